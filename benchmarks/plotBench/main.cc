@@ -0,0 +1,479 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QQuickView>
+#include <QQuickItem>
+#include <QQmlComponent>
+#include <QQmlContext>
+#include <QQmlEngine>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <QCanChannel.h>
+#include <QCanSignals.h>
+#include <QCanTrace.h>
+#include <QRealtimePlotter.h>
+
+#define SIGNALS_PER_FRAME   4
+#define FIRST_FRAME_ID      0x100
+#define BACKLOG_PERIOD_MS   50
+#define BUFFER_TIME_MS      (60 * 1000.0)
+
+static quint64 _now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+ * Channel without a socket generating frames with four 16 bit signals each.
+ * All frames are sent once per period and every value changes with each
+ * period. If the consumers fall behind the frames are sent back to back.
+ */
+class SyntheticChannel : public QCanChannel
+{
+public:
+    SyntheticChannel(int num_signals, int rate)
+     : m_NumSignals(num_signals), m_Rate(rate), m_Samples(0) {}
+
+    ~SyntheticChannel() { Stop(); }
+
+    bool IsValid() { return true; }
+
+    void Stop()
+    {
+        m_TerminationRequested = true;
+
+        wait();
+    }
+
+    bool Send(const QCanMessage &) { return true; }
+
+    /// Number of signal values sent so far
+    quint64 getSampleCount() const { return m_Samples.load(); }
+
+protected:
+    void run();
+
+private:
+    const int m_NumSignals;
+    const int m_Rate;
+
+    QAtomicInteger<quint64> m_Samples;
+};
+
+void SyntheticChannel::run()
+{
+    const quint64 period_us = 1000000ULL / m_Rate;
+    quint64 due_us = _now_us();
+    quint16 counter = 0;
+    QCanMessage message;
+    int i, j;
+
+    ::memset(&message, 0, sizeof(message));
+    message.dlc = 8;
+
+    while (!m_TerminationRequested) {
+        quint64 now_us = _now_us();
+
+        // Sleep in small steps to stay responsive to Stop()
+        if (now_us < due_us) {
+            struct timespec ts;
+
+            ts.tv_sec = 0;
+            ts.tv_nsec = qMin<quint64>(due_us - now_us, 10000) * 1000;
+
+            while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+                ;
+
+            continue;
+        }
+
+        gettimeofday(&message.tv, NULL);
+        counter++;
+
+        for (i = 0; i * SIGNALS_PER_FRAME < m_NumSignals; i++) {
+            const int count = qMin(SIGNALS_PER_FRAME, m_NumSignals - i * SIGNALS_PER_FRAME);
+
+            message.id = FIRST_FRAME_ID + i;
+
+            // Saw tooth with a different phase for each signal
+            for (j = 0; j < count; j++) {
+                quint16 raw = counter * 37 + (i * SIGNALS_PER_FRAME + j) * 1000;
+
+                message.data[2 * j] = raw & 0xFF;
+                message.data[2 * j + 1] = raw >> 8;
+            }
+
+            canMessageReceived(message);
+            m_Samples += count;
+        }
+
+        due_us += period_us;
+    }
+}
+
+/**
+ * Synthetic source decoded into QCanSignals. Samples arriving at the GUI
+ * thread are counted, the difference to the generated samples is the
+ * backlog queued in the event loop.
+ */
+class SyntheticBus
+{
+public:
+    SyntheticBus(int num_signals, int rate, QCanSignals::decode_mode_t mode);
+    ~SyntheticBus();
+
+    const QVector<QCanSignal *> & getSignals() const { return m_Signals; }
+
+    /// Run the source and process events for duration_ms
+    void run(int duration_ms);
+
+    /// Print throughput and backlog of the last run
+    void report(const QString & name, quint64 frames) const;
+
+private:
+    SyntheticChannel m_Channel;
+    QCanSignals *m_Bus;
+    QVector<QCanSignal *> m_Signals;
+
+    // Context of the sample counter, lives in the GUI thread
+    QObject m_Receiver;
+
+    quint64 m_Ingested;
+    quint64 m_Generated;
+    quint64 m_MaxBacklog;
+    qint64 m_Elapsed_ns;
+};
+
+SyntheticBus::SyntheticBus(int num_signals, int rate, QCanSignals::decode_mode_t mode)
+ : m_Channel(num_signals, rate), m_Ingested(0), m_Generated(0), m_MaxBacklog(0), m_Elapsed_ns(0)
+{
+    int i, j;
+
+    m_Bus = new QCanSignals(&m_Channel, mode);
+
+    for (i = 0; i * SIGNALS_PER_FRAME < num_signals; i++) {
+        QString messageName = QString("Frame%1").arg(i);
+        QCanSignalContainer *sc = new QCanSignalContainer(messageName, FIRST_FRAME_ID + i, false);
+
+        for (j = 0; j < SIGNALS_PER_FRAME && i * SIGNALS_PER_FRAME + j < num_signals; j++) {
+            QString signalName = QString("Signal%1").arg(i * SIGNALS_PER_FRAME + j);
+            QCanSignal *signal = new QCanSignal(signalName, 16 * j, 16, ENDIANESS_INTEL);
+
+            signal->setEquationOperands(0.01, 0.0);
+            signal->setLimit(0.0, 655.35);
+            sc->addSignal(signal);
+
+            m_Signals.append(signal);
+
+            QObject::connect(signal, &QCanSignal::valueChanged, &m_Receiver,
+                             [this](const struct timeval &, double) { m_Ingested++; });
+        }
+
+        m_Bus->addMessage(sc);
+    }
+}
+
+SyntheticBus::~SyntheticBus()
+{
+    m_Channel.Stop();
+
+    delete m_Bus;
+}
+
+void SyntheticBus::run(int duration_ms)
+{
+    QEventLoop loop;
+    QTimer sampler;
+    QElapsedTimer timer;
+
+    QObject::connect(&sampler, &QTimer::timeout, [this]() {
+        quint64 generated = m_Channel.getSampleCount();
+
+        if (generated > m_Ingested)
+            m_MaxBacklog = qMax(m_MaxBacklog, generated - m_Ingested);
+    });
+
+    QTimer::singleShot(duration_ms, &loop, SLOT(quit()));
+    sampler.start(BACKLOG_PERIOD_MS);
+
+    timer.start();
+    m_Channel.Start();
+
+    loop.exec();
+
+    m_Channel.Stop();
+    m_Elapsed_ns = timer.nsecsElapsed();
+    m_Generated = m_Channel.getSampleCount();
+}
+
+void SyntheticBus::report(const QString & name, quint64 frames) const
+{
+    const double seconds = m_Elapsed_ns / 1e9;
+    const quint64 backlog = m_Generated > m_Ingested ? m_Generated - m_Ingested : 0;
+
+    printf("%-40s %10.0f offered %10.0f ingested samples/s  backlog max %8llu end %8llu  %5.1f fps\n",
+           qPrintable(name), m_Generated / seconds, m_Ingested / seconds,
+           (unsigned long long)qMax(m_MaxBacklog, backlog), (unsigned long long)backlog,
+           frames / seconds);
+}
+
+static void ReportTimes(const char *name, const QCanLatencyHistogram & times)
+{
+    if (times.getCount() == 0)
+        return;
+
+    printf("    %-36s p50 %7.2f p90 %7.2f p99 %7.2f max %7.2f ms (%llu)\n", name,
+           times.percentile(0.50) / 1e6, times.percentile(0.90) / 1e6,
+           times.percentile(0.99) / 1e6, times.getMax() / 1e6,
+           (unsigned long long)times.getCount());
+}
+
+/**
+ * Plotter timing each replot and each paint of the canvas
+ */
+class BenchPlotter : public QRealtimePlotter
+{
+public:
+    BenchPlotter() : QRealtimePlotter(BUFFER_TIME_MS), m_Frames(0) {}
+
+    void replot()
+    {
+        QElapsedTimer timer;
+
+        timer.start();
+        QRealtimePlotter::replot();
+        m_ReplotTimes.add(timer.nsecsElapsed());
+    }
+
+    quint64 getFrameCount() const { return m_Frames; }
+
+    const QCanLatencyHistogram & getReplotTimes() const { return m_ReplotTimes; }
+    const QCanLatencyHistogram & getPaintTimes() const { return m_PaintTimes; }
+    const QCanLatencyHistogram & getRasterTimes() const { return m_RasterTimes; }
+
+protected:
+    void drawCanvas(QPainter *painter)
+    {
+        QRealtimePlotter::drawCanvas(painter);
+
+        m_Frames++;
+        m_PaintTimes.add(getPaintTime_us() * 1000);
+
+        if (getRenderMode() == E_RENDER_THREADED)
+            m_RasterTimes.add(getRasterTime_us() * 1000);
+    }
+
+private:
+    quint64 m_Frames;
+
+    QCanLatencyHistogram m_ReplotTimes;
+    QCanLatencyHistogram m_PaintTimes;
+    QCanLatencyHistogram m_RasterTimes;
+};
+
+static void BenchPlot(int num_signals, int rate, QCanSignals::decode_mode_t mode,
+                      QRealtimePlotter::render_mode_t render_mode, int duration_ms)
+{
+    SyntheticBus bus(num_signals, rate, mode);
+    BenchPlotter plotter;
+    int i;
+
+    plotter.setRenderMode(render_mode);
+    plotter.changeScale(QRealtimePlotter::E_SCALE_LEFT, 0.0, 655.35, QString());
+
+    for (i = 0; i < bus.getSignals().size(); i++)
+        plotter.addCurve(QRealtimePlotter::E_SCALE_LEFT, *bus.getSignals()[i], QColor::fromHsv((i * 37) % 360, 255, 200));
+
+    plotter.resize(1280, 480);
+    plotter.show();
+    plotter.startRecording();
+
+    bus.run(duration_ms);
+
+    bus.report(QString("plot %1 %2 curves x %3 Hz")
+               .arg(render_mode == QRealtimePlotter::E_RENDER_THREADED ? "threaded" : "direct")
+               .arg(num_signals).arg(rate), plotter.getFrameCount());
+
+    ReportTimes("replot", plotter.getReplotTimes());
+    ReportTimes("paint canvas", plotter.getPaintTimes());
+    ReportTimes("rasterise (worker)", plotter.getRasterTimes());
+}
+
+/// Grid with a text and a bar bound to each signal
+static QByteArray CreateQml(int num_signals)
+{
+    QByteArray qml = "import QtQuick 2.0\n"
+                     "Grid {\n"
+                     "    columns: 8\n"
+                     "    spacing: 4\n";
+    int i;
+
+    for (i = 0; i < num_signals; i++) {
+        qml += QString("    Column {\n"
+                       "        Text { text: sig_%1.value.toFixed(2) }\n"
+                       "        Rectangle { width: sig_%1.value / 4; height: 6; color: \"steelblue\" }\n"
+                       "    }\n").arg(i).toUtf8();
+    }
+
+    qml += "}\n";
+
+    return qml;
+}
+
+static void BenchQml(int num_signals, int rate, QCanSignals::decode_mode_t mode, int duration_ms)
+{
+    SyntheticBus bus(num_signals, rate, mode);
+    QQuickView view;
+    QQmlComponent component(view.engine());
+    int i;
+
+    for (i = 0; i < bus.getSignals().size(); i++)
+        view.rootContext()->setContextProperty(QString("sig_%1").arg(i), bus.getSignals()[i]);
+
+    component.setData(CreateQml(num_signals), QUrl());
+
+    QQuickItem *root = qobject_cast<QQuickItem *>(component.create(view.rootContext()));
+
+    if (root == NULL) {
+        fprintf(stderr, "%s\n", qPrintable(component.errorString()));
+        return;
+    }
+
+    root->setParentItem(view.contentItem());
+
+    // Render signals are emitted by the render thread if there is one
+    QCanLatencyHistogram renderTimes;
+    QElapsedTimer renderTimer;
+    QAtomicInteger<quint64> frames(0);
+
+    QObject::connect(&view, &QQuickWindow::beforeSynchronizing, [&renderTimer]() {
+        renderTimer.start();
+    }, Qt::DirectConnection);
+    QObject::connect(&view, &QQuickWindow::afterRendering, [&renderTimer, &renderTimes]() {
+        renderTimes.add(renderTimer.nsecsElapsed());
+    }, Qt::DirectConnection);
+    QObject::connect(&view, &QQuickWindow::frameSwapped, [&frames]() {
+        frames++;
+    }, Qt::DirectConnection);
+
+    view.resize(1280, 720);
+    view.show();
+
+    bus.run(duration_ms);
+
+    // Stop rendering before the counters go out of scope
+    view.hide();
+
+    bus.report(QString("qml %1 signals x %2 Hz").arg(num_signals).arg(rate), frames.load());
+
+    ReportTimes("sync and render", renderTimes);
+
+    delete root;
+}
+
+int main(int argc, char *argv[])
+{
+    // Headless by default, the benchmark must run without a display
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    // Offscreen platform has no OpenGL context
+    if (qEnvironmentVariableIsEmpty("QT_QUICK_BACKEND"))
+        qputenv("QT_QUICK_BACKEND", "software");
+
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+
+    parser.addHelpOption();
+
+    QCommandLineOption curvesOption("curves",
+                "Comma separated numbers of curves (signals) to run (default: 1,8,32)", "n,...", "1,8,32");
+    parser.addOption(curvesOption);
+
+    QCommandLineOption rateOption("rate",
+                "Samples per second of each signal (default: 100)", "hz", "100");
+    parser.addOption(rateOption);
+
+    QCommandLineOption durationOption("duration",
+                "Seconds to run each configuration (default: 5)", "seconds", "5");
+    parser.addOption(durationOption);
+
+    QCommandLineOption rxThreadDecodeOption("decode-on-rx-thread",
+                "Decode frames on the CAN receive thread instead of the GUI thread");
+    parser.addOption(rxThreadDecodeOption);
+
+    QCommandLineOption renderOption("render",
+                "Comma separated plot render modes, direct and/or threaded (default: both)", "mode,...", "direct,threaded");
+    parser.addOption(renderOption);
+
+    QCommandLineOption targetOption("target",
+                "Comma separated views to load, plot and/or qml (default: both)", "view,...", "plot,qml");
+    parser.addOption(targetOption);
+
+    parser.process(a);
+
+    const int rate = parser.value(rateOption).toInt();
+    const int duration_ms = parser.value(durationOption).toInt() * 1000;
+    const QStringList targets = parser.value(targetOption).split(",");
+    const QStringList renderModes = parser.value(renderOption).split(",");
+    const QCanSignals::decode_mode_t mode = parser.isSet(rxThreadDecodeOption) ?
+            QCanSignals::E_DECODE_RX_THREAD : QCanSignals::E_DECODE_GUI_THREAD;
+
+    if (rate <= 0 || duration_ms <= 0) {
+        fprintf(stderr, "--rate and --duration must be positive\n");
+        return 1;
+    }
+
+    QString curves;
+    foreach(curves, parser.value(curvesOption).split(",")) {
+        const int num_signals = curves.toInt();
+
+        if (num_signals <= 0)
+            continue;
+
+        if (targets.contains("plot")) {
+            if (renderModes.contains("direct"))
+                BenchPlot(num_signals, rate, mode, QRealtimePlotter::E_RENDER_DIRECT, duration_ms);
+
+            if (renderModes.contains("threaded"))
+                BenchPlot(num_signals, rate, mode, QRealtimePlotter::E_RENDER_THREADED, duration_ms);
+        }
+
+        if (targets.contains("qml"))
+            BenchQml(num_signals, rate, mode, duration_ms);
+    }
+
+    return 0;
+}
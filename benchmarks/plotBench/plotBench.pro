@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = plotBench
+CONFIG += console
+QT += core \
+    gui \
+    widgets \
+    quick \
+    xml
+SOURCES += main.cc
+LIBS += -L../../qcan -lqcan -L../../widgets -lwidgets -lqwt-qt5 -lrt
+INCLUDEPATH += ../../qcan ../../widgets
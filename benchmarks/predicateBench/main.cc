@@ -0,0 +1,183 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QCanChannel.h>
+#include <QCanSignals.h>
+#include <QCanPredicate.h>
+
+#define NUM_FRAMES 65536
+#define NUM_ROUNDS 200
+
+/**
+ * Channel without a socket, frames are fed by the benchmark
+ */
+class BenchChannel : public QCanChannel
+{
+public:
+    BenchChannel() {}
+
+    bool Send(const QCanMessage &) { return true; }
+};
+
+static QCanSignals * CreateBus(QCanChannel *channel)
+{
+    QCanSignals *bus = new QCanSignals(channel);
+
+    QString absName("ABS");
+    QString speedName("Speed");
+    QString brakeName("Brake");
+    QCanSignalContainer *abs = new QCanSignalContainer(absName, 0x0B2, false);
+    QCanSignal *speed = new QCanSignal(speedName, 0, 16, ENDIANESS_INTEL);
+    QCanSignal *brake = new QCanSignal(brakeName, 16, 1, ENDIANESS_INTEL);
+
+    speed->setEquationOperands(0.01, 0.0);
+    speed->setLimit(0.0, 655.35);
+    abs->addSignal(speed);
+    abs->addSignal(brake);
+    bus->addMessage(abs);
+
+    QString engineName("Engine");
+    QString rpmName("Rpm");
+    QString tempName("Temp");
+    QCanSignalContainer *engine = new QCanSignalContainer(engineName, 0x0C0, false);
+    QCanSignal *rpm = new QCanSignal(rpmName, 0, 16, ENDIANESS_INTEL);
+    QCanSignal *temp = new QCanSignal(tempName, 16, 8, ENDIANESS_INTEL);
+
+    rpm->setLimit(0.0, 65535.0);
+    temp->setEquationOperands(1.0, -40.0);
+    temp->setLimit(-40.0, 215.0);
+    engine->addSignal(rpm);
+    engine->addSignal(temp);
+    bus->addMessage(engine);
+
+    return bus;
+}
+
+static void CreateFrames(QVector<QCanMessage> & frames)
+{
+    static const quint32 ids[] = { 0x0B2, 0x0C0, 0x100, 0x200, 0x7DF };
+
+    frames.resize(NUM_FRAMES);
+    srand(1);
+
+    for (int i = 0; i < frames.size(); i++) {
+        QCanMessage & f = frames[i];
+
+        ::memset(&f, 0, sizeof(f));
+        f.tv.tv_sec = i / 1000;
+        f.tv.tv_usec = (i % 1000) * 1000;
+        f.id = ids[rand() % (sizeof(ids) / sizeof(ids[0]))];
+        f.dlc = 8;
+
+        for (int j = 0; j < 8; j++)
+            f.data[j] = rand() & 0xFF;
+    }
+}
+
+static void Report(const char *name, qint64 elapsed_ns, quint64 evaluations, quint64 matches)
+{
+    printf("%-70s %8.1f Meval/s %7.1f ns/eval %6.2f%% match\n", name,
+           evaluations * 1000.0 / elapsed_ns, (double)elapsed_ns / evaluations,
+           100.0 * matches / evaluations);
+}
+
+static void BenchPredicate(const QString & expression, QCanSignals *bus, const QVector<QCanMessage> & frames)
+{
+    QCanPredicate predicate;
+
+    predicate.addBus("Motor", bus);
+
+    if (!predicate.compile(expression)) {
+        fprintf(stderr, "%s: %s\n", qPrintable(expression), qPrintable(predicate.getError()));
+        return;
+    }
+
+    QElapsedTimer timer;
+    quint64 matches = 0;
+
+    timer.start();
+
+    for (int r = 0; r < NUM_ROUNDS; r++) {
+        for (int i = 0; i < frames.size(); i++)
+            matches += predicate.evaluate(frames[i]);
+    }
+
+    Report(qPrintable(expression), timer.nsecsElapsed(), (quint64)NUM_ROUNDS * frames.size(), matches);
+}
+
+// What a hand written filter slot does today: name lookups for every frame
+static void BenchLookup(QCanSignals *bus, const QVector<QCanMessage> & frames)
+{
+    QElapsedTimer timer;
+    quint64 matches = 0;
+
+    timer.start();
+
+    for (int r = 0; r < NUM_ROUNDS; r++) {
+        for (int i = 0; i < frames.size(); i++) {
+            const QCanMessage & f = frames[i];
+            QCanSignal *speed = (*(*bus)["ABS"])["Speed"];
+
+            matches += speed->physicalValueFromMessage(f) > 120 && f.id == 0x0B2;
+        }
+    }
+
+    Report("QString lookup: ABS.Speed > 120 && id == 0x0B2", timer.nsecsElapsed(),
+           (quint64)NUM_ROUNDS * frames.size(), matches);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList expressions = a.arguments().mid(1);
+
+    if (expressions.isEmpty()) {
+        expressions << "Motor.ABS.Speed > 120 && id == 0x0B2"
+                    << "id == 0x0B2"
+                    << "(data[0] & 0x0F) == 3 && dlc == 8"
+                    << "Engine.Rpm > 3000 && Engine.Temp > 100 || ABS.Brake && ABS.Speed * 3.6 > 50"
+                    << "((data[1] << 8 | data[0]) ^ 0x5A5A) % 7 == 0 && !ext";
+    }
+
+    BenchChannel channel;
+    QCanSignals *bus = CreateBus(&channel);
+    QVector<QCanMessage> frames;
+
+    CreateFrames(frames);
+
+    BenchLookup(bus, frames);
+
+    QString expression;
+    foreach(expression, expressions)
+        BenchPredicate(expression, bus, frames);
+
+    delete bus;
+
+    return 0;
+}
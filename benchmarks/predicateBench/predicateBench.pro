@@ -0,0 +1,9 @@
+TEMPLATE = app
+TARGET = predicateBench
+CONFIG += console
+QT += core \
+    xml
+QT -= gui
+SOURCES += main.cc
+LIBS += -L../../qcan -lqcan
+INCLUDEPATH += ../../qcan
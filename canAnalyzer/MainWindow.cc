@@ -18,25 +18,151 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QFile>
+#include <QHeaderView>
+#include <QFontDatabase>
+#include <QInputDialog>
+#include <QScrollBar>
+#include <QDir>
+#include <QActionGroup>
+#include <QDomDocument>
+
 #include <MainWindow.h>
+#include <TraceModel.h>
+#include <OverviewModel.h>
+#include <QCanReplayChannel.h>
+#include <QCanSignals.h>
+
+static void _setupTableView(QTableView *view, QAbstractItemModel *model)
+{
+    view->setModel(model);
+    view->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    view->setWordWrap(false);
+
+    // Fixed row height, the view never measures rows outside the viewport
+    view->verticalHeader()->hide();
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->verticalHeader()->setDefaultSectionSize(view->fontMetrics().height() + 4);
+    view->horizontalHeader()->setStretchLastSection(true);
+}
 
 MainWindow::MainWindow()
+ : m_CanChannel(NULL), m_Interface("vcan0"), m_Signals(NULL), m_FollowTrace(true)
 {
+    int i;
+
     this->setupUi(this);
 
+    m_TraceModel = new TraceModel(1 << 20, this);
+    m_OverviewModel = new OverviewModel(this);
+
+    _setupTableView(traceView, m_TraceModel);
+    _setupTableView(overviewView, m_OverviewModel);
+
+    for (i = OverviewModel::E_COLUMN_DATA0; i < OverviewModel::E_COLUMN_COUNT; i++)
+        overviewView->setColumnWidth(i, overviewView->fontMetrics().width("000"));
+
+    QActionGroup *viewGroup = new QActionGroup(this);
+    viewGroup->addAction(actionTrace);
+    viewGroup->addAction(actionOverview);
+
+    QObject::connect(viewGroup, SIGNAL(triggered(QAction *)), this, SLOT(onMenuView(QAction *)));
+    QObject::connect(actionLoadKcd, SIGNAL(triggered()), this, SLOT(onMenuLoadKcd()));
+
+    QObject::connect(m_TraceModel, SIGNAL(rowsAboutToBeInserted(const QModelIndex &, int, int)), this, SLOT(traceRowsAboutToBeInserted()));
+    QObject::connect(m_TraceModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)), this, SLOT(traceRowsInserted()));
+
     QObject::connect(actionConnect, SIGNAL(triggered()), this, SLOT(onMenuConnect()));
+    QObject::connect(actionReplay, SIGNAL(triggered()), this, SLOT(onMenuReplay()));
+    QObject::connect(actionDisconnect, SIGNAL(triggered()), this, SLOT(onMenuDisconnect()));
+}
+
+MainWindow::~MainWindow()
+{
+    onMenuDisconnect();
+
+    m_OverviewModel->setSignals(NULL);
+    delete m_Signals;
+}
+
+void MainWindow::openChannel(QCanChannel *channel, const QString & name)
+{
+    onMenuDisconnect();
+
+    m_CanChannel = channel;
+    m_ChannelName = name;
+
+    m_TraceModel->clear();
+    m_OverviewModel->clear();
+    m_FollowTrace = true;
+
+    // Frames are stored by the receive thread and shown once per display frame
+    QObject::connect(m_CanChannel, SIGNAL(canMessageReceived(const QCanMessage &)),
+                     m_TraceModel, SLOT(canMessageReceived(const QCanMessage &)), Qt::DirectConnection);
+    QObject::connect(m_CanChannel, SIGNAL(canMessageReceived(const QCanMessage &)),
+                     m_OverviewModel, SLOT(canMessageReceived(const QCanMessage &)), Qt::DirectConnection);
+
+    if (!m_CanChannel->Start())
+        statusbar->showMessage(QString("Failed to open %1").arg(name));
+    else
+        setWindowTitle(QString("canAnalyzer - %1").arg(name));
+}
+
+/// Names of all CAN network interfaces
+static QStringList _canInterfaces()
+{
+    QDir dir("/sys/class/net");
+    QStringList interfaces;
+    QString name;
+
+    foreach(name, dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QFile type(dir.filePath(name + "/type"));
+
+        // ARPHRD_CAN
+        if (type.open(QIODevice::ReadOnly) && type.readAll().trimmed() == "280")
+            interfaces.append(name);
+    }
+
+    return interfaces;
 }
 
 /**
- * Open configured CAN interface
+ * Select and open a CAN interface
  */
 void MainWindow::onMenuConnect()
 {
-    m_CanChannel = new QCanChannel("vcan0");
+    QStringList interfaces = _canInterfaces();
+    bool ok;
+
+    if (!interfaces.contains(m_Interface))
+        interfaces.prepend(m_Interface);
+
+    QString name = QInputDialog::getItem(this, "Connect", "CAN interface:", interfaces,
+                                         interfaces.indexOf(m_Interface), true, &ok);
+
+    if (!ok || name.isEmpty())
+        return;
+
+    m_Interface = name;
+
+    openChannel(new QCanChannel(name), name);
+}
+
+/**
+ * Replay a log file instead of a CAN interface
+ */
+void MainWindow::onMenuReplay()
+{
+    QString filename = QFileDialog::getOpenFileName(this, "Replay log file", QString(),
+                                                    "CAN log files (*.log *.asc);;All files (*)");
 
-    QObject::connect(m_CanChannel, SIGNAL(canMessageReceived(const QCanMessage &)), this, SLOT(canMessageReceived(const QCanMessage &)));
+    if (filename.isEmpty())
+        return;
 
-    m_CanChannel->Start();
+    openChannel(new QCanReplayChannel(filename), QFileInfo(filename).fileName());
 }
 
 /**
@@ -44,10 +170,88 @@ void MainWindow::onMenuConnect()
  */
 void MainWindow::onMenuDisconnect()
 {
+    if (!m_CanChannel)
+        return;
+
+    m_CanChannel->Stop();
+
+    delete m_CanChannel;
+    m_CanChannel = NULL;
+}
+
+/**
+ * Load message descriptions to decode the signals of the overview
+ */
+void MainWindow::onMenuLoadKcd()
+{
+    QString filename = QFileDialog::getOpenFileName(this, "Load KCD file", QString(),
+                                                    "KCD files (*.kcd);;All files (*)");
+
+    if (filename.isEmpty())
+        return;
+
+    QFile file(filename);
+    QDomDocument doc;
+    QStringList busses;
+    int i;
+
+    if (file.open(QIODevice::ReadOnly) && doc.setContent(&file)) {
+        QDomNodeList nodes = doc.documentElement().elementsByTagName("Bus");
+
+        for (i = 0; i < nodes.size(); i++)
+            busses.append(nodes.at(i).toElement().attribute("name"));
+    }
+
+    if (busses.isEmpty()) {
+        statusbar->showMessage(QString("No bus found in %1").arg(filename));
+        return;
+    }
+
+    QString bus = busses.first();
+    bool ok = true;
+
+    if (busses.size() > 1)
+        bus = QInputDialog::getItem(this, "Load KCD file", "Bus:", busses, 0, false, &ok);
+
+    if (!ok)
+        return;
+
+    // Frames are only decoded for the rows shown by the overview
+    QCanSignals *description = QCanSignals::createFromKCD(NULL, filename, bus);
+
+    if (!description) {
+        statusbar->showMessage(QString("Failed to load bus %1 from %2").arg(bus).arg(filename));
+        return;
+    }
+
+    m_OverviewModel->setSignals(description);
+
+    delete m_Signals;
+    m_Signals = description;
+}
+
+void MainWindow::onMenuView(QAction *action)
+{
+    viewStack->setCurrentWidget(action == actionOverview ? overviewPage : tracePage);
+}
+
+void MainWindow::traceRowsAboutToBeInserted()
+{
+    QScrollBar *bar = traceView->verticalScrollBar();
+
+    m_FollowTrace = bar->value() == bar->maximum();
 }
 
-void MainWindow::canMessageReceived(const QCanMessage & frame)
+void MainWindow::traceRowsInserted()
 {
-    qDebug("Received");
+    if (m_FollowTrace)
+        traceView->scrollToBottom();
+
+    QString message = QString("%1: %2 frames").arg(m_ChannelName).arg(m_TraceModel->getFrameCount());
+
+    if (m_TraceModel->getDroppedCount())
+        message += QString(", %1 not shown").arg(m_TraceModel->getDroppedCount());
+
+    statusbar->showMessage(message);
 }
 
@@ -26,6 +26,10 @@
 
 #include <QCanChannel.h>
 
+class TraceModel;
+class OverviewModel;
+class QCanSignals;
+
 class MainWindow : public QMainWindow,
                    public Ui::MainWindow
 {
@@ -33,15 +37,35 @@ class MainWindow : public QMainWindow,
 
     public:
         MainWindow();
+        virtual ~MainWindow();
 
     private slots:
         void onMenuConnect();
+        void onMenuReplay();
         void onMenuDisconnect();
+        void onMenuLoadKcd();
+        void onMenuView(QAction *action);
 
-        void canMessageReceived(const QCanMessage & frame);
+        void traceRowsAboutToBeInserted();
+        void traceRowsInserted();
 
     private:
+        void openChannel(QCanChannel *channel, const QString & name);
+
         QCanChannel *m_CanChannel;
+        QString m_ChannelName;
+
+        // Interface selected the last time
+        QString m_Interface;
+
+        TraceModel *m_TraceModel;
+        OverviewModel *m_OverviewModel;
+
+        // Message descriptions of the loaded KCD file, not attached to the channel
+        QCanSignals *m_Signals;
+
+        // Trace was scrolled to the end, keep following new frames
+        bool m_FollowTrace;
 };
 
 #endif
@@ -0,0 +1,416 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <QColor>
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include <OverviewModel.h>
+#include <QCanSignals.h>
+
+#define OVERVIEW_STD_SLOTS  (CAN_SFF_MASK + 1)
+
+// Flags of a slot key
+#define KEY_USED            (1U << 30)
+#define KEY_EXT             (1U << 31)
+
+static inline void _extend(int & first, int & last, int column)
+{
+    first = qMin(first, column);
+    last = qMax(last, column);
+}
+
+OverviewModel::OverviewModel(QObject *parent)
+ : QAbstractTableModel(parent), m_NewSlotCount(0), m_KnownSlots(0), m_Signals(NULL)
+{
+    m_Slots.resize(OVERVIEW_STD_SLOTS + OVERVIEW_EXT_SLOTS);
+    m_NewSlots.resize(m_Slots.size());
+
+    m_Statistics = new QCanChannelStatistics();
+
+    m_Clock.start();
+
+    QObject::connect(&m_UpdateTimer, SIGNAL(timeout()), this, SLOT(update()));
+
+    setFrameRate(30);
+}
+
+OverviewModel::~OverviewModel()
+{
+    delete m_Statistics;
+}
+
+void OverviewModel::setFrameRate(int fps)
+{
+    m_UpdateTimer.start(1000 / qMax(fps, 1));
+}
+
+void OverviewModel::clear()
+{
+    int i;
+
+    beginResetModel();
+
+    for (i = 0; i < m_Slots.size(); i++)
+        m_Slots[i].key.store(0);
+
+    m_NewSlotCount.store(0);
+    m_Rows.clear();
+    m_KnownSlots = 0;
+
+    delete m_Statistics;
+    m_Statistics = new QCanChannelStatistics();
+
+    endResetModel();
+}
+
+void OverviewModel::setSignals(QCanSignals *bus)
+{
+    int i;
+
+    m_Signals = bus;
+
+    for (i = 0; i < m_Rows.size(); i++) {
+        m_Rows[i].message = findMessage(m_Rows[i].key);
+        m_Rows[i].decoded = decodeSignals(m_Rows[i]);
+    }
+
+    if (!m_Rows.isEmpty())
+        emit dataChanged(index(0, E_COLUMN_SIGNALS), index(m_Rows.size() - 1, E_COLUMN_SIGNALS));
+}
+
+int OverviewModel::findSlot(quint32 id, bool isExt, bool & inserted)
+{
+    const quint32 key = KEY_USED | (isExt ? KEY_EXT : 0) | (id & CAN_EFF_MASK);
+    int index, i;
+
+    inserted = false;
+
+    if (!isExt) {
+        index = id & CAN_SFF_MASK;
+    } else {
+        // Linear probing, slots are only freed by clear()
+        for (i = 0; i < OVERVIEW_EXT_SLOTS; i++) {
+            index = OVERVIEW_STD_SLOTS + ((id * 2654435761U + i) & (OVERVIEW_EXT_SLOTS - 1));
+
+            const quint32 k = m_Slots[index].key.load();
+
+            if (k == key)
+                return index;
+
+            if (k == 0)
+                break;
+        }
+
+        if (i == OVERVIEW_EXT_SLOTS)
+            return -1;
+    }
+
+    if (m_Slots[index].key.load() != key) {
+        m_Slots[index].key.store(key);
+        inserted = true;
+    }
+
+    return index;
+}
+
+void OverviewModel::canMessageReceived(const QCanMessage & frame)
+{
+    bool inserted;
+    const int index = findSlot(frame.id, frame.isExt, inserted);
+
+    m_Statistics->frameReceived(frame);
+
+    if (index < 0)
+        return;
+
+    Slot & slot = m_Slots[index];
+
+    slot.lock.beginWrite();
+    slot.frame = frame;
+    slot.lock.endWrite();
+
+    // New identifiers are published once their first frame is stored
+    if (inserted) {
+        const int count = m_NewSlotCount.load();
+
+        m_NewSlots[count] = index;
+        m_NewSlotCount.storeRelease(count + 1);
+    }
+}
+
+QCanSignalContainer * OverviewModel::findMessage(quint32 key) const
+{
+    if (!m_Signals)
+        return NULL;
+
+    QCanSignalContainer *sc;
+    foreach(sc, m_Signals->getMessageList()) {
+        if (sc->getCanId() == (key & CAN_EFF_MASK) && sc->isExt() == ((key & KEY_EXT) != 0))
+            return sc;
+    }
+
+    return NULL;
+}
+
+QString OverviewModel::decodeSignals(const Row & row) const
+{
+    QString decoded;
+
+    if (!row.message)
+        return decoded;
+
+    QCanSignal *signal;
+    foreach(signal, row.message->getSignalList()) {
+        if (!decoded.isEmpty())
+            decoded += "  ";
+
+        decoded += QString("%1=%2").arg(signal->getName()).arg(signal->physicalValueFromMessage(row.frame));
+    }
+
+    return decoded;
+}
+
+void OverviewModel::refreshRow(Row & row, qint64 now_ms, int & first, int & last)
+{
+    const Slot & slot = m_Slots[row.slot];
+    int j;
+
+    // Highlight of bytes which did not change again runs out
+    if (row.highlighted) {
+        row.highlighted = false;
+
+        for (j = 0; j < 8; j++) {
+            if (!row.changed_ms[j])
+                continue;
+
+            if (now_ms - row.changed_ms[j] < OVERVIEW_HIGHLIGHT_MS) {
+                row.highlighted = true;
+                continue;
+            }
+
+            row.changed_ms[j] = 0;
+            _extend(first, last, E_COLUMN_DATA0 + j);
+        }
+    }
+
+    if (slot.lock.getWriteCount() == row.sequence)
+        return;
+
+    QCanMessage frame;
+    int sequence;
+
+    do {
+        sequence = slot.lock.beginRead();
+        frame = slot.frame;
+    } while (slot.lock.retryRead(sequence));
+
+    // Nothing is highlighted when the row is filled for the first time
+    const bool initial = row.sequence == 0;
+
+    row.sequence = static_cast<quint32>(sequence) >> 1;
+
+    if (frame.dlc != row.frame.dlc)
+        _extend(first, last, E_COLUMN_DLC);
+
+    for (j = 0; j < 8; j++) {
+        const bool present = j < frame.dlc;
+
+        if (present != (j < row.frame.dlc)) {
+            _extend(first, last, E_COLUMN_DATA0 + j);
+        } else if (present && frame.data[j] != row.frame.data[j]) {
+            _extend(first, last, E_COLUMN_DATA0 + j);
+
+            if (!initial) {
+                row.changed_ms[j] = now_ms;
+                row.highlighted = true;
+            }
+        }
+    }
+
+    row.frame = frame;
+
+    m_Statistics->getIdStatistics(frame.id, frame.isExt, row.statistics);
+    _extend(first, last, E_COLUMN_COUNT);
+    _extend(first, last, E_COLUMN_JITTER);
+
+    if (row.message) {
+        QString decoded = decodeSignals(row);
+
+        if (decoded != row.decoded) {
+            row.decoded = decoded;
+            _extend(first, last, E_COLUMN_SIGNALS);
+        }
+    }
+}
+
+void OverviewModel::update()
+{
+    // 0 marks bytes which are not highlighted
+    const qint64 now_ms = m_Clock.elapsed() + 1;
+    const int count = m_NewSlotCount.loadAcquire();
+    int i, first, last;
+
+    // Identifiers received for the first time get a row at their sorted position
+    for (; m_KnownSlots < count; m_KnownSlots++) {
+        Row row;
+
+        row.slot = m_NewSlots[m_KnownSlots];
+        row.key = m_Slots[row.slot].key.load();
+        row.sequence = 0;
+        row.message = findMessage(row.key);
+        row.highlighted = false;
+
+        ::memset(&row.frame, 0, sizeof(row.frame));
+        ::memset(&row.statistics, 0, sizeof(row.statistics));
+        ::memset(row.changed_ms, 0, sizeof(row.changed_ms));
+
+        // Inserted rows are complete, no need to track changed columns
+        first = E_NUM_COLUMNS;
+        last = -1;
+        refreshRow(row, now_ms, first, last);
+
+        i = std::lower_bound(m_Rows.constBegin(), m_Rows.constEnd(), row.key,
+                             [](const Row & r, quint32 key) { return r.key < key; }) - m_Rows.constBegin();
+
+        beginInsertRows(QModelIndex(), i, i);
+        m_Rows.insert(i, row);
+        endInsertRows();
+    }
+
+    // One dataChanged() per changed row, covering its changed columns
+    for (i = 0; i < m_Rows.size(); i++) {
+        first = E_NUM_COLUMNS;
+        last = -1;
+
+        refreshRow(m_Rows[i], now_ms, first, last);
+
+        if (first <= last)
+            emit dataChanged(index(i, first), index(i, last));
+    }
+}
+
+int OverviewModel::rowCount(const QModelIndex & parent) const
+{
+    return parent.isValid() ? 0 : m_Rows.size();
+}
+
+int OverviewModel::columnCount(const QModelIndex & parent) const
+{
+    return parent.isValid() ? 0 : E_NUM_COLUMNS;
+}
+
+QVariant OverviewModel::data(const QModelIndex & index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_Rows.size())
+        return QVariant();
+
+    const Row & row = m_Rows[index.row()];
+    const int column = index.column();
+    const int byte = column - E_COLUMN_DATA0;
+    const bool isData = byte >= 0 && byte < 8;
+
+    if (role == Qt::BackgroundRole) {
+        if (isData && row.changed_ms[byte])
+            return QColor(255, 220, 120);
+
+        return QVariant();
+    }
+
+    if (role == Qt::TextAlignmentRole) {
+        if (column == E_COLUMN_SIGNALS)
+            return int(Qt::AlignLeft | Qt::AlignVCenter);
+
+        if (isData)
+            return int(Qt::AlignCenter);
+
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    char text[16];
+
+    if (isData) {
+        if (byte >= row.frame.dlc)
+            return QVariant();
+
+        snprintf(text, sizeof(text), "%02X", row.frame.data[byte]);
+        return QString::fromLatin1(text);
+    }
+
+    switch (column) {
+    case E_COLUMN_ID:
+        snprintf(text, sizeof(text), row.frame.isExt ? "%08X" : "%03X", row.frame.id);
+        return QString::fromLatin1(text);
+
+    case E_COLUMN_DLC:
+        return row.frame.dlc;
+
+    case E_COLUMN_COUNT:
+        return (qulonglong)row.statistics.count;
+
+    case E_COLUMN_PERIOD:
+        if (row.statistics.count < 2)
+            return QVariant();
+
+        return QString::number(row.statistics.meanPeriod_ms, 'f', 1);
+
+    case E_COLUMN_JITTER:
+        if (row.statistics.count < 3)
+            return QVariant();
+
+        return QString::number(row.statistics.jitter_ms, 'f', 2);
+
+    case E_COLUMN_SIGNALS:
+        return row.decoded;
+    }
+
+    return QVariant();
+}
+
+QVariant OverviewModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole || section >= E_NUM_COLUMNS)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    if (section >= E_COLUMN_DATA0 && section < E_COLUMN_DATA0 + 8)
+        return QString::number(section - E_COLUMN_DATA0);
+
+    switch (section) {
+    case E_COLUMN_ID:
+        return QString("ID");
+    case E_COLUMN_DLC:
+        return QString("DLC");
+    case E_COLUMN_COUNT:
+        return QString("Count");
+    case E_COLUMN_PERIOD:
+        return QString("Period [ms]");
+    case E_COLUMN_JITTER:
+        return QString("Jitter [ms]");
+    case E_COLUMN_SIGNALS:
+        return QString("Signals");
+    }
+
+    return QVariant();
+}
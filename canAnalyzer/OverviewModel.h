@@ -0,0 +1,159 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef _OVERVIEW_MODEL_H_
+#define _OVERVIEW_MODEL_H_
+
+#include <QAbstractTableModel>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+
+#include <QCanChannel.h>
+#include <QCanChannelStatistics.h>
+#include <QCanSeqLock.h>
+
+class QCanSignals;
+class QCanSignalContainer;
+
+/// Extended identifiers tracked at once, must be a power of two
+#define OVERVIEW_EXT_SLOTS      4096
+
+/// Time a changed data byte stays highlighted
+#define OVERVIEW_HIGHLIGHT_MS   1000
+
+/**
+ * Table with one row per received CAN identifier, sorted by identifier.
+ *
+ * The receive thread only stores the last frame of each identifier and
+ * updates its counters, nothing is queued per frame. Once per display frame
+ * the rows of identifiers received since the last update are refreshed and
+ * dataChanged() is emitted for the changed columns of those rows only, so
+ * the GUI thread load depends on the number of identifiers, not on the
+ * frame rate.
+ */
+class OverviewModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+    public:
+        typedef enum E_COLUMN {
+            E_COLUMN_ID = 0,
+            E_COLUMN_DLC,
+            E_COLUMN_DATA0,
+            E_COLUMN_COUNT = E_COLUMN_DATA0 + 8,
+            E_COLUMN_PERIOD,
+            E_COLUMN_JITTER,
+            E_COLUMN_SIGNALS,
+            E_NUM_COLUMNS
+        } column_t;
+
+        OverviewModel(QObject *parent = NULL);
+        virtual ~OverviewModel();
+
+        /// Refresh rows at most fps times per second (default: 30)
+        void setFrameRate(int fps);
+
+        /// Remove all rows, the channel must not be running
+        void clear();
+
+        /**
+         * Messages used to decode the signals column, not owned. The bus
+         * should not be attached to a channel, frames are decoded on
+         * demand. NULL hides the decoded signals.
+         */
+        void setSignals(QCanSignals *bus);
+
+        int rowCount(const QModelIndex & parent = QModelIndex()) const;
+        int columnCount(const QModelIndex & parent = QModelIndex()) const;
+        QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const;
+        QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+    public slots:
+        /// Store a frame, must be connected with Qt::DirectConnection
+        void canMessageReceived(const QCanMessage & frame);
+
+    private slots:
+        /// Refresh rows of identifiers received since the last update
+        void update();
+
+    private:
+        // Last frame of an identifier, written by the receive thread
+        struct Slot {
+            // Identifier with flags, 0 while unused
+            QAtomicInteger<quint32> key;
+
+            QCanSeqLock lock;
+            QCanMessage frame;
+        };
+
+        struct Row {
+            quint32 key;
+            int slot;
+
+            // Write count of the slot when the row was refreshed
+            quint32 sequence;
+
+            QCanMessage frame;
+            QCanIdStatistics statistics;
+
+            QCanSignalContainer *message;
+            QString decoded;
+
+            // Time the data bytes last changed, 0 if not highlighted
+            qint64 changed_ms[8];
+            bool highlighted;
+        };
+
+        /// @return slot index, -1 if the extended table is full
+        int findSlot(quint32 id, bool isExt, bool & inserted);
+
+        /**
+         * Read the slot of a row if it was written since the last refresh
+         * and extend [first, last] by the columns which changed
+         */
+        void refreshRow(Row & row, qint64 now_ms, int & first, int & last);
+
+        QCanSignalContainer * findMessage(quint32 key) const;
+        QString decodeSignals(const Row & row) const;
+
+        // Standard identifiers are indexed directly, extended identifiers
+        // are kept in an open addressing table behind them
+        QVector<Slot> m_Slots;
+
+        // Slots in order of first reception, published by m_NewSlotCount
+        QVector<int> m_NewSlots;
+        QAtomicInt m_NewSlotCount;
+
+        // Count, period and jitter, maintained by the receive thread
+        QCanChannelStatistics *m_Statistics;
+
+        // Only used by the GUI thread
+        QVector<Row> m_Rows;
+        int m_KnownSlots;
+
+        QCanSignals *m_Signals;
+
+        QElapsedTimer m_Clock;
+        QTimer m_UpdateTimer;
+};
+
+#endif
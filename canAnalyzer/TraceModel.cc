@@ -0,0 +1,165 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdio.h>
+
+#include <TraceModel.h>
+
+static inline quint64 _toUs(const struct timeval & tv)
+{
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+TraceModel::TraceModel(int capacity, QObject *parent)
+ : QAbstractTableModel(parent), m_Head(0), m_First(0), m_End(0), m_Dropped(0), m_StartTime_us(0)
+{
+    m_Ring.resize(qMax(capacity, 4));
+
+    QObject::connect(&m_UpdateTimer, SIGNAL(timeout()), this, SLOT(update()));
+
+    setFrameRate(30);
+}
+
+TraceModel::~TraceModel()
+{
+}
+
+void TraceModel::setFrameRate(int fps)
+{
+    m_UpdateTimer.start(1000 / qMax(fps, 1));
+}
+
+void TraceModel::clear()
+{
+    beginResetModel();
+
+    m_Head.storeRelease(0);
+    m_First = 0;
+    m_End = 0;
+    m_Dropped = 0;
+    m_StartTime_us = 0;
+
+    endResetModel();
+}
+
+void TraceModel::canMessageReceived(const QCanMessage & frame)
+{
+    quint64 head = m_Head.loadAcquire();
+
+    m_Ring[head % m_Ring.size()] = frame;
+    m_Head.storeRelease(++head);
+}
+
+void TraceModel::update()
+{
+    const quint64 head = m_Head.loadAcquire();
+    const quint64 visible = m_Ring.size() - m_Ring.size() / 4;
+
+    if (head == m_End)
+        return;
+
+    // Rows the receive thread will overwrite soon leave the view first
+    const quint64 first = head > visible ? head - visible : 0;
+
+    if (first > m_First) {
+        const quint64 removed = qMin(first, m_End) - m_First;
+
+        if (removed > 0) {
+            beginRemoveRows(QModelIndex(), 0, removed - 1);
+            m_First += removed;
+            endRemoveRows();
+        }
+
+        // More frames than the ring holds arrived since the last update
+        if (first > m_End) {
+            m_Dropped += first - m_End;
+            m_First = first;
+            m_End = first;
+        }
+    }
+
+    if (m_StartTime_us == 0)
+        m_StartTime_us = _toUs(m_Ring[m_End % m_Ring.size()].tv);
+
+    // One insertion for all frames of this display frame
+    beginInsertRows(QModelIndex(), m_End - m_First, head - m_First - 1);
+    m_End = head;
+    endInsertRows();
+}
+
+int TraceModel::rowCount(const QModelIndex & parent) const
+{
+    return parent.isValid() ? 0 : m_End - m_First;
+}
+
+int TraceModel::columnCount(const QModelIndex & parent) const
+{
+    return parent.isValid() ? 0 : E_NUM_COLUMNS;
+}
+
+QVariant TraceModel::data(const QModelIndex & index, int role) const
+{
+    if (!index.isValid() || index.row() >= rowCount())
+        return QVariant();
+
+    if (role == Qt::TextAlignmentRole) {
+        if (index.column() == E_COLUMN_DATA)
+            return int(Qt::AlignLeft | Qt::AlignVCenter);
+
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    const QCanMessage & frame = frameAt(index.row());
+    char text[32];
+    int i, len;
+
+    switch (index.column()) {
+    case E_COLUMN_TIME:
+        return QString::number(((qint64)_toUs(frame.tv) - (qint64)m_StartTime_us) / 1000000.0, 'f', 6);
+
+    case E_COLUMN_ID:
+        snprintf(text, sizeof(text), frame.isExt ? "%08X" : "%03X", frame.id);
+        return QString::fromLatin1(text);
+
+    case E_COLUMN_DLC:
+        return frame.dlc;
+
+    case E_COLUMN_DATA:
+        for (i = 0, len = 0; i < frame.dlc && i < 8; i++)
+            len += snprintf(text + len, sizeof(text) - len, i ? " %02X" : "%02X", frame.data[i]);
+
+        return QString::fromLatin1(text, len);
+    }
+
+    return QVariant();
+}
+
+QVariant TraceModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    static const char *names[E_NUM_COLUMNS] = { "Time", "ID", "DLC", "Data" };
+
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole || section >= E_NUM_COLUMNS)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    return QString(names[section]);
+}
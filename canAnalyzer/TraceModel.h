@@ -0,0 +1,106 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef _TRACE_MODEL_H_
+#define _TRACE_MODEL_H_
+
+#include <QAbstractTableModel>
+#include <QAtomicInteger>
+#include <QTimer>
+#include <QVector>
+
+#include <QCanChannel.h>
+
+/**
+ * Table of received frames, newest last. Frames are written into a
+ * preallocated ring by the channel receive thread without any allocation
+ * or event per frame. Once per display frame the new frames are announced
+ * to the view with a single row insertion, only the rows scrolled into
+ * view are ever formatted.
+ *
+ * The oldest quarter of the ring is not shown, it keeps the receive thread
+ * from overwriting rows the view may still read until the next update.
+ */
+class TraceModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+    public:
+        typedef enum E_COLUMN {
+            E_COLUMN_TIME = 0,
+            E_COLUMN_ID,
+            E_COLUMN_DLC,
+            E_COLUMN_DATA,
+            E_NUM_COLUMNS
+        } column_t;
+
+        /**
+         * @param capacity number of frames kept, the default holds about two
+         * minutes of a fully loaded 1 Mbit/s bus
+         */
+        TraceModel(int capacity = 1 << 20, QObject *parent = NULL);
+        virtual ~TraceModel();
+
+        /// Show new frames at most fps times per second (default: 30)
+        void setFrameRate(int fps);
+
+        /// Remove all frames, the channel must not be running
+        void clear();
+
+        /// Number of frames received since the last clear()
+        quint64 getFrameCount() const { return m_Head.loadAcquire(); }
+
+        /// Frames received but overwritten before they were shown
+        quint64 getDroppedCount() const { return m_Dropped; }
+
+        int rowCount(const QModelIndex & parent = QModelIndex()) const;
+        int columnCount(const QModelIndex & parent = QModelIndex()) const;
+        QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const;
+        QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+    public slots:
+        /// Store a frame, must be connected with Qt::DirectConnection
+        void canMessageReceived(const QCanMessage & frame);
+
+    private slots:
+        /// Announce frames received since the last update to the view
+        void update();
+
+    private:
+        const QCanMessage & frameAt(int row) const {
+            return m_Ring[(m_First + row) % m_Ring.size()];
+        }
+
+        // Frame ring, only written by the receive thread
+        QVector<QCanMessage> m_Ring;
+        QAtomicInteger<quint64> m_Head;
+
+        // Frames shown by the view [m_First, m_End), only used by the GUI thread
+        quint64 m_First;
+        quint64 m_End;
+        quint64 m_Dropped;
+
+        // Time column is relative to the first frame
+        quint64 m_StartTime_us;
+
+        QTimer m_UpdateTimer;
+};
+
+#endif
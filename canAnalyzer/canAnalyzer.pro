@@ -4,8 +4,10 @@ QT += core \
     gui \
     widgets \
     xml
-HEADERS += MainWindow.h 
-SOURCES += main.cc MainWindow.cc
+HEADERS += MainWindow.h \
+           OverviewModel.h \
+           TraceModel.h
+SOURCES += main.cc MainWindow.cc TraceModel.cc OverviewModel.cc
 FORMS += mainwindow.ui
 RESOURCES +=
 LIBS += -L../qcan -lqcan
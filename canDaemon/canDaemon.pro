@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = canDaemon
+CONFIG += console
+QT += core \
+    network \
+    xml
+QT -= gui
+SOURCES += main.cc
+RESOURCES +=
+LIBS += -L../qcan -lqcan -lrt
+INCLUDEPATH += ../qcan
@@ -0,0 +1,216 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+
+#include <signal.h>
+
+#include <QCanChannel.h>
+#include <QCanSignals.h>
+#include <QCanReplayChannel.h>
+#include <QCanSharedSignals.h>
+#include <QCanStreamServer.h>
+
+struct bus_channel_mapping {
+    QString channel;
+    QString bus;
+};
+
+typedef QList<struct bus_channel_mapping> bus_channel_map_t;
+
+static volatile sig_atomic_t s_TerminationRequested = 0;
+
+static void SignalHandler(int)
+{
+    s_TerminationRequested = 1;
+}
+
+static void CreateBusChannelMappingFromString(const QString & str, bus_channel_map_t & map)
+{
+    QStringList l = str.split(",");
+    QString s;
+
+    foreach(s, l) {
+        int channel_sep = s.indexOf("=");
+
+        struct bus_channel_mapping map_entry;
+
+        map_entry.channel = s.left(channel_sep);
+        map_entry.bus = s.mid(channel_sep + 1);
+
+        map.push_back(map_entry);
+    }
+}
+
+/**
+ * Headless daemon decoding CAN busses once and publishing all signal values
+ * in shared memory, see QCanSharedSignals. Optionally the values are streamed
+ * to remote clients, see QCanStreamServer.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+
+    parser.addHelpOption();
+
+    QCommandLineOption busChannelMappingOption ("bus-channel-mapping",
+                "List of bus/channel mappings, e.g.: vcan0=Motor,vcan2=Machine", "mapping");
+    parser.addOption(busChannelMappingOption);
+
+    QCommandLineOption kcdFileOption("kcd-file",
+                "Path to KCD (Kayak CAN definition file)", "file");
+    parser.addOption(kcdFileOption);
+
+    QCommandLineOption sharedMemoryOption("shared-memory",
+                "Name of the shared memory segment (default: qcan)", "name");
+    parser.addOption(sharedMemoryOption);
+
+    QCommandLineOption replayOption("replay",
+                "Replay a candump (-l), Vector ASC or binary recording file instead of "
+                "using CAN channels", "file");
+    parser.addOption(replayOption);
+
+    QCommandLineOption replaySpeedOption("replay-speed",
+                "Replay speed factor, 1 is real time, 0 is unthrottled (default: 1)", "factor");
+    parser.addOption(replaySpeedOption);
+
+    QCommandLineOption streamPortOption("stream-port",
+                "Stream changed signal values to remote clients on a TCP port", "port");
+    parser.addOption(streamPortOption);
+
+    QCommandLineOption bitrateOption("bitrate",
+                "Nominal bitrate of all busses for the bus load estimate (default: 500000)", "bitrate");
+    parser.addOption(bitrateOption);
+
+    QCommandLineOption busStatisticsOption("bus-statistics",
+                "Print frame rate, bus load, error frames and kernel drops of each channel "
+                "periodically", "seconds");
+    parser.addOption(busStatisticsOption);
+
+    parser.process(a);
+
+    if (!parser.isSet(kcdFileOption)) {
+        qWarning("No signal definition file (e.g. Kayak) found");
+        return -1;
+    }
+
+    if (!parser.isSet(busChannelMappingOption)) {
+        qWarning("No bus/channel mapping given");
+        return -1;
+    }
+
+    QString kcdfile = parser.value(kcdFileOption);
+    QString name = parser.isSet(sharedMemoryOption) ? parser.value(sharedMemoryOption) : QString("qcan");
+
+    bus_channel_map_t map;
+    CreateBusChannelMappingFromString(parser.value(busChannelMappingOption), map);
+
+    QList<QCanChannel*> channels;
+    QCanSharedSignals shared(name);
+    QCanStreamServer stream;
+    struct bus_channel_mapping m;
+
+    foreach(m, map) {
+        QCanChannel *c;
+
+        if (parser.isSet(replayOption)) {
+            double speed = parser.isSet(replaySpeedOption) ? parser.value(replaySpeedOption).toDouble() : 1.0;
+
+            c = new QCanReplayChannel(parser.value(replayOption), m.channel, speed);
+        } else {
+            c = new QCanChannel(m.channel);
+        }
+
+        // Values are published directly by the receive threads
+        QCanSignals *s = QCanSignals::createFromKCD(c, kcdfile, m.bus, QCanSignals::E_DECODE_RX_THREAD);
+
+        if (!s) {
+            qWarning("Unable to load bus %s", qPrintable(m.bus));
+            return -1;
+        }
+
+        if (parser.isSet(bitrateOption))
+            c->setBitrate(parser.value(bitrateOption).toUInt());
+
+        shared.addBus(m.bus, s);
+
+        if (parser.isSet(streamPortOption))
+            stream.addBus(m.bus, s);
+
+        channels.push_back(c);
+    }
+
+    if (!shared.create()) {
+        qWarning("Unable to create shared memory segment %s, is another canDaemon publishing it?", qPrintable(name));
+        return -1;
+    }
+
+    if (parser.isSet(streamPortOption) && !stream.listen(parser.value(streamPortOption).toUShort())) {
+        qWarning("Unable to listen on port %s", qPrintable(parser.value(streamPortOption)));
+        shared.destroy();
+        return -1;
+    }
+
+    QCanChannel *c;
+    foreach(c, channels)
+        c->Start();
+
+    // Remove the segment on SIGINT/SIGTERM
+    signal(SIGINT, SignalHandler);
+    signal(SIGTERM, SignalHandler);
+
+    QTimer terminationTimer;
+    QObject::connect(&terminationTimer, &QTimer::timeout, [&a]() {
+        if (s_TerminationRequested)
+            a.quit();
+    });
+    terminationTimer.start(100);
+
+    QTimer statisticsTimer;
+    QObject::connect(&statisticsTimer, &QTimer::timeout, [&map, &channels]() {
+        for (int i = 0; i < channels.size(); i++) {
+            QCanBusStatistics stats;
+
+            channels[i]->getStatistics().sample(stats);
+
+            qWarning("%s: %.0f frames/s, load %.1f%%, %llu error frames, %llu bus-off, %llu dropped",
+                     qPrintable(map[i].channel), stats.framesPerSecond, stats.busLoad * 100.0,
+                     (unsigned long long)stats.errorFrames, (unsigned long long)stats.busOff,
+                     (unsigned long long)stats.overflowDrops);
+        }
+    });
+
+    if (parser.isSet(busStatisticsOption))
+        statisticsTimer.start(parser.value(busStatisticsOption).toDouble() * 1000);
+
+    int ret = a.exec();
+
+    foreach(c, channels)
+        c->Stop();
+
+    stream.close();
+    shared.destroy();
+
+    return ret;
+}
@@ -7,5 +7,5 @@ QT += core \
     xml
 SOURCES += main.cc
 RESOURCES +=
-LIBS += -L../qcan -lqcan
+LIBS += -L../qcan -lqcan -lrt
 INCLUDEPATH += ../qcan
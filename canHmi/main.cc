@@ -24,9 +24,20 @@
 #include <QQuickView>
 #include <QQmlContext>
 #include <QCommandLineParser>
+#include <QTimer>
 
 #include <QCanChannel.h>
 #include <QCanSignals.h>
+#include <QCanTxScheduler.h>
+#include <QCanReplayChannel.h>
+#include <QCanRecorder.h>
+#include <QCanMergeChannel.h>
+#include <QCanFlightRecorder.h>
+#include <QCanPredicate.h>
+#include <QCanGateway.h>
+#include <QCanSharedSignalsClient.h>
+#include <QCanSignalStatistics.h>
+#include <QCanTrace.h>
 
 struct bus_channel_mapping {
     QString channel;
@@ -35,6 +46,12 @@ struct bus_channel_mapping {
 
 typedef QList<struct bus_channel_mapping> bus_channel_map_t;
 
+struct gateway_route {
+    QString name;
+    QCanGateway *gateway;
+    int route;
+};
+
 static void CreateBusChannelMappingFromString(const QString & str, bus_channel_map_t & map)
 {
     QStringList l = str.split(",");
@@ -71,8 +88,104 @@ int main(int argc, char *argv[])
                 "Path to local file which describes the HMI view", "file");
     parser.addOption(qmlFileOption);
 
+    QCommandLineOption rxThreadDecodeOption("decode-on-rx-thread",
+                "Decode frames on the CAN receive thread instead of the GUI thread");
+    parser.addOption(rxThreadDecodeOption);
+
+    QCommandLineOption cyclicTxOption("cyclic-tx",
+                "Send all messages with a KCD interval cyclically");
+    parser.addOption(cyclicTxOption);
+
+    QCommandLineOption replayOption("replay",
+                "Replay a candump (-l), Vector ASC or binary recording file, mapped channel names "
+                "select the interface (candump) or channel number (ASC) to replay", "file");
+    parser.addOption(replayOption);
+
+    QCommandLineOption replaySpeedOption("replay-speed",
+                "Replay speed factor, 1 is real time, 0 is unthrottled (default: 1)", "factor");
+    parser.addOption(replaySpeedOption);
+
+    QCommandLineOption recordOption("record",
+                "Record all received frames to a binary recording file", "file");
+    parser.addOption(recordOption);
+
+    QCommandLineOption mergeLatencyOption("merge-latency",
+                "Record frames of all channels in timestamp order, frames are held back at most "
+                "the given time for reordering", "ms");
+    parser.addOption(mergeLatencyOption);
+
+    QCommandLineOption recordFilterOption("record-filter",
+                "Only record frames matching an expression, e.g. \"Motor.ABS.Speed > 120 || id == 0x0B2\"",
+                "expression");
+    parser.addOption(recordFilterOption);
+
+    QCommandLineOption flightRecorderOption("flight-recorder",
+                "Keep recent traffic in memory and save it to <prefix>-<time>-<n>.qcr when the "
+                "trigger expression becomes true", "prefix");
+    parser.addOption(flightRecorderOption);
+
+    QCommandLineOption triggerOption("trigger",
+                "Flight recorder trigger expression, e.g. \"Motor.ABS.Speed > 120 && id == 0x0B2\"",
+                "expression");
+    parser.addOption(triggerOption);
+
+    QCommandLineOption routeOption("route",
+                "Gateway messages between busses, signals with equal names are copied, "
+                "e.g. Motor.ABS=Machine.ABS_GW,Machine.Cmd=Motor.Cmd", "routes");
+    parser.addOption(routeOption);
+
+    QCommandLineOption routeStatisticsOption("route-statistics",
+                "Print frames, errors, latency and processing time of each route periodically",
+                "seconds");
+    parser.addOption(routeStatisticsOption);
+
+    QCommandLineOption statisticsOption("statistics",
+                "Collect sliding window statistics of signals, available in QML as "
+                "<bus>_<message>_<signal>_stats, e.g. Motor.ABS.Speed,Motor.ABS.Torque", "signals");
+    parser.addOption(statisticsOption);
+
+    QCommandLineOption statisticsWindowOption("statistics-window",
+                "Length of the statistics window (default: 10000)", "ms");
+    parser.addOption(statisticsWindowOption);
+
+    QCommandLineOption traceOption("trace",
+                "Measure latencies from kernel timestamp to screen update and write "
+                "histograms per stage to a file on exit", "file");
+    parser.addOption(traceOption);
+
+    QCommandLineOption sharedMemoryOption("shared-memory",
+                "Show signals published by canDaemon instead of opening CAN channels", "name");
+    parser.addOption(sharedMemoryOption);
+
     parser.process(a);
 
+    if (parser.isSet(sharedMemoryOption)) {
+        QCanSharedSignalsClient client;
+
+        if (!client.attach(parser.value(sharedMemoryOption))) {
+            qWarning("Unable to attach to shared memory segment");
+            return -1;
+        }
+
+        QObject::connect(&client, &QCanSharedSignalsClient::writerTerminated, []() {
+            qWarning("canDaemon has terminated, values are no longer updated");
+        });
+
+        QQuickView view;
+
+        // Same names as for local channels, e.g. Motor_ABS_Speed
+        for (int i = 0; i < client.getSignalCount(); i++) {
+            QString name = client.getSignalName(i);
+
+            view.rootContext()->setContextProperty(QString(name).replace(".", "_"), client.getSignal(name));
+        }
+
+        view.setSource(QUrl::fromLocalFile(parser.value(qmlFileOption)));
+        view.show();
+
+        return a.exec();
+    }
+
     if (!parser.isSet(kcdFileOption)) {
         qWarning("No signal definition file (e.g. Kayak) found");
         return -1;
@@ -91,6 +204,9 @@ int main(int argc, char *argv[])
         mappingstr = parser.value(busChannelMappingOption);
     }
 
+    QCanSignals::decode_mode_t decodeMode = parser.isSet(rxThreadDecodeOption) ?
+                QCanSignals::E_DECODE_RX_THREAD : QCanSignals::E_DECODE_GUI_THREAD;
+
     bus_channel_map_t map;
 
     // Parse bus-channel-mapping argument and build a list busses and channels
@@ -101,14 +217,46 @@ int main(int argc, char *argv[])
 
     QQuickView view;
 
+    if (parser.isSet(traceOption)) {
+        QCanTrace::setEnabled(true);
+
+        QObject::connect(&view, &QQuickWindow::frameSwapped, []() {
+            QCanTrace::recordRendered();
+        });
+    }
+
+    QList<QCanChannel*> channels;
+    QList<QCanSignals*> busses;
+    QCanPredicate recordFilter;
+    QCanSignalStatistics statistics;
+    QCanPredicate trigger;
+
     foreach(m, map) {
-        QCanChannel *c = new QCanChannel(m.channel);
-        QCanSignals *s = QCanSignals::createFromKCD(c, kcdfile, m.bus);
+        QCanChannel *c;
+
+        if (parser.isSet(replayOption)) {
+            double speed = parser.isSet(replaySpeedOption) ? parser.value(replaySpeedOption).toDouble() : 1.0;
+
+            c = new QCanReplayChannel(parser.value(replayOption), m.channel, speed);
+        } else {
+            c = new QCanChannel(m.channel);
+        }
+
+        QCanSignals *s = QCanSignals::createFromKCD(c, kcdfile, m.bus, decodeMode);
 
         QCanSignalContainer *sc;
         foreach(sc, s->getMessageList()) {
             QCanSignal *cc;
 
+            // Messages provide consistent multi-signal snapshots, e.g.
+            // Motor_ABS.getSnapshot()
+            QString messageName = m.bus;
+
+            messageName.append("_");
+            messageName.append(sc->getName());
+
+            view.rootContext()->setContextProperty(messageName, sc);
+
             foreach(cc, sc->getSignalList()) {
                 QString fullName = m.bus;
 
@@ -121,12 +269,188 @@ int main(int argc, char *argv[])
             }
         }
 
-	c->Start();
+        recordFilter.addBus(m.bus, s);
+        trigger.addBus(m.bus, s);
+
+        channels.push_back(c);
+        busses.push_back(s);
+    }
+
+    if (parser.isSet(statisticsOption)) {
+        quint32 window = parser.isSet(statisticsWindowOption) ? parser.value(statisticsWindowOption).toUInt() : 10000;
+        QStringList names = parser.value(statisticsOption).split(",");
+        QString n;
+
+        foreach(n, names) {
+            QStringList parts = n.split(".");
+            QCanSignalContainer *sc = NULL;
+            QCanSignal *sig = NULL;
+
+            for (int i = 0; parts.size() == 3 && i < map.size(); i++) {
+                if (map[i].bus == parts[0])
+                    sc = (*busses[i])[parts[1]];
+            }
+
+            if (sc)
+                sig = (*sc)[parts[2]];
+
+            if (!sig) {
+                qWarning("Unknown signal %s", qPrintable(n));
+                return -1;
+            }
+
+            view.rootContext()->setContextProperty(QString("%1_stats").arg(parts.join("_")),
+                                                   statistics.addSignal(sc, sig, window));
+        }
+    }
+
+    QCanRecorder *recorder = NULL;
+    QCanMergeChannel *merge = NULL;
+
+    if (parser.isSet(recordOption)) {
+        recorder = new QCanRecorder();
+
+        if (!recorder->open(parser.value(recordOption))) {
+            qWarning("Unable to create recording file");
+            return -1;
+        }
+
+        if (parser.isSet(recordFilterOption)) {
+            if (!recordFilter.compile(parser.value(recordFilterOption))) {
+                qWarning("Invalid record filter: %s", qPrintable(recordFilter.getError()));
+                return -1;
+            }
+
+            recorder->setFilter(&recordFilter);
+        }
+
+        if (parser.isSet(mergeLatencyOption)) {
+            merge = new QCanMergeChannel(parser.value(mergeLatencyOption).toInt());
+
+            for (int i = 0; i < channels.size(); i++)
+                merge->addChannel(channels[i]);
+
+            recorder->attach(merge);
+            merge->Start();
+        }
+    }
+
+    if (parser.isSet(flightRecorderOption) && !trigger.compile(parser.value(triggerOption))) {
+        qWarning("Invalid flight recorder trigger: %s", qPrintable(trigger.getError()));
+        return -1;
+    }
+
+    QList<struct gateway_route> gatewayRoutes;
+
+    if (parser.isSet(routeOption)) {
+        QHash<QCanChannel*, QCanGateway*> gateways;
+        QStringList routes = parser.value(routeOption).split(",");
+        QString r;
+
+        foreach(r, routes) {
+            QStringList from = r.section("=", 0, 0).split(".");
+            QStringList to = r.section("=", 1, 1).split(".");
+            int source = -1, destination = -1;
+
+            for (int i = 0; i < map.size(); i++) {
+                if (from.size() == 2 && map[i].bus == from[0])
+                    source = i;
+
+                if (to.size() == 2 && map[i].bus == to[0])
+                    destination = i;
+            }
+
+            QCanSignalContainer *sourceMessage = source >= 0 ? (*busses[source])[from[1]] : NULL;
+            QCanSignalContainer *destinationMessage = destination >= 0 ? (*busses[destination])[to[1]] : NULL;
+
+            if (!sourceMessage || !destinationMessage) {
+                qWarning("Invalid route %s", qPrintable(r));
+                return -1;
+            }
+
+            QCanGateway *gateway = gateways.value(channels[source], NULL);
+
+            if (!gateway) {
+                gateway = new QCanGateway(channels[source]);
+                gateways.insert(channels[source], gateway);
+            }
+
+            int route = gateway->addRoute(sourceMessage, channels[destination], destinationMessage);
+
+            QCanSignal *sig;
+            foreach(sig, destinationMessage->getSignalList()) {
+                QCanSignal *sourceSignal = (*sourceMessage)[sig->getName()];
+
+                if (sourceSignal)
+                    gateway->addSignalRule(route, sourceSignal, sig);
+            }
+
+            struct gateway_route gr;
+
+            gr.name = r;
+            gr.gateway = gateway;
+            gr.route = route;
+
+            gatewayRoutes.push_back(gr);
+        }
+    }
+
+    QTimer routeStatisticsTimer;
+    QObject::connect(&routeStatisticsTimer, &QTimer::timeout, [&gatewayRoutes]() {
+        for (int i = 0; i < gatewayRoutes.size(); i++) {
+            QCanGatewayStatistics stats;
+
+            gatewayRoutes[i].gateway->getStatistics(gatewayRoutes[i].route, stats);
+
+            qWarning("%s: %llu frames, %llu errors, latency %.1f/%.1f/%.1f us (min/mean/max), "
+                     "processing %.1f/%.1f us (mean/max)",
+                     qPrintable(gatewayRoutes[i].name), (unsigned long long)stats.count,
+                     (unsigned long long)stats.errors, stats.minLatency_ns / 1000.0,
+                     stats.meanLatency_ns / 1000.0, stats.maxLatency_ns / 1000.0,
+                     stats.meanProcessing_ns / 1000.0, stats.maxProcessing_ns / 1000.0);
+        }
+    });
+
+    if (parser.isSet(routeStatisticsOption))
+        routeStatisticsTimer.start(parser.value(routeStatisticsOption).toDouble() * 1000);
+
+    for (int i = 0; i < channels.size(); i++) {
+        QCanChannel *c = channels[i];
+
+        if (recorder && !merge)
+            recorder->attach(c);
+
+        if (parser.isSet(flightRecorderOption)) {
+            QCanFlightRecorder *flightRecorder = new QCanFlightRecorder(c);
+
+            flightRecorder->setFilePrefix(QString("%1-%2").arg(parser.value(flightRecorderOption)).arg(i));
+            flightRecorder->addPredicateTrigger(&trigger);
+        }
+
+        c->Start();
+
+        if (parser.isSet(cyclicTxOption)) {
+            QCanTxScheduler *scheduler = new QCanTxScheduler(c);
+
+            scheduler->addMessages(busses[i]);
+            scheduler->Start();
+        }
     }
 
     view.setSource(QUrl::fromLocalFile(qmlfile));
     view.show();
 
-    return a.exec();
+    int ret = a.exec();
+
+    if (merge)
+        merge->Stop();
+
+    if (recorder)
+        recorder->close();
+
+    if (parser.isSet(traceOption) && !QCanTrace::dump(parser.value(traceOption)))
+        qWarning("Unable to write trace file");
+
+    return ret;
 }
 
@@ -20,7 +20,11 @@
  */
 #include <QDomDocument>
 #include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
 #include <qwt/qwt_slider.h>
+#include <qwt/qwt_scale_widget.h>
+#include <qwt/qwt_scale_draw.h>
 
 #include "MainWindow.h"
 
@@ -72,9 +76,12 @@ ScaleDescription * ScaleDescription::CreateScaleDescriptionFromString(const QStr
     return sd;
 }
 
-MainWindow::MainWindow(const QString & channel, const QString & filename,
+MainWindow::MainWindow(QCanChannel * channel, const QString & filename,
                        const QString & busname, QObject* parent)
- : m_CanChannel(channel), m_CanSignals(NULL)
+ : m_CanChannel(channel), m_CanSignals(NULL), m_SharedSignals(NULL), m_StreamSignals(NULL),
+   m_BusName(busname), m_Plotter(NULL), m_Stores(new QRealtimeSampleStores(this)),
+   m_BufferTime_ms(10 * 60 * 1000.0), m_MemoryBudget(64 * 1024 * 1024), m_SpillSize(128 * 1024 * 1024),
+   m_ThreadedRendering(false)
 {
     this->setLayout(new QVBoxLayout());
 
@@ -95,20 +102,82 @@ MainWindow::MainWindow(const QString & channel, const QString & filename,
     QDomElement e = findBusByName(docElem, busname);
 
     if (!e.isNull())
-        m_CanSignals = QCanSignals::createFromKCD(&m_CanChannel, e);
+        m_CanSignals = QCanSignals::createFromKCD(m_CanChannel, e);
 
     file.close();
 
-    m_CanChannel.Start();
+    m_CanChannel->Start();
+}
+
+MainWindow::MainWindow(QCanSharedSignalsClient * client,
+                       const QString & busname, QObject* parent)
+ : m_CanChannel(NULL), m_CanSignals(NULL), m_SharedSignals(client), m_StreamSignals(NULL),
+   m_BusName(busname), m_Plotter(NULL), m_Stores(new QRealtimeSampleStores(this)),
+   m_BufferTime_ms(10 * 60 * 1000.0), m_MemoryBudget(64 * 1024 * 1024), m_SpillSize(128 * 1024 * 1024),
+   m_ThreadedRendering(false)
+{
+    this->setLayout(new QVBoxLayout());
+
+    setWindowTitle("openCanAnalyzer");
+}
+
+MainWindow::MainWindow(QCanStreamClient * client,
+                       const QString & busname, QObject* parent)
+ : m_CanChannel(NULL), m_CanSignals(NULL), m_SharedSignals(NULL), m_StreamSignals(client),
+   m_BusName(busname), m_Plotter(NULL), m_Stores(new QRealtimeSampleStores(this)),
+   m_BufferTime_ms(10 * 60 * 1000.0), m_MemoryBudget(64 * 1024 * 1024), m_SpillSize(128 * 1024 * 1024),
+   m_ThreadedRendering(false)
+{
+    this->setLayout(new QVBoxLayout());
+
+    setWindowTitle("openCanAnalyzer");
 }
 
 MainWindow::~MainWindow()
 {
+    if (m_CanChannel)
+        m_CanChannel->Stop();
+
     if(m_CanSignals)
         delete m_CanSignals;
+
+    delete m_CanChannel;
+    delete m_SharedSignals;
+    delete m_StreamSignals;
+}
+
+const QObject * MainWindow::findSignal(const ScaleDescription::Curve & c, double & lower, double & upper)
+{
+    QString name = QString("%1.%2.%3").arg(m_BusName).arg(c.messsage).arg(c.signal);
+
+    if (m_SharedSignals) {
+        QCanSharedSignal * s = m_SharedSignals->getSignal(name);
+
+        if (s)
+            s->getLimit(lower, upper);
+
+        return s;
+    }
+
+    if (m_StreamSignals) {
+        QCanStreamSignal * s = m_StreamSignals->getSignal(name);
+
+        if (s)
+            s->getLimit(lower, upper);
+
+        return s;
+    }
+
+    QCanSignalContainer * sc = m_CanSignals ? (*m_CanSignals)[c.messsage] : NULL;
+    QCanSignal * s = sc ? (*sc)[c.signal] : NULL;
+
+    if (s)
+        s->getLimit(lower, upper);
+
+    return s;
 }
 
-void MainWindow::addScale(QRealtimePlotter::scale_t scale, const ScaleDescription & desc)
+void MainWindow::addScale(QRealtimePlotter * plotter, QRealtimePlotter::scale_t scale, const ScaleDescription & desc)
 {
     double lower = 0.0, upper = 0.0;
 
@@ -120,47 +189,117 @@ void MainWindow::addScale(QRealtimePlotter::scale_t scale, const ScaleDescriptio
         double tmp_lower = 0.0, tmp_upper = 0.0;
         ScaleDescription::Curve c = *iter;
 
-        QCanSignalContainer * sc = (*m_CanSignals)[c.messsage];
-
-        if (sc) {
-            QCanSignal * s = (*sc)[c.signal];
+        const QObject * s = findSignal(c, tmp_lower, tmp_upper);
 
-            if (s) {
-                s->getLimit(tmp_lower, tmp_upper);
+        if (s) {
+            if (tmp_lower < lower)
+                lower = tmp_lower;
 
-                if (tmp_lower < lower)
-                    lower = tmp_lower;
+            if (tmp_upper > upper)
+                upper = tmp_upper;
 
-                if (tmp_upper > upper)
-                    upper = tmp_upper;
-
-                m_Plotter->addCurve(scale, *s, c.color);
-            }
+            plotter->addCurve(scale, *s, c.color);
         }
         iter++;
     }
 
 
-    m_Plotter->changeScale(scale, lower, upper, desc.getScaleName());
+    plotter->changeScale(scale, lower, upper, desc.getScaleName());
+}
+
+void MainWindow::setBufferLimits(double buffer_time_ms, qint64 memory_budget, qint64 spill_size)
+{
+    m_BufferTime_ms = buffer_time_ms;
+    m_MemoryBudget = memory_budget;
+    m_SpillSize = spill_size;
 }
 
 void MainWindow::addPlot(const ScaleDescription & left, const ScaleDescription & right)
 {
-    m_Plotter = new QRealtimePlotter(10 * 60 * 1000 * 1000.0 /* keep 10min. in buffer */, this);
+    // All panes share the decoded signals and their sample stores
+    QRealtimePlotter *pane = new QRealtimePlotter(m_BufferTime_ms, this, m_Stores);
+    pane->setMemoryBudget(m_MemoryBudget, m_SpillSize);
+
+    if (m_ThreadedRendering)
+        pane->setRenderMode(QRealtimePlotter::E_RENDER_THREADED);
 
     const int margin = 5;
-    m_Plotter->setContentsMargins(margin, margin, margin, margin);
+    pane->setContentsMargins(margin, margin, margin, margin);
 
-    m_Plotter->setTimeScale(5000.0);
+    pane->setTimeScale(5000.0);
 
-    addScale(QRealtimePlotter::E_SCALE_LEFT, left);
-    addScale(QRealtimePlotter::E_SCALE_RIGHT, right);
+    addScale(pane, QRealtimePlotter::E_SCALE_LEFT, left);
+    addScale(pane, QRealtimePlotter::E_SCALE_RIGHT, right);
 
+    // Panes are stacked above the controls
+    static_cast<QVBoxLayout *>(layout())->insertWidget(m_Panes.size(), pane);
+    m_Panes.push_back(pane);
+
+    if (m_Panes.size() > 1) {
+        pane->followTimeScale(m_Plotter);
+        alignPanes();
+        return;
+    }
+
+    m_Plotter = pane;
     m_Plotter->startRecording();
 
-    layout()->addWidget(m_Plotter);
+    QHBoxLayout *controls = new QHBoxLayout();
 
-//    QwtSlider *slider = new QwtSlider(this);
-   // layout()->addWidget(slider);
+    // Zooming or panning in the plot pauses it as well
+    QPushButton *pause = new QPushButton("Pause", this);
+    pause->setCheckable(true);
+    connect(pause, SIGNAL(toggled(bool)), m_Plotter, SLOT(setPaused(bool)));
+    connect(m_Plotter, SIGNAL(pausedChanged(bool)), pause, SLOT(setChecked(bool)));
+    controls->addWidget(pause);
+
+    // Visible interval in seconds
+    QwtSlider *slider = new QwtSlider(Qt::Horizontal, this);
+    slider->setScale(1.0, 60.0);
+    slider->setTotalSteps(59);
+    slider->setValue(m_Plotter->getTimeScale() / 1000.0);
+    connect(slider, SIGNAL(valueChanged(double)), this, SLOT(setVisibleInterval(double)));
+    controls->addWidget(slider);
+
+    static_cast<QVBoxLayout *>(layout())->addLayout(controls);
+}
+
+void MainWindow::alignPanes()
+{
+    const int axes[] = { QwtPlot::yLeft, QwtPlot::yRight };
+    QRealtimePlotter *pane = NULL;
+    unsigned int i;
+
+    // Only the bottom pane shows the time axis, legends on top keep the canvases equally wide
+    foreach(pane, m_Panes) {
+        pane->enableAxis(QwtPlot::xBottom, pane == m_Panes.last());
+        pane->setLegendPosition(QwtPlot::TopLegend);
+    }
+
+    // Equally wide value scales so all canvases line up with the time axis
+    for (i = 0; i < sizeof(axes) / sizeof(axes[0]); i++) {
+        bool enabled = false;
+        double extent = 0.0;
+
+        foreach(pane, m_Panes) {
+            QwtScaleWidget *w = pane->axisWidget(axes[i]);
+
+            enabled |= pane->axisEnabled(axes[i]);
+
+            w->scaleDraw()->setMinimumExtent(0.0);
+            extent = qMax(extent, w->scaleDraw()->extent(w->font()));
+        }
+
+        foreach(pane, m_Panes) {
+            pane->enableAxis(axes[i], enabled);
+            pane->axisWidget(axes[i])->scaleDraw()->setMinimumExtent(extent);
+        }
+    }
+}
+
+void MainWindow::setVisibleInterval(double seconds)
+{
+    m_Plotter->setTimeScale(seconds * 1000.0);
+    m_Plotter->updateTimeScale();
 }
 
@@ -26,6 +26,8 @@
 
 #include <QCanChannel.h>
 #include <QCanSignals.h>
+#include <QCanSharedSignalsClient.h>
+#include <QCanStreamClient.h>
 
 #include <QRealtimePlotter.h>
 
@@ -61,20 +63,76 @@ class MainWindow : public QWidget
     Q_OBJECT
 
 public:
-    explicit MainWindow(const QString & channel, const QString & file,
+    /**
+     * @param channel live or replay channel, the window takes ownership
+     */
+    explicit MainWindow(QCanChannel * channel, const QString & file,
+                        const QString & busname, QObject* parent = NULL);
+
+    /**
+     * Plot signals published by canDaemon
+     * @param client attached client, the window takes ownership
+     */
+    explicit MainWindow(QCanSharedSignalsClient * client,
+                        const QString & busname, QObject* parent = NULL);
+
+    /**
+     * Plot signals streamed by a remote canDaemon
+     * @param client connected client, the window takes ownership
+     */
+    explicit MainWindow(QCanStreamClient * client,
                         const QString & busname, QObject* parent = NULL);
     virtual ~MainWindow();
 
+    /**
+     * Buffer settings of the plot, must be called before addPlot()
+     * @param buffer_time_ms time to keep samples for scrolling back
+     * @param memory_budget memory for the samples of all curves in bytes
+     * @param spill_size size of the spill files in bytes, 0 to disable
+     */
+    void setBufferLimits(double buffer_time_ms, qint64 memory_budget, qint64 spill_size);
+
+    /// Rasterise the curves on a worker thread, must be called before addPlot()
+    void setThreadedRendering(bool threaded) { m_ThreadedRendering = threaded; }
+
+    /**
+     * Add a pane with a left and a right scale below the existing ones.
+     * All panes share one time axis, zooming or pausing one applies to all.
+     */
     void addPlot(const ScaleDescription & left, const ScaleDescription & right);
 
+private slots:
+    /// Change the visible interval of the live view
+    void setVisibleInterval(double seconds);
+
 protected:
-    void addScale(QRealtimePlotter::scale_t scale, const ScaleDescription & desc);
+    void addScale(QRealtimePlotter * plotter, QRealtimePlotter::scale_t scale, const ScaleDescription & desc);
+
+    /// Line up the canvases of all panes
+    void alignPanes();
+
+    /// @return signal object of a curve or NULL if unknown
+    const QObject * findSignal(const ScaleDescription::Curve & curve, double & lower, double & upper);
 
 private:
-    QCanChannel m_CanChannel;
+    QCanChannel *m_CanChannel;
     QCanSignals* m_CanSignals;
 
+    QCanSharedSignalsClient *m_SharedSignals;
+    QCanStreamClient *m_StreamSignals;
+    QString m_BusName;
+
+    // First pane, drives the time axis of all panes
     QRealtimePlotter *m_Plotter;
+
+    QVector<QRealtimePlotter *> m_Panes;
+    QRealtimeSampleStores *m_Stores;
+
+    double m_BufferTime_ms;
+    qint64 m_MemoryBudget;
+    qint64 m_SpillSize;
+
+    bool m_ThreadedRendering;
 };
 
 #endif /* MAINWINDOW_H_ */
@@ -3,10 +3,11 @@ TARGET = canPlotter
 QT += core \
     gui \
     widgets \
+    network \
     xml
 HEADERS += MainWindow.h
 SOURCES += MainWindow.cc \
            main.cc
 RESOURCES +=
-LIBS += -L../qcan -lqcan -L../widgets -lwidgets -lqwt-qt5
+LIBS += -L../qcan -lqcan -L../widgets -lwidgets -lqwt-qt5 -lrt
 INCLUDEPATH += ../qcan ../widgets
@@ -22,6 +22,8 @@
 #include <QApplication>
 #include <QCommandLineParser>
 
+#include <QCanReplayChannel.h>
+
 #include "MainWindow.h"
 
 int main(int argc, char *argv[])
@@ -65,9 +67,48 @@ int main(int argc, char *argv[])
                 "scale-signals");
     parser.addOption(rightScaleSignalsOption);
 
+    QCommandLineOption replayOption("replay",
+                "Replay a candump (-l) or Vector ASC log file instead of using a CAN channel", "file");
+    parser.addOption(replayOption);
+
+    QCommandLineOption replaySpeedOption("replay-speed",
+                "Replay speed factor, 1 is real time (default: 1)", "factor");
+    parser.addOption(replaySpeedOption);
+
+    QCommandLineOption sharedMemoryOption("shared-memory",
+                "Plot signals published by canDaemon instead of using a CAN channel", "name");
+    parser.addOption(sharedMemoryOption);
+
+    QCommandLineOption streamOption("stream",
+                "Plot signals streamed by a remote canDaemon instead of using a CAN channel", "host:port");
+    parser.addOption(streamOption);
+
+    QCommandLineOption bufferTimeOption("buffer-time",
+                "Minutes of samples kept for scrolling back (default: 10)", "minutes");
+    parser.addOption(bufferTimeOption);
+
+    QCommandLineOption memoryBudgetOption("memory-budget",
+                "Memory used for the samples of all curves in MiB (default: 64)", "MiB");
+    parser.addOption(memoryBudgetOption);
+
+    QCommandLineOption spillSizeOption("spill-size",
+                "Size of the temporary files older samples are moved to in MiB, 0 drops them (default: 128)", "MiB");
+    parser.addOption(spillSizeOption);
+
+    QCommandLineOption paneOption("pane",
+                "Add a pane below the first one, may be given several times:\n"\
+                " LEFT-SCALE-NAME:SIGNALS|RIGHT-SCALE-NAME:SIGNALS with SIGNALS as for --left-scale-signals,\n"\
+                " all panes share one time axis",
+                "pane");
+    parser.addOption(paneOption);
+
+    QCommandLineOption threadedRenderingOption("threaded-rendering",
+                "Draw the curves on a worker thread, the GUI thread only shows the finished image");
+    parser.addOption(threadedRenderingOption);
+
     parser.process(a);
 
-    if (!parser.isSet(kcdFileOption)) {
+    if (!parser.isSet(kcdFileOption) && !parser.isSet(sharedMemoryOption) && !parser.isSet(streamOption)) {
         qWarning("No signal definition file (e.g. Kayak) found");
         return -1;
     }
@@ -90,9 +131,61 @@ int main(int argc, char *argv[])
     QString rightScaleName = parser.value(rightScaleNameOption);
     QString rightScaleSignals = parser.value(rightScaleSignalsOption);
 
-    MainWindow vBox(channel,
-                    kcdfile,
-                    busname);
+    QCanChannel *canChannel = NULL;
+    QCanSharedSignalsClient *sharedSignals = NULL;
+    QCanStreamClient *streamSignals = NULL;
+
+    if (parser.isSet(streamOption)) {
+        QString host = parser.value(streamOption).section(":", 0, 0);
+        quint16 port = parser.value(streamOption).section(":", 1, 1).toUShort();
+
+        streamSignals = new QCanStreamClient();
+
+        if (!streamSignals->connectToServer(host, port)) {
+            qWarning("Unable to connect to %s", qPrintable(parser.value(streamOption)));
+            return -1;
+        }
+    } else if (parser.isSet(sharedMemoryOption)) {
+        sharedSignals = new QCanSharedSignalsClient();
+
+        if (!sharedSignals->attach(parser.value(sharedMemoryOption))) {
+            qWarning("Unable to attach to shared memory segment");
+            return -1;
+        }
+
+        QObject::connect(sharedSignals, &QCanSharedSignalsClient::writerTerminated, []() {
+            qWarning("canDaemon has terminated, values are no longer updated");
+        });
+    } else if (parser.isSet(replayOption)) {
+        double speed = parser.isSet(replaySpeedOption) ? parser.value(replaySpeedOption).toDouble() : 1.0;
+
+        // Only the channel given by --channel is replayed if set
+        QCanReplayChannel *replay = new QCanReplayChannel(parser.value(replayOption),
+                                                          parser.isSet(channelOption) ? channel : QString(),
+                                                          speed);
+
+        // Plot shows wall clock time
+        replay->setRebaseTimestamps(true);
+        canChannel = replay;
+    } else {
+        canChannel = new QCanChannel(channel);
+    }
+
+    MainWindow *vBox;
+
+    if (streamSignals)
+        vBox = new MainWindow(streamSignals, busname);
+    else if (sharedSignals)
+        vBox = new MainWindow(sharedSignals, busname);
+    else
+        vBox = new MainWindow(canChannel, kcdfile, busname);
+
+    double minutes = parser.isSet(bufferTimeOption) ? parser.value(bufferTimeOption).toDouble() : 10.0;
+    qint64 budget = parser.isSet(memoryBudgetOption) ? parser.value(memoryBudgetOption).toLongLong() : 64;
+    qint64 spill = parser.isSet(spillSizeOption) ? parser.value(spillSizeOption).toLongLong() : 128;
+
+    vBox->setBufferLimits(minutes * 60 * 1000.0, budget * 1024 * 1024, spill * 1024 * 1024);
+    vBox->setThreadedRendering(parser.isSet(threadedRenderingOption));
 
     ScaleDescription *left_scale = ScaleDescription::CreateScaleDescriptionFromString(
                                     leftScaleName,
@@ -101,9 +194,30 @@ int main(int argc, char *argv[])
                                     rightScaleName,
                                     rightScaleSignals);
 
-    vBox.addPlot(*left_scale, *right_scale);
+    vBox->addPlot(*left_scale, *right_scale);
+
+    QString pane;
+
+    foreach(pane, parser.values(paneOption)) {
+        QString left = pane.section("|", 0, 0);
+        QString right = pane.section("|", 1);
+
+        ScaleDescription *pane_left = ScaleDescription::CreateScaleDescriptionFromString(
+                                        left.section(":", 0, 0), left.section(":", 1));
+        ScaleDescription *pane_right = ScaleDescription::CreateScaleDescriptionFromString(
+                                        right.section(":", 0, 0), right.section(":", 1));
+
+        vBox->addPlot(*pane_left, *pane_right);
+
+        delete pane_left;
+        delete pane_right;
+    }
+
+    vBox->show();
+
+    int ret = a.exec();
 
-    vBox.show();
+    delete vBox;
 
-    return a.exec();
+    return ret;
 }
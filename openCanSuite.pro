@@ -1,7 +1,9 @@
 TEMPLATE = subdirs
-SUBDIRS = qcan canHmi canPlotter canAnalyzer widgets
+SUBDIRS = qcan canHmi canPlotter canAnalyzer canDaemon widgets benchmarks
 canPlotter.depends = qcan widgets
 canAnalyzer.depends = qcan widgets
 canHmi.depends = qcan
+canDaemon.depends = qcan
 widgets.depends = qcan
+benchmarks.depends = qcan widgets
 
@@ -28,10 +28,13 @@
 #include <net/if.h>
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <linux/can/error.h>
 
 #include "QCanChannel.h"
+#include "QCanTrace.h"
 
 QCanChannel::QCanChannel(const QString & name)
+ : m_Name(name)
 {
     m_SocketFd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
     m_TerminationRequested = false;
@@ -45,6 +48,15 @@ QCanChannel::QCanChannel(const QString & name)
         m_SocketAddr.can_family = AF_CAN;
         m_SocketAddr.can_ifindex = ifr.ifr_ifindex;
 
+        // Timestamps and kernel drop counter are delivered with every
+        // frame, error frames are counted by the statistics
+        const int enable = 1;
+        const can_err_mask_t errorMask = CAN_ERR_MASK;
+
+        setsockopt(m_SocketFd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+        setsockopt(m_SocketFd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+        setsockopt(m_SocketFd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errorMask, sizeof(errorMask));
+
         if (bind(m_SocketFd, (struct sockaddr *)&m_SocketAddr, sizeof(m_SocketAddr)) < 0) {
             close(m_SocketFd);
             m_SocketFd = -1;
@@ -54,6 +66,14 @@ QCanChannel::QCanChannel(const QString & name)
     qRegisterMetaType<QCanMessage>("QCanMessage");
 }
 
+QCanChannel::QCanChannel()
+ : m_TerminationRequested(false), m_SocketFd(-1)
+{
+    ::memset(&m_SocketAddr, 0, sizeof(m_SocketAddr));
+
+    qRegisterMetaType<QCanMessage>("QCanMessage");
+}
+
 QCanChannel::~QCanChannel()
 {
     Stop();
@@ -74,10 +94,13 @@ void QCanChannel::Stop()
 {
     m_TerminationRequested = true;
 
-    if (m_SocketFd > 0)
-        close(m_SocketFd);
-
+    // Receive loop polls the termination flag every 10ms
     wait();
+
+    if (m_SocketFd > 0) {
+        close(m_SocketFd);
+        m_SocketFd = -1;
+    }
 }
 
 void QCanChannel::run()
@@ -102,9 +125,47 @@ void QCanChannel::run()
             QCanMessage message;
 
             struct can_frame frame;
+            struct iovec iov;
+            struct msghdr msg;
+            char control[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(quint32))];
 
-            if (recv(m_SocketFd, &frame, sizeof(struct can_frame), MSG_DONTWAIT) > 0) {
-                ioctl(m_SocketFd, SIOCGSTAMP, &message.tv);
+            iov.iov_base = &frame;
+            iov.iov_len = sizeof(frame);
+
+            ::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            if (recvmsg(m_SocketFd, &msg, MSG_DONTWAIT) > 0) {
+                struct cmsghdr *cmsg;
+                bool hasTimestamp = false;
+
+                for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    if (cmsg->cmsg_level != SOL_SOCKET)
+                        continue;
+
+                    if (cmsg->cmsg_type == SO_TIMESTAMP) {
+                        ::memcpy(&message.tv, CMSG_DATA(cmsg), sizeof(message.tv));
+                        hasTimestamp = true;
+                    } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                        quint32 drops;
+
+                        ::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                        m_Statistics.setOverflowDrops(drops);
+                    }
+                }
+
+                if (!hasTimestamp)
+                    gettimeofday(&message.tv, NULL);
+
+                if (frame.can_id & CAN_ERR_FLAG) {
+                    m_Statistics.errorFrameReceived(frame.can_id, frame.data);
+                    continue;
+                }
+
+                QCAN_TRACE(E_TRACE_RECEIVE, message.tv);
 
                 message.isExt = (frame.can_id & CAN_EFF_FLAG) ? true : false;
                 message.id = frame.can_id & (message.isExt ? CAN_EFF_MASK : CAN_SFF_MASK);
@@ -112,6 +173,8 @@ void QCanChannel::run()
 
                 ::memcpy(&message.data[0], &frame.data[0], 8);
 
+                m_Statistics.frameReceived(message);
+
                 canMessageReceived(message);
             }
         }
@@ -119,6 +182,11 @@ void QCanChannel::run()
 }
 
 void QCanChannel::canMessageSend(const QCanMessage &message)
+{
+    Send(message);
+}
+
+bool QCanChannel::Send(const QCanMessage &message)
 {
     struct can_frame frame;
 
@@ -130,5 +198,5 @@ void QCanChannel::canMessageSend(const QCanMessage &message)
         frame.can_id |= CAN_EFF_FLAG;
     }
 
-    write(m_SocketFd, &frame, sizeof(struct can_frame));
+    return write(m_SocketFd, &frame, sizeof(struct can_frame)) == sizeof(struct can_frame);
 }
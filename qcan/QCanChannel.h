@@ -27,6 +27,8 @@
 #include <net/if.h>
 #include <linux/can.h>
 
+#include "QCanChannelStatistics.h"
+
 struct QCanMessage
 {
     struct timeval tv;
@@ -57,20 +59,44 @@ public:
      * @param name interface name of CAN interface
      */
     QCanChannel(const QString & name);
-    ~QCanChannel();
+    virtual ~QCanChannel();
 
-    bool IsValid() { return m_SocketFd > 0; }
+    virtual bool IsValid() { return m_SocketFd > 0; }
     bool Start();
-    void Stop();
+    virtual void Stop();
+
+    /**
+     * Write a frame to the channel. May be called from any thread.
+     * @return true if the frame was passed to the socket
+     */
+    virtual bool Send(const QCanMessage & message);
+
+    /// Reception statistics, maintained by the receive thread
+    QCanChannelStatistics & getStatistics() { return m_Statistics; }
+
+    /// Nominal bitrate of the bus, used for the bus load estimate
+    void setBitrate(quint32 bitrate) { m_Statistics.setBitrate(bitrate); }
+
+    /// Interface name, empty for channels not bound to an interface
+    const QString & getName() const { return m_Name; }
 
 protected:
+    /// For channels not backed by a SocketCAN interface
+    QCanChannel();
+
+    void setName(const QString & name) { m_Name = name; }
+
     void run();
 
+    bool m_TerminationRequested;
+
+    QCanChannelStatistics m_Statistics;
+
 private:
     int m_SocketFd;
     struct sockaddr_can m_SocketAddr;
 
-    bool m_TerminationRequested;
+    QString m_Name;
 };
 
 #endif /* SOCKETCANCHANNEL_H_ */
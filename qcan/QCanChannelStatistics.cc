@@ -0,0 +1,238 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <time.h>
+#include <stdlib.h>
+
+#include <linux/can.h>
+#include <linux/can/error.h>
+
+#include "QCanChannelStatistics.h"
+#include "QCanChannel.h"
+
+#define EXTENDED_SLOTS  4096
+#define EXT_FLAG        0x80000000U
+
+static quint64 _now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (quint64)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+QCanChannelStatistics::QCanChannelStatistics()
+ : m_Bitrate(500000), m_Standard(CAN_SFF_MASK + 1), m_Extended(EXTENDED_SLOTS),
+   m_Frames(0), m_Bits(0), m_ExtendedOverflow(0),
+   m_ErrorFrames(0), m_BusOff(0), m_ControllerErrors(0), m_ProtocolErrors(0),
+   m_AckErrors(0), m_LostArbitration(0), m_OverflowDrops(0),
+   m_SampleTime_us(0), m_SampleFrames(0), m_SampleBits(0)
+{
+    for (int i = 0; i < m_Standard.size(); i++) {
+        m_Standard[i].key.store(i);
+        m_Standard[i].count.store(0);
+    }
+
+    for (int i = 0; i < m_Extended.size(); i++) {
+        m_Extended[i].key.store(0);
+        m_Extended[i].count.store(0);
+    }
+}
+
+quint32 QCanChannelStatistics::frameBits(quint8 dlc, bool isExt)
+{
+    const quint32 data = 8 * (dlc > 8 ? 8 : dlc);
+
+    if (isExt)
+        return data + 67 + (54 + data - 1) / 4;
+
+    return data + 47 + (34 + data - 1) / 4;
+}
+
+QCanChannelStatistics::IdCounter * QCanChannelStatistics::findCounter(quint32 id, bool isExt, bool insert)
+{
+    if (!isExt)
+        return &m_Standard[id & CAN_SFF_MASK];
+
+    const quint32 key = id | EXT_FLAG;
+    quint32 slot = (key * 2654435761U) & (EXTENDED_SLOTS - 1);
+
+    // Only the receive thread inserts, readers see a slot once its key is set
+    for (int probe = 0; probe < EXTENDED_SLOTS / 4; probe++) {
+        IdCounter & c = m_Extended[slot];
+        quint32 current = c.key.loadAcquire();
+
+        if (current == key)
+            return &c;
+
+        if (current == 0) {
+            if (!insert)
+                return NULL;
+
+            c.count.store(0);
+            c.key.storeRelease(key);
+
+            return &c;
+        }
+
+        slot = (slot + 1) & (EXTENDED_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+const QCanChannelStatistics::IdCounter * QCanChannelStatistics::findCounter(quint32 id, bool isExt) const
+{
+    return const_cast<QCanChannelStatistics *>(this)->findCounter(id, isExt, false);
+}
+
+void QCanChannelStatistics::frameReceived(const QCanMessage & frame)
+{
+    const quint64 time_us = (quint64)frame.tv.tv_sec * 1000000 + frame.tv.tv_usec;
+
+    m_Frames.storeRelease(m_Frames.load() + 1);
+    m_Bits.storeRelease(m_Bits.load() + frameBits(frame.dlc, frame.isExt));
+
+    IdCounter *c = findCounter(frame.id, frame.isExt, true);
+
+    if (!c) {
+        m_ExtendedOverflow.storeRelease(m_ExtendedOverflow.load() + 1);
+        return;
+    }
+
+    const quint64 count = c->count.load() + 1;
+
+    if (count == 1) {
+        c->firstTime_us.store(time_us);
+        c->jitter.store(0);
+    } else if (time_us > c->lastTime_us.load()) {
+        const qint64 period = time_us - c->lastTime_us.load();
+        const qint64 mean = (time_us - c->firstTime_us.load()) / (count - 1);
+        const quint64 jitter = c->jitter.load();
+
+        // Exponential smoothing with alpha 1/16
+        c->jitter.store(jitter + llabs(period - mean) - jitter / 16);
+    }
+
+    c->lastTime_us.store(time_us);
+    c->count.storeRelease(count);
+}
+
+void QCanChannelStatistics::errorFrameReceived(quint32 canId, const quint8 *data)
+{
+    m_ErrorFrames.storeRelease(m_ErrorFrames.load() + 1);
+
+    if (canId & CAN_ERR_BUSOFF)
+        m_BusOff.storeRelease(m_BusOff.load() + 1);
+
+    if ((canId & CAN_ERR_CRTL) && data[1])
+        m_ControllerErrors.storeRelease(m_ControllerErrors.load() + 1);
+
+    if (canId & CAN_ERR_PROT)
+        m_ProtocolErrors.storeRelease(m_ProtocolErrors.load() + 1);
+
+    if (canId & CAN_ERR_ACK)
+        m_AckErrors.storeRelease(m_AckErrors.load() + 1);
+
+    if (canId & CAN_ERR_LOSTARB)
+        m_LostArbitration.storeRelease(m_LostArbitration.load() + 1);
+}
+
+void QCanChannelStatistics::readCounter(const IdCounter & c, QCanIdStatistics & statistics)
+{
+    const quint32 key = c.key.load();
+    const quint64 count = c.count.loadAcquire();
+    const quint64 first = c.firstTime_us.load();
+    const quint64 last = c.lastTime_us.load();
+
+    statistics.isExt = (key & EXT_FLAG) != 0;
+    statistics.id = key & ~EXT_FLAG;
+    statistics.count = count;
+    statistics.lastTime_us = last;
+    statistics.meanPeriod_ms = count > 1 && last > first ? (last - first) / 1000.0 / (count - 1) : 0.0;
+    statistics.jitter_ms = c.jitter.load() / 16.0 / 1000.0;
+}
+
+void QCanChannelStatistics::getIdStatistics(QVector<QCanIdStatistics> & statistics) const
+{
+    QCanIdStatistics s;
+
+    statistics.clear();
+
+    for (int i = 0; i < m_Standard.size(); i++) {
+        if (!m_Standard[i].count.loadAcquire())
+            continue;
+
+        readCounter(m_Standard[i], s);
+        statistics.push_back(s);
+    }
+
+    for (int i = 0; i < m_Extended.size(); i++) {
+        if (!m_Extended[i].key.loadAcquire() || !m_Extended[i].count.loadAcquire())
+            continue;
+
+        readCounter(m_Extended[i], s);
+        statistics.push_back(s);
+    }
+}
+
+bool QCanChannelStatistics::getIdStatistics(quint32 id, bool isExt, QCanIdStatistics & statistics) const
+{
+    const IdCounter *c = findCounter(id, isExt);
+
+    if (!c || !c->count.loadAcquire())
+        return false;
+
+    readCounter(*c, statistics);
+
+    return true;
+}
+
+void QCanChannelStatistics::sample(QCanBusStatistics & statistics)
+{
+    const quint64 now_us = _now_us();
+
+    statistics.frames = m_Frames.loadAcquire();
+    statistics.bits = m_Bits.loadAcquire();
+    statistics.errorFrames = m_ErrorFrames.loadAcquire();
+    statistics.busOff = m_BusOff.loadAcquire();
+    statistics.controllerErrors = m_ControllerErrors.loadAcquire();
+    statistics.protocolErrors = m_ProtocolErrors.loadAcquire();
+    statistics.ackErrors = m_AckErrors.loadAcquire();
+    statistics.lostArbitration = m_LostArbitration.loadAcquire();
+    statistics.overflowDrops = m_OverflowDrops.loadAcquire();
+
+    statistics.framesPerSecond = 0.0;
+    statistics.busLoad = 0.0;
+
+    if (m_SampleTime_us && now_us > m_SampleTime_us) {
+        const double seconds = (now_us - m_SampleTime_us) / 1000000.0;
+
+        statistics.framesPerSecond = (statistics.frames - m_SampleFrames) / seconds;
+
+        if (m_Bitrate)
+            statistics.busLoad = (statistics.bits - m_SampleBits) / seconds / m_Bitrate;
+    }
+
+    m_SampleTime_us = now_us;
+    m_SampleFrames = statistics.frames;
+    m_SampleBits = statistics.bits;
+}
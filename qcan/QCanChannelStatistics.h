@@ -0,0 +1,159 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANCHANNELSTATISTICS_H_
+#define QCANCHANNELSTATISTICS_H_
+
+#include <QtGlobal>
+#include <QVector>
+#include <QAtomicInteger>
+
+struct QCanMessage;
+
+/**
+ * Reception statistics of a single CAN identifier
+ */
+struct QCanIdStatistics
+{
+    quint32 id;
+    bool isExt;
+
+    quint64 count;
+    quint64 lastTime_us;
+
+    double meanPeriod_ms;
+
+    /// Smoothed absolute deviation of periods from the mean period
+    double jitter_ms;
+};
+
+/**
+ * Totals of a channel and rates since the previous sample
+ */
+struct QCanBusStatistics
+{
+    quint64 frames;
+    quint64 bits;
+
+    quint64 errorFrames;
+    quint64 busOff;
+    quint64 controllerErrors;
+    quint64 protocolErrors;
+    quint64 ackErrors;
+    quint64 lostArbitration;
+
+    /// Frames dropped by the kernel because the socket queue was full
+    quint64 overflowDrops;
+
+    double framesPerSecond;
+
+    /// Estimated bus load in [0, 1] based on the configured bitrate
+    double busLoad;
+};
+
+/**
+ * Frame, error and per identifier counters of a channel.
+ *
+ * Counters are written by the receive thread only and read with atomic
+ * loads, so sampling from the GUI thread needs no locking. Fields of a
+ * sample may be from slightly different points in time.
+ */
+class QCanChannelStatistics
+{
+public:
+    QCanChannelStatistics();
+
+    /// Nominal bitrate used for the bus load estimate (default: 500000)
+    void setBitrate(quint32 bitrate) { m_Bitrate = bitrate; }
+    quint32 getBitrate() const { return m_Bitrate; }
+
+    /// Called by the receive thread for every frame
+    void frameReceived(const QCanMessage & frame);
+
+    /// Called by the receive thread for error frames (CAN_ERR_FLAG set)
+    void errorFrameReceived(quint32 canId, const quint8 *data);
+
+    /// Called by the receive thread with the SO_RXQ_OVFL counter
+    void setOverflowDrops(quint32 drops) { m_OverflowDrops.storeRelease(drops); }
+
+    /// Statistics of all identifiers received so far
+    void getIdStatistics(QVector<QCanIdStatistics> & statistics) const;
+
+    /// @return false if the identifier was not received
+    bool getIdStatistics(quint32 id, bool isExt, QCanIdStatistics & statistics) const;
+
+    /**
+     * Read totals and compute rates since the previous call. Has to be
+     * called by a single thread.
+     */
+    void sample(QCanBusStatistics & statistics);
+
+    /**
+     * Worst case number of bits on the wire including stuff bits, see
+     * Davis et al., "Controller Area Network (CAN) schedulability analysis"
+     */
+    static quint32 frameBits(quint8 dlc, bool isExt);
+
+private:
+    struct IdCounter {
+        // Identifier with bit 31 set for extended frames, 0 while the
+        // slot of the extended table is unused
+        QAtomicInteger<quint32> key;
+
+        QAtomicInteger<quint64> count;
+        QAtomicInteger<quint64> firstTime_us;
+        QAtomicInteger<quint64> lastTime_us;
+
+        // Fixed point 1/16 us
+        QAtomicInteger<quint64> jitter;
+    };
+
+    IdCounter *findCounter(quint32 id, bool isExt, bool insert);
+    const IdCounter *findCounter(quint32 id, bool isExt) const;
+
+    static void readCounter(const IdCounter & counter, QCanIdStatistics & statistics);
+
+    quint32 m_Bitrate;
+
+    // Standard identifiers are indexed directly, extended identifiers are
+    // kept in an open addressing table which is never shrunk
+    QVector<IdCounter> m_Standard;
+    QVector<IdCounter> m_Extended;
+
+    QAtomicInteger<quint64> m_Frames;
+    QAtomicInteger<quint64> m_Bits;
+    QAtomicInteger<quint64> m_ExtendedOverflow;
+
+    QAtomicInteger<quint64> m_ErrorFrames;
+    QAtomicInteger<quint64> m_BusOff;
+    QAtomicInteger<quint64> m_ControllerErrors;
+    QAtomicInteger<quint64> m_ProtocolErrors;
+    QAtomicInteger<quint64> m_AckErrors;
+    QAtomicInteger<quint64> m_LostArbitration;
+    QAtomicInteger<quint32> m_OverflowDrops;
+
+    // State of sample()
+    quint64 m_SampleTime_us;
+    quint64 m_SampleFrames;
+    quint64 m_SampleBits;
+};
+
+#endif /* QCANCHANNELSTATISTICS_H_ */
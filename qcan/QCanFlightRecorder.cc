@@ -0,0 +1,261 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+
+#include <QDateTime>
+#include <QMetaObject>
+
+#include "QCanFlightRecorder.h"
+#include "QCanRecorder.h"
+#include "QCanSignals.h"
+#include "QCanPredicate.h"
+
+static inline quint64 _toUs(const struct timeval & tv)
+{
+    return (quint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Data bytes covered by a DLC, in the memory layout of QCanMessage::data
+static quint64 _dlcMask(quint8 dlc)
+{
+    quint8 bytes[8];
+    quint64 mask;
+
+    for (int i = 0; i < 8; i++)
+        bytes[i] = i < dlc ? 0xFF : 0x00;
+
+    ::memcpy(&mask, bytes, sizeof(mask));
+    return mask;
+}
+
+QCanFlightRecorder::QCanFlightRecorder(QCanChannel *channel, quint32 preTrigger_ms,
+                                       quint32 postTrigger_ms, quint32 maxFrameRate,
+                                       QObject *parent)
+ : QObject(parent), m_CanChannel(channel),
+   m_PreTrigger_us((quint64)preTrigger_ms * 1000), m_PostTrigger_us((quint64)postTrigger_ms * 1000),
+   m_Head(0), m_Capturing(false), m_WindowStart(0), m_TriggerTime_us(0),
+   m_SavePending(0), m_CaptureCount(0), m_TriggerCount(0), m_SavedCount(0),
+   m_FilePrefix("flightrec")
+{
+    quint64 capacity = ((quint64)preTrigger_ms + postTrigger_ms) * maxFrameRate / 1000 + 1;
+
+    m_Ring.resize(capacity);
+    m_Capture.resize(capacity);
+
+    m_TriggerTv.tv_sec = 0;
+    m_TriggerTv.tv_usec = 0;
+
+    QObject::connect(m_CanChannel, SIGNAL(canMessageReceived(const QCanMessage &)),
+                     this, SLOT(canMessageReceived(const QCanMessage &)), Qt::DirectConnection);
+}
+
+QCanFlightRecorder::~QCanFlightRecorder()
+{
+    QObject::disconnect(m_CanChannel, SIGNAL(canMessageReceived(const QCanMessage &)),
+                        this, SLOT(canMessageReceived(const QCanMessage &)));
+}
+
+void QCanFlightRecorder::addSignalTrigger(QCanSignalContainer *message, QCanSignal *signal,
+                                          compare_t compare, double threshold)
+{
+    Trigger t;
+
+    ::memset(&t, 0, sizeof(t));
+    t.id = message->getCanId();
+    t.idMask = 0xFFFFFFFF;
+    t.isExt = message->isExt();
+    t.signal = signal;
+    t.compare = compare;
+    t.threshold = threshold;
+
+    m_Triggers.push_back(t);
+}
+
+void QCanFlightRecorder::addPatternTrigger(quint32 id, quint32 idMask, bool isExt,
+                                           const quint8 data[8], const quint8 dataMask[8])
+{
+    Trigger t;
+
+    ::memset(&t, 0, sizeof(t));
+    t.id = id & idMask;
+    t.idMask = idMask;
+    t.isExt = isExt;
+
+    if (data && dataMask) {
+        ::memcpy(&t.data, data, sizeof(t.data));
+        ::memcpy(&t.dataMask, dataMask, sizeof(t.dataMask));
+        t.data &= t.dataMask;
+    }
+
+    m_Triggers.push_back(t);
+}
+
+void QCanFlightRecorder::addPredicateTrigger(const QCanPredicate *predicate)
+{
+    Trigger t;
+
+    ::memset(&t, 0, sizeof(t));
+    t.predicate = predicate;
+
+    m_Triggers.push_back(t);
+}
+
+bool QCanFlightRecorder::evaluate(Trigger & t, const QCanMessage & frame)
+{
+    bool state = false;
+
+    if (t.predicate) {
+        state = t.predicate->evaluate(frame, m_CanChannel);
+    } else {
+        if ((frame.id & t.idMask) != t.id || frame.isExt != t.isExt)
+            return false;
+
+        if (!t.signal) {
+            quint64 data;
+
+            // Masked bytes beyond the DLC never match
+            if (t.dataMask & ~_dlcMask(frame.dlc))
+                return false;
+
+            ::memcpy(&data, frame.data, sizeof(data));
+
+            return (data & t.dataMask) == t.data;
+        }
+
+        double value = t.signal->physicalValueFromMessage(frame);
+
+        switch (t.compare) {
+        case E_COMPARE_EQUAL:         state = value == t.threshold; break;
+        case E_COMPARE_NOT_EQUAL:     state = value != t.threshold; break;
+        case E_COMPARE_LESS:          state = value < t.threshold; break;
+        case E_COMPARE_LESS_EQUAL:    state = value <= t.threshold; break;
+        case E_COMPARE_GREATER:       state = value > t.threshold; break;
+        case E_COMPARE_GREATER_EQUAL: state = value >= t.threshold; break;
+        }
+    }
+
+    // Only fire when the condition becomes true
+    bool fired = state && !t.lastState;
+    t.lastState = state;
+
+    return fired;
+}
+
+void QCanFlightRecorder::canMessageReceived(const QCanMessage & frame)
+{
+    quint64 head = m_Head.loadAcquire();
+    const quint64 capacity = m_Ring.size();
+
+    m_Ring[head % capacity] = frame;
+    m_Head.storeRelease(++head);
+
+    if (m_Capturing) {
+        // Window is complete or the ring would overwrite its start
+        if (_toUs(frame.tv) >= m_TriggerTime_us + m_PostTrigger_us ||
+            head - m_WindowStart >= capacity)
+            finishCapture();
+    }
+
+    bool fired = false;
+
+    // Evaluate all triggers to keep edge state of signal triggers up to date
+    for (int i = 0; i < m_Triggers.size(); i++)
+        fired |= evaluate(m_Triggers[i], frame);
+
+    if (!fired)
+        return;
+
+    m_TriggerCount.fetchAndAddRelaxed(1);
+
+    if (!m_Capturing && !m_SavePending.loadAcquire())
+        startCapture(frame);
+}
+
+void QCanFlightRecorder::startCapture(const QCanMessage & frame)
+{
+    const quint64 capacity = m_Ring.size();
+    const quint64 head = m_Head.loadAcquire();
+    const quint64 triggerTime = _toUs(frame.tv);
+    const quint64 startTime = triggerTime > m_PreTrigger_us ? triggerTime - m_PreTrigger_us : 0;
+
+    // Binary search first frame of the pre-trigger window in the ring,
+    // the trigger frame is the latest one
+    quint64 lo = head > capacity ? head - capacity : 0;
+    quint64 hi = head - 1;
+
+    while (lo < hi) {
+        quint64 mid = lo + (hi - lo) / 2;
+
+        if (_toUs(m_Ring[mid % capacity].tv) < startTime)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    m_WindowStart = lo;
+    m_TriggerTime_us = triggerTime;
+    m_TriggerTv = frame.tv;
+    m_Capturing = true;
+
+    emit triggered(frame.tv);
+}
+
+void QCanFlightRecorder::finishCapture()
+{
+    const quint64 capacity = m_Ring.size();
+    const quint64 head = m_Head.loadAcquire();
+    int count = 0;
+
+    for (quint64 i = m_WindowStart; i < head && count < (int)capacity; i++)
+        m_Capture[count++] = m_Ring[i % capacity];
+
+    m_CaptureCount = count;
+    m_Capturing = false;
+
+    m_SavePending.storeRelease(1);
+    QMetaObject::invokeMethod(this, "saveCapture", Qt::QueuedConnection);
+}
+
+void QCanFlightRecorder::saveCapture()
+{
+    QCanRecorder recorder;
+    QString filename = QString("%1-%2-%3.qcr")
+            .arg(m_FilePrefix)
+            .arg(QDateTime::fromMSecsSinceEpoch(m_TriggerTime_us / 1000).toString("yyyyMMdd-hhmmss.zzz"))
+            .arg(m_SavedCount.loadAcquire());
+
+    if (recorder.open(filename)) {
+        const int channel = recorder.addChannel(m_CanChannel->getName());
+
+        for (int i = 0; i < m_CaptureCount; i++)
+            recorder.writeMessage(m_Capture[i], channel);
+
+        recorder.close();
+
+        m_SavedCount.fetchAndAddRelease(1);
+        emit captureSaved(filename);
+    } else {
+        qWarning("Unable to save flight recorder window to %s", qPrintable(filename));
+    }
+
+    // Hand capture buffer back to the receive thread
+    m_SavePending.storeRelease(0);
+}
@@ -0,0 +1,171 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANFLIGHTRECORDER_H_
+#define QCANFLIGHTRECORDER_H_
+
+#include <QObject>
+#include <QVector>
+#include <QString>
+#include <QAtomicInteger>
+
+#include "QCanChannel.h"
+
+class QCanSignal;
+class QCanSignalContainer;
+class QCanPredicate;
+
+/**
+ * Keeps the most recent traffic of a CAN channel in memory and saves a
+ * window around a trigger event as binary recording (see QCanRecorder).
+ *
+ * Frames are stored in a preallocated ring and triggers are evaluated on the
+ * channel receive thread, nothing is allocated per frame. The window is
+ * complete with the first frame received after the post-trigger time, it is
+ * written to disk by the thread owning the flight recorder.
+ */
+class QCanFlightRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef enum E_COMPARE {
+        E_COMPARE_EQUAL = 0,
+        E_COMPARE_NOT_EQUAL,
+        E_COMPARE_LESS,
+        E_COMPARE_LESS_EQUAL,
+        E_COMPARE_GREATER,
+        E_COMPARE_GREATER_EQUAL
+    } compare_t;
+
+    /**
+     * @param channel channel to record
+     * @param preTrigger_ms time to keep before a trigger
+     * @param postTrigger_ms time to record after a trigger
+     * @param maxFrameRate highest expected frame rate (frames/s), sizes the ring
+     */
+    QCanFlightRecorder(QCanChannel *channel, quint32 preTrigger_ms = 5000,
+                       quint32 postTrigger_ms = 2000, quint32 maxFrameRate = 10000,
+                       QObject *parent = NULL);
+    ~QCanFlightRecorder();
+
+    /**
+     * Directory and name prefix of saved windows, files are named
+     * <prefix>-<trigger time>-<n>.qcr
+     */
+    void setFilePrefix(const QString & prefix) { m_FilePrefix = prefix; }
+
+    /**
+     * Trigger when a signal value starts to satisfy a comparison.
+     * Triggers must be added before the channel is started.
+     */
+    void addSignalTrigger(QCanSignalContainer *message, QCanSignal *signal,
+                          compare_t compare, double threshold);
+
+    /**
+     * Trigger on frames matching an identifier and data pattern, bits cleared
+     * in a mask are ignored.
+     */
+    void addPatternTrigger(quint32 id, quint32 idMask, bool isExt,
+                           const quint8 data[8] = NULL, const quint8 dataMask[8] = NULL);
+
+    /**
+     * Trigger when a compiled predicate starts to be true. The predicate is
+     * not owned and must outlive the flight recorder.
+     */
+    void addPredicateTrigger(const QCanPredicate *predicate);
+
+    /// Number of frames received
+    quint64 getFrameCount() const { return m_Head.loadAcquire(); }
+
+    /// Number of fired triggers, including those ignored during a capture
+    quint64 getTriggerCount() const { return m_TriggerCount.loadAcquire(); }
+
+    /// Number of windows written to disk
+    quint64 getSavedCount() const { return m_SavedCount.loadAcquire(); }
+
+signals:
+    /// A trigger fired, the window will be saved once complete
+    void triggered(const struct timeval & tv);
+
+    /// A window was written to filename
+    void captureSaved(const QString & filename);
+
+public slots:
+    void canMessageReceived(const QCanMessage & frame);
+
+private slots:
+    void saveCapture();
+
+private:
+    struct Trigger {
+        quint32 id;
+        quint32 idMask;
+        bool isExt;
+
+        // Pattern trigger
+        quint64 data;
+        quint64 dataMask;
+
+        // Signal trigger, NULL for pattern triggers
+        QCanSignal *signal;
+        compare_t compare;
+        double threshold;
+
+        // Predicate trigger, matches any identifier
+        const QCanPredicate *predicate;
+
+        bool lastState;
+    };
+
+    bool evaluate(Trigger & t, const QCanMessage & frame);
+    void startCapture(const QCanMessage & frame);
+    void finishCapture();
+
+    QCanChannel *m_CanChannel;
+
+    const quint64 m_PreTrigger_us;
+    const quint64 m_PostTrigger_us;
+
+    QVector<Trigger> m_Triggers;
+
+    // Frame ring, only written by the receive thread
+    QVector<QCanMessage> m_Ring;
+    QAtomicInteger<quint64> m_Head;
+
+    // Window of the current capture, only used by the receive thread
+    bool m_Capturing;
+    quint64 m_WindowStart;
+    quint64 m_TriggerTime_us;
+    struct timeval m_TriggerTv;
+
+    // Completed window handed over to saveCapture()
+    QAtomicInt m_SavePending;
+    QVector<QCanMessage> m_Capture;
+    int m_CaptureCount;
+
+    QAtomicInteger<quint64> m_TriggerCount;
+    QAtomicInteger<quint64> m_SavedCount;
+
+    QString m_FilePrefix;
+};
+
+#endif /* QCANFLIGHTRECORDER_H_ */
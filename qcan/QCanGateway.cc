@@ -0,0 +1,309 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <endian.h>
+#include <byteswap.h>
+
+#include "QCanGateway.h"
+#include "QCanSignals.h"
+#include "QCanChannel.h"
+
+static inline qint64 _now_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+
+    return (qint64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline quint32 _key(quint32 id, bool isExt)
+{
+    return isExt ? (id | 0x80000000U) : id;
+}
+
+static inline quint64 _mask(quint32 length)
+{
+    return length >= 64 ? ~Q_UINT64_C(0) : (Q_UINT64_C(1) << length) - 1;
+}
+
+// Bit position of a signal in the payload read as 64 bit word of its byte order
+static inline quint32 _shift(const QCanSignal *signal)
+{
+    if (signal->getOrder() == ENDIANESS_INTEL)
+        return signal->getOffset();
+
+    return 64 - signal->getOffset() - signal->getLength();
+}
+
+// Range of raw values a signal can hold. The upper bound is the largest
+// double below 2^n, which converts to a 64 bit integer without overflow.
+static inline void _rawRange(const QCanSignal *signal, double & lower, double & upper)
+{
+    const int length = qMin((int)signal->getLength(), 64);
+
+    if (signal->isSigned()) {
+        lower = -ldexp(1.0, length - 1);
+        upper = floor(nextafter(ldexp(1.0, length - 1), 0.0));
+    } else {
+        lower = 0.0;
+        upper = floor(nextafter(ldexp(1.0, length), 0.0));
+    }
+}
+
+QCanGateway::QCanGateway(QCanChannel *source, QObject *parent)
+ : QObject(parent), m_Source(source)
+{
+    QObject::connect(m_Source, SIGNAL(canMessageReceived(const QCanMessage &)),
+                     this, SLOT(canMessageReceived(const QCanMessage &)), Qt::DirectConnection);
+}
+
+QCanGateway::~QCanGateway()
+{
+    QObject::disconnect(m_Source, SIGNAL(canMessageReceived(const QCanMessage &)),
+                        this, SLOT(canMessageReceived(const QCanMessage &)));
+
+    qDeleteAll(m_Routes);
+}
+
+int QCanGateway::addRoute(quint32 key, Route *route)
+{
+    ::memset(&route->stats, 0, sizeof(route->stats));
+
+    m_Routes.push_back(route);
+    m_RouteIndex[key].push_back(route);
+
+    return m_Routes.size() - 1;
+}
+
+int QCanGateway::addRoute(quint32 id, bool isExt, QCanChannel *destination,
+                          quint32 destinationId, bool destinationExt)
+{
+    Route *r = new Route;
+
+    r->destination = destination;
+    r->message = NULL;
+    r->id = destinationId;
+    r->isExt = destinationExt;
+    r->rewrite = false;
+    r->dlc = 0;
+
+    return addRoute(_key(id, isExt), r);
+}
+
+int QCanGateway::addRoute(QCanSignalContainer *message, QCanChannel *destination,
+                          QCanSignalContainer *destinationMessage)
+{
+    Route *r = new Route;
+
+    r->destination = destination;
+    r->message = destinationMessage;
+    r->id = destinationMessage->getCanId();
+    r->isExt = destinationMessage->isExt();
+    r->rewrite = true;
+    r->dlc = qMin(destinationMessage->getLength(), (quint32)8);
+
+    return addRoute(_key(message->getCanId(), message->isExt()), r);
+}
+
+bool QCanGateway::addSignalRule(int route, QCanSignal *source, QCanSignal *destination,
+                                double factor, double offset)
+{
+    if (route < 0 || route >= m_Routes.size() || !m_Routes[route]->rewrite)
+        return false;
+
+    Rule rule;
+    double lower, upper;
+    double fieldLower, fieldUpper;
+
+    rule.sourceIntel = source->getOrder() == ENDIANESS_INTEL;
+    rule.sourceSigned = source->isSigned();
+    rule.sourceLength = source->getLength();
+    rule.sourceShift = _shift(source);
+    rule.sourceMask = _mask(source->getLength());
+
+    rule.destinationIntel = destination->getOrder() == ENDIANESS_INTEL;
+    rule.destinationShift = _shift(destination);
+    rule.destinationMask = _mask(destination->getLength());
+
+    // physical = raw * slope + intercept on both sides, fold the whole
+    // conversion chain into raw' = a * raw + b
+    rule.a = source->getSlope() * factor / destination->getSlope();
+    rule.b = (source->getIntercept() * factor + offset - destination->getIntercept()) /
+             destination->getSlope();
+
+    rule.convert = !(rule.a == 1.0 && rule.b == 0.0 &&
+                     source->isSigned() == destination->isSigned() &&
+                     source->getLength() <= destination->getLength());
+
+    // Clamp to the physical limits of the destination signal
+    destination->getLimit(lower, upper);
+    rule.minRaw = ceil((lower - destination->getIntercept()) / destination->getSlope());
+    rule.maxRaw = floor((upper - destination->getIntercept()) / destination->getSlope());
+
+    if (rule.minRaw > rule.maxRaw)
+        qSwap(rule.minRaw, rule.maxRaw);
+
+    // Limits default to +-Inf, always clamp to the destination bit field
+    _rawRange(destination, fieldLower, fieldUpper);
+    rule.minRaw = qBound(fieldLower, rule.minRaw, fieldUpper);
+    rule.maxRaw = qBound(fieldLower, rule.maxRaw, fieldUpper);
+
+    m_Routes[route]->rules.push_back(rule);
+
+    return true;
+}
+
+bool QCanGateway::getStatistics(int route, QCanGatewayStatistics & stats) const
+{
+    int sequence;
+
+    if (route < 0 || route >= m_Routes.size())
+        return false;
+
+    Route *r = m_Routes[route];
+
+    do {
+        sequence = r->lock.beginRead();
+        stats = r->stats;
+    } while (r->lock.retryRead(sequence));
+
+    return true;
+}
+
+void QCanGateway::canMessageReceived(const QCanMessage & frame)
+{
+    QHash<quint32, QVector<Route*> >::const_iterator iter = m_RouteIndex.constFind(_key(frame.id, frame.isExt));
+
+    if (iter == m_RouteIndex.constEnd())
+        return;
+
+    const qint64 start_ns = _now_ns(CLOCK_MONOTONIC);
+    const QVector<Route*> & routes = iter.value();
+
+    for (int i = 0; i < routes.size(); i++)
+        route(routes[i], frame, start_ns);
+}
+
+void QCanGateway::route(Route *r, const QCanMessage & frame, qint64 start_ns)
+{
+    QCanMessage out;
+
+    out.tv = frame.tv;
+    out.id = r->id;
+    out.isExt = r->isExt;
+
+    if (!r->rewrite) {
+        out.dlc = frame.dlc;
+        ::memcpy(out.data, frame.data, sizeof(out.data));
+    } else {
+        quint64 word;
+
+        ::memcpy(&word, frame.data, sizeof(word));
+
+        // Payload as seen by Intel and Motorola signals
+        const quint64 sourceIntel = le64toh(word);
+        const quint64 sourceMotorola = be64toh(word);
+
+        // Destination is kept in Intel order, Motorola rules work on
+        // the byte swapped word. Signals without rule keep their current value.
+        QCanMessage current;
+
+        r->message->buildMessage(current);
+        ::memcpy(&word, current.data, sizeof(word));
+
+        quint64 destination = le64toh(word);
+
+        for (int i = 0; i < r->rules.size(); i++) {
+            const Rule & rule = r->rules[i];
+            quint64 raw = ((rule.sourceIntel ? sourceIntel : sourceMotorola) >> rule.sourceShift) & rule.sourceMask;
+
+            // Sign extend
+            if (rule.sourceSigned && rule.sourceLength < 64 && (raw >> (rule.sourceLength - 1)) & 1)
+                raw |= ~rule.sourceMask;
+
+            if (rule.convert) {
+                double value = rule.sourceSigned ? (double)(qint64)raw : (double)raw;
+
+                value = floor(rule.a * value + rule.b + 0.5);
+
+                if (value < rule.minRaw)
+                    value = rule.minRaw;
+
+                if (value > rule.maxRaw)
+                    value = rule.maxRaw;
+
+                raw = value < 0.0 ? (quint64)(qint64)value : (quint64)value;
+            }
+
+            raw = (raw & rule.destinationMask) << rule.destinationShift;
+
+            if (rule.destinationIntel) {
+                destination = (destination & ~(rule.destinationMask << rule.destinationShift)) | raw;
+            } else {
+                quint64 motorola = bswap_64(destination);
+
+                motorola = (motorola & ~(rule.destinationMask << rule.destinationShift)) | raw;
+                destination = bswap_64(motorola);
+            }
+        }
+
+        word = htole64(destination);
+        ::memcpy(out.data, &word, sizeof(word));
+        out.dlc = r->dlc;
+    }
+
+    bool sent = r->destination->Send(out);
+
+    const qint64 end_ns = _now_ns(CLOCK_MONOTONIC);
+    const qint64 processing = end_ns - start_ns;
+
+    // Kernel receive timestamps use the realtime clock
+    qint64 latency = _now_ns(CLOCK_REALTIME) -
+            ((qint64)frame.tv.tv_sec * 1000000000LL + (qint64)frame.tv.tv_usec * 1000);
+
+    r->lock.beginWrite();
+
+    QCanGatewayStatistics & s = r->stats;
+
+    if (!sent) {
+        s.errors++;
+    } else {
+        s.count++;
+
+        if (s.count == 1 || latency < s.minLatency_ns)
+            s.minLatency_ns = latency;
+
+        if (s.count == 1 || latency > s.maxLatency_ns)
+            s.maxLatency_ns = latency;
+
+        if (processing > s.maxProcessing_ns)
+            s.maxProcessing_ns = processing;
+
+        s.lastLatency_ns = latency;
+        s.meanLatency_ns += (latency - s.meanLatency_ns) / s.count;
+        s.meanProcessing_ns += (processing - s.meanProcessing_ns) / s.count;
+    }
+
+    r->lock.endWrite();
+}
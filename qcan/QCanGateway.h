@@ -0,0 +1,159 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANGATEWAY_H_
+#define QCANGATEWAY_H_
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+
+#include "QCanSeqLock.h"
+
+class QCanChannel;
+class QCanSignal;
+class QCanSignalContainer;
+struct QCanMessage;
+
+/**
+ * Routing statistics of a gateway route. Latency is measured from the
+ * kernel receive timestamp of the source frame until the routed frame was
+ * written, processing from entering the gateway until the frame was written.
+ */
+struct QCanGatewayStatistics
+{
+    quint64 count;
+    quint64 errors;
+
+    qint64 lastLatency_ns;
+    qint64 minLatency_ns;
+    qint64 maxLatency_ns;
+    double meanLatency_ns;
+
+    qint64 maxProcessing_ns;
+    double meanProcessing_ns;
+};
+
+/**
+ * Routes frames received on a source channel to other channels.
+ *
+ * A route either forwards a frame with a new identifier, or builds the
+ * destination frame from signal rules. Rules are compiled into mask/shift
+ * operations on the 64 bit payload: signals with equal scaling are copied
+ * bitwise, otherwise the raw value is converted by a single a * raw + b and
+ * clamped to the limits and the bit field of the destination signal.
+ * Destination signals without a rule keep the current data of the
+ * destination message.
+ *
+ * Routing runs on the receive thread of the source channel, routes must be
+ * added before the channel is started.
+ */
+class QCanGateway : public QObject
+{
+    Q_OBJECT
+
+public:
+    QCanGateway(QCanChannel *source, QObject *parent = NULL);
+    ~QCanGateway();
+
+    /**
+     * Forward a frame unchanged except for its identifier
+     * @return route index
+     */
+    int addRoute(quint32 id, bool isExt, QCanChannel *destination,
+                 quint32 destinationId, bool destinationExt);
+
+    /**
+     * Build a destination message from a source message, the payload
+     * is defined by signal rules added by addSignalRule()
+     * @return route index
+     */
+    int addRoute(QCanSignalContainer *message, QCanChannel *destination,
+                 QCanSignalContainer *destinationMessage);
+
+    /**
+     * Copy a signal, the physical value is converted to
+     * destination = source * factor + offset
+     * @return false if route is invalid or has no signal rules
+     */
+    bool addSignalRule(int route, QCanSignal *source, QCanSignal *destination,
+                       double factor = 1.0, double offset = 0.0);
+
+    int getRouteCount() const { return m_Routes.size(); }
+
+    /**
+     * Read statistics of a route. May be called from any thread.
+     */
+    bool getStatistics(int route, QCanGatewayStatistics & stats) const;
+
+private slots:
+    void canMessageReceived(const QCanMessage & frame);
+
+private:
+    struct Rule {
+        bool sourceIntel;
+        bool sourceSigned;
+        quint32 sourceLength;
+        quint32 sourceShift;
+        quint64 sourceMask;
+
+        bool destinationIntel;
+        quint32 destinationShift;
+        quint64 destinationMask;
+
+        // Raw value is copied if false, converted by a * raw + b otherwise
+        bool convert;
+        double a;
+        double b;
+        double minRaw;
+        double maxRaw;
+    };
+
+    struct Route {
+        QCanChannel *destination;
+
+        // Provides the payload of signals without rule, NULL if forwarded
+        QCanSignalContainer *message;
+
+        quint32 id;
+        bool isExt;
+
+        // Payload is built from rules instead of copied
+        bool rewrite;
+        quint8 dlc;
+        QVector<Rule> rules;
+
+        QCanSeqLock lock;
+        QCanGatewayStatistics stats;
+    };
+
+    int addRoute(quint32 key, Route *route);
+    void route(Route *r, const QCanMessage & frame, qint64 start_ns);
+
+    QCanChannel *m_Source;
+
+    QVector<Route*> m_Routes;
+
+    // Routes by source identifier (bit 31 set for extended frames)
+    QHash<quint32, QVector<Route*> > m_RouteIndex;
+};
+
+#endif /* QCANGATEWAY_H_ */
@@ -0,0 +1,276 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <time.h>
+
+#include <algorithm>
+
+#include "QCanMergeChannel.h"
+#include "QCanRecorder.h"
+#include "QCanRecordReader.h"
+
+static quint64 _now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (quint64)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static inline quint64 _timestamp_us(const QCanMessage & frame)
+{
+    return (quint64)frame.tv.tv_sec * 1000000ULL + frame.tv.tv_usec;
+}
+
+QCanMergeChannel::QCanMergeChannel(int maxLatency_ms, int maxWindow)
+ : m_MaxLatency_us((quint64)maxLatency_ms * 1000), m_MaxWindow(maxWindow),
+   m_Sequence(0), m_LastReleased_us(0), m_MergedFrames(0), m_LateFrames(0)
+{
+    m_Heap.reserve(maxWindow + 1);
+}
+
+QCanMergeChannel::~QCanMergeChannel()
+{
+    Stop();
+}
+
+int QCanMergeChannel::addChannel(QCanChannel *channel)
+{
+    Input input;
+
+    input.channel = channel;
+    input.lastTime_us = 0;
+    input.lastArrival_us = 0;
+
+    const int index = m_Inputs.size();
+
+    m_Inputs.push_back(input);
+
+    // Frames are queued on the receive thread of the input. sender() is not
+    // valid there, the index is bound to the connection instead.
+    QObject::connect(channel, &QCanChannel::canMessageReceived, this, [this, index](const QCanMessage & frame) {
+        inputMessageReceived(index, frame);
+    }, Qt::DirectConnection);
+
+    return index;
+}
+
+void QCanMergeChannel::Stop()
+{
+    m_Lock.lock();
+    m_TerminationRequested = true;
+    m_Wakeup.wakeAll();
+    m_Lock.unlock();
+
+    wait();
+}
+
+bool QCanMergeChannel::Send(const QCanMessage & message)
+{
+    Q_UNUSED(message);
+
+    return false;
+}
+
+bool QCanMergeChannel::later(const Entry & a, const Entry & b)
+{
+    if (a.time_us != b.time_us)
+        return a.time_us > b.time_us;
+
+    return a.sequence > b.sequence;
+}
+
+void QCanMergeChannel::inputMessageReceived(int index, const QCanMessage & frame)
+{
+    Entry e;
+
+    e.time_us = _timestamp_us(frame);
+    e.arrival_us = _now_us();
+    e.input = index;
+    e.channel = -1;
+    e.frame = frame;
+
+    QMutexLocker locker(&m_Lock);
+
+    Input & input = m_Inputs[index];
+
+    if (e.time_us > input.lastTime_us)
+        input.lastTime_us = e.time_us;
+
+    input.lastArrival_us = e.arrival_us;
+
+    e.sequence = m_Sequence++;
+
+    m_Heap.push_back(e);
+    std::push_heap(m_Heap.begin(), m_Heap.end(), later);
+
+    m_Wakeup.wakeOne();
+}
+
+bool QCanMergeChannel::canRelease(quint64 now_us, quint64 & wait_us) const
+{
+    const Entry & top = m_Heap.first();
+
+    if (m_Heap.size() > m_MaxWindow)
+        return true;
+
+    if (now_us >= top.arrival_us + m_MaxLatency_us)
+        return true;
+
+    wait_us = top.arrival_us + m_MaxLatency_us - now_us;
+
+    for (int i = 0; i < m_Inputs.size(); i++) {
+        const Input & input = m_Inputs[i];
+
+        // Inputs idle for the latency bound don't hold back others
+        if (input.lastTime_us >= top.time_us || now_us >= input.lastArrival_us + m_MaxLatency_us)
+            continue;
+
+        quint64 idle_us = input.lastArrival_us + m_MaxLatency_us - now_us;
+
+        if (idle_us < wait_us)
+            wait_us = idle_us;
+
+        return false;
+    }
+
+    return true;
+}
+
+void QCanMergeChannel::run()
+{
+    QVector<Entry> batch;
+
+    m_Lock.lock();
+
+    for (;;) {
+        const quint64 now_us = _now_us();
+        quint64 wait_us = m_MaxLatency_us;
+
+        // Release everything left on termination
+        while (!m_Heap.isEmpty() && (m_TerminationRequested || canRelease(now_us, wait_us))) {
+            std::pop_heap(m_Heap.begin(), m_Heap.end(), later);
+            batch.push_back(m_Heap.last());
+            m_Heap.pop_back();
+        }
+
+        if (batch.isEmpty()) {
+            if (m_TerminationRequested)
+                break;
+
+            m_Wakeup.wait(&m_Lock, m_Heap.isEmpty() ? 100 : (wait_us + 999) / 1000);
+            continue;
+        }
+
+        // Emit without holding the lock, inputs keep queueing
+        m_Lock.unlock();
+
+        for (int i = 0; i < batch.size(); i++) {
+            const Entry & e = batch[i];
+
+            if (e.time_us < m_LastReleased_us)
+                m_LateFrames.fetchAndAddRelaxed(1);
+            else
+                m_LastReleased_us = e.time_us;
+
+            emit canMessageReceived(e.frame);
+            emit canMessageMerged(e.input, e.frame);
+        }
+
+        m_MergedFrames.fetchAndAddRelaxed(batch.size());
+        batch.clear();
+
+        m_Lock.lock();
+    }
+
+    m_Lock.unlock();
+}
+
+bool QCanMergeChannel::mergeFiles(const QStringList & inputs, const QString & output, int maxWindow)
+{
+    QVector<QCanRecordReader*> readers;
+    QVector<Entry> heads, window;
+    QCanRecorder recorder;
+    bool ok = recorder.open(output);
+    quint64 sequence = 0;
+
+    for (int i = 0; ok && i < inputs.size(); i++) {
+        QCanRecordReader *reader = new QCanRecordReader();
+
+        readers.push_back(reader);
+
+        if (!reader->open(inputs[i])) {
+            ok = false;
+            break;
+        }
+
+        Entry e;
+
+        e.input = i;
+        e.arrival_us = 0;
+
+        if (reader->next(e.frame)) {
+            e.time_us = _timestamp_us(e.frame);
+            e.sequence = sequence++;
+            e.channel = recorder.addChannel(reader->getChannelName());
+            heads.push_back(e);
+        }
+    }
+
+    std::make_heap(heads.begin(), heads.end(), later);
+
+    // k-way merge over the file heads, unordered frames within a file are
+    // sorted by the reorder window
+    while (ok && !heads.isEmpty()) {
+        std::pop_heap(heads.begin(), heads.end(), later);
+
+        Entry & head = heads.last();
+
+        window.push_back(head);
+        std::push_heap(window.begin(), window.end(), later);
+
+        if (readers[head.input]->next(head.frame)) {
+            head.time_us = _timestamp_us(head.frame);
+            head.sequence = sequence++;
+            head.channel = recorder.addChannel(readers[head.input]->getChannelName());
+            std::push_heap(heads.begin(), heads.end(), later);
+        } else {
+            heads.pop_back();
+        }
+
+        if (window.size() > maxWindow) {
+            std::pop_heap(window.begin(), window.end(), later);
+            recorder.writeMessage(window.last().frame, window.last().channel);
+            window.pop_back();
+        }
+    }
+
+    while (ok && !window.isEmpty()) {
+        std::pop_heap(window.begin(), window.end(), later);
+        recorder.writeMessage(window.last().frame, window.last().channel);
+        window.pop_back();
+    }
+
+    recorder.close();
+    qDeleteAll(readers);
+
+    return ok;
+}
@@ -0,0 +1,136 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANMERGECHANNEL_H_
+#define QCANMERGECHANNEL_H_
+
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QAtomicInteger>
+
+#include "QCanChannel.h"
+
+/**
+ * Channel combining the frames of several input channels into a single
+ * stream ordered by timestamp.
+ *
+ * Received frames are kept in a min-heap. A frame is released once every
+ * input active within the latency bound has delivered a frame at least as
+ * late, once it was held back for the latency bound or once the reorder
+ * window is full. Inputs must use the same clock for their timestamps
+ * (SocketCAN channels or replay channels with rebased timestamps).
+ * Frames are emitted on the merge thread.
+ */
+class QCanMergeChannel : public QCanChannel
+{
+    Q_OBJECT
+
+signals:
+    /// Like canMessageReceived() with the index of the input channel
+    void canMessageMerged(int input, const QCanMessage & frame);
+
+public:
+    /**
+     * @param maxLatency_ms longest time a frame is held back
+     * @param maxWindow maximum number of frames held back
+     */
+    QCanMergeChannel(int maxLatency_ms = 10, int maxWindow = 65536);
+    virtual ~QCanMergeChannel();
+
+    /**
+     * Add an input channel, must be called before Start()
+     * @return index of the input
+     */
+    int addChannel(QCanChannel *channel);
+
+    /// Input channel of an index returned by addChannel()
+    QCanChannel* getInput(int index) const { return m_Inputs[index].channel; }
+    int getInputCount() const { return m_Inputs.size(); }
+
+    virtual bool IsValid() { return !m_Inputs.isEmpty(); }
+    virtual void Stop();
+
+    /// The merged stream has no transmit path, frames are dropped
+    virtual bool Send(const QCanMessage & message);
+
+    quint64 getMergedFrames() const { return m_MergedFrames.load(); }
+
+    /// Frames released after a frame with a later timestamp
+    quint64 getLateFrames() const { return m_LateFrames.load(); }
+
+    /**
+     * Merge recordings written by QCanRecorder into a single recording
+     * ordered by timestamp. Inputs are expected to be mostly ordered,
+     * frames are reordered within a window of maxWindow frames.
+     */
+    static bool mergeFiles(const QStringList & inputs, const QString & output, int maxWindow = 65536);
+
+protected:
+    void run();
+
+private:
+    struct Entry {
+        quint64 time_us;
+        quint64 sequence;
+        quint64 arrival_us;
+        int input;
+        QCanMessage frame;
+
+        // Recorder channel of the frame, only used by mergeFiles()
+        int channel;
+    };
+
+    struct Input {
+        QCanChannel *channel;
+        quint64 lastTime_us;
+        quint64 lastArrival_us;
+    };
+
+    /// Queue a frame of an input, called on the receive thread of the input
+    void inputMessageReceived(int index, const QCanMessage & frame);
+
+    /// Comparator for a min-heap on timestamp and arrival order
+    static bool later(const Entry & a, const Entry & b);
+
+    /**
+     * @param wait_us set to the time until the top may be released
+     * @return true if the top of the heap may be released
+     */
+    bool canRelease(quint64 now_us, quint64 & wait_us) const;
+
+    const quint64 m_MaxLatency_us;
+    const int m_MaxWindow;
+
+    QVector<Input> m_Inputs;
+
+    QMutex m_Lock;
+    QWaitCondition m_Wakeup;
+    QVector<Entry> m_Heap;
+    quint64 m_Sequence;
+    quint64 m_LastReleased_us;
+
+    QAtomicInteger<quint64> m_MergedFrames;
+    QAtomicInteger<quint64> m_LateFrames;
+};
+
+#endif /* QCANMERGECHANNEL_H_ */
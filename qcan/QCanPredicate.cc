@@ -0,0 +1,520 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <QStringList>
+
+#include "QCanPredicate.h"
+#include "QCanSignals.h"
+#include "QCanChannel.h"
+
+static const char * const s_Operators[] = {
+    "&&", "||", "==", "!=", "<=", ">=", "<<", ">>",
+    "<", ">", "+", "-", "*", "/", "%", "&", "|", "^", "!", "~", "(", ")", "[", "]"
+};
+
+#define NUM_OPERATORS (sizeof(s_Operators) / sizeof(s_Operators[0]))
+
+/**
+ * Recursive descent parser emitting the stack machine program
+ */
+class QCanPredicateCompiler
+{
+public:
+    QCanPredicateCompiler(QCanPredicate & predicate, const QByteArray & text)
+     : m_Predicate(predicate), m_Text(text), m_Pos(m_Text.constData()),
+       m_Token(T_END), m_Number(0.0), m_Depth(0) {}
+
+    bool run();
+
+private:
+    typedef enum E_TOKEN {
+        T_END = 0,
+        T_NUMBER,
+        T_NAME,
+        T_OPERATOR
+    } token_t;
+
+    struct BinaryOperator {
+        const char *text;
+        int precedence;
+        QCanPredicate::opcode_t op;
+    };
+
+    static const BinaryOperator * findBinaryOperator(const QByteArray & text);
+
+    bool next();
+    bool isOperator(const char *op) const { return m_Token == T_OPERATOR && m_TokenText == op; }
+    bool expect(const char *op);
+
+    bool parseBinary(int minPrecedence);
+    bool parseUnary();
+    bool parsePrimary();
+    bool parseName(const QString & name);
+
+    bool append(QCanPredicate::opcode_t op, qint32 arg = 0);
+    bool fail(const QString & message);
+
+    QCanPredicate & m_Predicate;
+
+    const QByteArray m_Text;
+    const char *m_Pos;
+
+    token_t m_Token;
+    QByteArray m_TokenText;
+    double m_Number;
+
+    int m_Depth;
+};
+
+const QCanPredicateCompiler::BinaryOperator *
+QCanPredicateCompiler::findBinaryOperator(const QByteArray & text)
+{
+    static const BinaryOperator operators[] = {
+        { "||",  1, QCanPredicate::OP_JUMP_IF_TRUE },
+        { "&&",  2, QCanPredicate::OP_JUMP_IF_FALSE },
+        { "|",   3, QCanPredicate::OP_BIT_OR },
+        { "^",   4, QCanPredicate::OP_BIT_XOR },
+        { "&",   5, QCanPredicate::OP_BIT_AND },
+        { "==",  6, QCanPredicate::OP_EQ },
+        { "!=",  6, QCanPredicate::OP_NE },
+        { "<",   7, QCanPredicate::OP_LT },
+        { "<=",  7, QCanPredicate::OP_LE },
+        { ">",   7, QCanPredicate::OP_GT },
+        { ">=",  7, QCanPredicate::OP_GE },
+        { "<<",  8, QCanPredicate::OP_SHL },
+        { ">>",  8, QCanPredicate::OP_SHR },
+        { "+",   9, QCanPredicate::OP_ADD },
+        { "-",   9, QCanPredicate::OP_SUB },
+        { "*",  10, QCanPredicate::OP_MUL },
+        { "/",  10, QCanPredicate::OP_DIV },
+        { "%",  10, QCanPredicate::OP_MOD },
+    };
+
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+        if (text == operators[i].text)
+            return &operators[i];
+    }
+
+    return NULL;
+}
+
+bool QCanPredicateCompiler::fail(const QString & message)
+{
+    m_Predicate.m_Error = QString("%1 at position %2")
+            .arg(message)
+            .arg(m_Pos - m_Text.constData());
+    return false;
+}
+
+bool QCanPredicateCompiler::next()
+{
+    while (isspace((unsigned char)*m_Pos))
+        m_Pos++;
+
+    const char *start = m_Pos;
+
+    if (*m_Pos == '\0') {
+        m_Token = T_END;
+        m_TokenText.clear();
+        return true;
+    }
+
+    if (isdigit((unsigned char)*m_Pos) || (*m_Pos == '.' && isdigit((unsigned char)m_Pos[1]))) {
+        char *end;
+
+        if (m_Pos[0] == '0' && (m_Pos[1] == 'x' || m_Pos[1] == 'X'))
+            m_Number = strtoull(m_Pos, &end, 16);
+        else
+            m_Number = strtod(m_Pos, &end);
+
+        m_Pos = end;
+        m_Token = T_NUMBER;
+        m_TokenText = QByteArray(start, m_Pos - start);
+        return true;
+    }
+
+    if (isalpha((unsigned char)*m_Pos) || *m_Pos == '_') {
+        while (isalnum((unsigned char)*m_Pos) || *m_Pos == '_' || *m_Pos == '.')
+            m_Pos++;
+
+        m_Token = T_NAME;
+        m_TokenText = QByteArray(start, m_Pos - start);
+        return true;
+    }
+
+    for (size_t i = 0; i < NUM_OPERATORS; i++) {
+        size_t len = strlen(s_Operators[i]);
+
+        if (strncmp(m_Pos, s_Operators[i], len) == 0) {
+            m_Pos += len;
+            m_Token = T_OPERATOR;
+            m_TokenText = QByteArray(start, len);
+            return true;
+        }
+    }
+
+    return fail(QString("Unexpected character '%1'").arg(QChar(*m_Pos)));
+}
+
+bool QCanPredicateCompiler::expect(const char *op)
+{
+    if (!isOperator(op))
+        return fail(QString("Expected '%1'").arg(op));
+
+    return next();
+}
+
+bool QCanPredicateCompiler::append(QCanPredicate::opcode_t op, qint32 arg)
+{
+    QCanPredicate::Instruction i;
+
+    i.op = op;
+    i.arg = arg;
+    m_Predicate.m_Program.push_back(i);
+
+    switch (op) {
+    case QCanPredicate::OP_CONST:
+    case QCanPredicate::OP_SIGNAL:
+    case QCanPredicate::OP_ID:
+    case QCanPredicate::OP_DLC:
+    case QCanPredicate::OP_EXT:
+    case QCanPredicate::OP_DATA:
+        m_Depth++;
+        break;
+    case QCanPredicate::OP_NEG:
+    case QCanPredicate::OP_NOT:
+    case QCanPredicate::OP_BIT_NOT:
+    case QCanPredicate::OP_TO_BOOL:
+        break;
+    default:
+        // Binary operators and the fall through path of jumps pop one value
+        m_Depth--;
+        break;
+    }
+
+    if (m_Depth > QCanPredicate::MAX_STACK_DEPTH)
+        return fail("Expression too complex");
+
+    return true;
+}
+
+bool QCanPredicateCompiler::run()
+{
+    if (!next() || !parseBinary(1))
+        return false;
+
+    if (m_Token != T_END)
+        return fail(QString("Unexpected '%1'").arg(QString::fromLatin1(m_TokenText)));
+
+    return true;
+}
+
+bool QCanPredicateCompiler::parseBinary(int minPrecedence)
+{
+    if (!parseUnary())
+        return false;
+
+    for (;;) {
+        if (m_Token != T_OPERATOR)
+            return true;
+
+        const BinaryOperator *o = findBinaryOperator(m_TokenText);
+
+        if (!o || o->precedence < minPrecedence)
+            return true;
+
+        if (!next())
+            return false;
+
+        if (o->op == QCanPredicate::OP_JUMP_IF_FALSE || o->op == QCanPredicate::OP_JUMP_IF_TRUE) {
+            int jump = m_Predicate.m_Program.size();
+
+            if (!append(o->op) || !parseBinary(o->precedence + 1) || !append(QCanPredicate::OP_TO_BOOL))
+                return false;
+
+            m_Predicate.m_Program[jump].arg = m_Predicate.m_Program.size();
+        } else {
+            if (!parseBinary(o->precedence + 1) || !append(o->op))
+                return false;
+        }
+    }
+}
+
+bool QCanPredicateCompiler::parseUnary()
+{
+    QCanPredicate::opcode_t op;
+
+    if (isOperator("!"))
+        op = QCanPredicate::OP_NOT;
+    else if (isOperator("-"))
+        op = QCanPredicate::OP_NEG;
+    else if (isOperator("~"))
+        op = QCanPredicate::OP_BIT_NOT;
+    else if (isOperator("+"))
+        return next() && parseUnary();
+    else
+        return parsePrimary();
+
+    return next() && parseUnary() && append(op);
+}
+
+bool QCanPredicateCompiler::parsePrimary()
+{
+    if (m_Token == T_NUMBER) {
+        m_Predicate.m_Constants.push_back(m_Number);
+        return append(QCanPredicate::OP_CONST, m_Predicate.m_Constants.size() - 1) && next();
+    }
+
+    if (isOperator("(")) {
+        return next() && parseBinary(1) && expect(")");
+    }
+
+    if (m_Token == T_NAME) {
+        QString name = QString::fromLatin1(m_TokenText);
+
+        return next() && parseName(name);
+    }
+
+    if (m_Token == T_END)
+        return fail("Unexpected end of expression");
+
+    return fail(QString("Unexpected '%1'").arg(QString::fromLatin1(m_TokenText)));
+}
+
+bool QCanPredicateCompiler::parseName(const QString & name)
+{
+    if (name == "true" || name == "false") {
+        m_Predicate.m_Constants.push_back(name == "true" ? 1.0 : 0.0);
+        return append(QCanPredicate::OP_CONST, m_Predicate.m_Constants.size() - 1);
+    }
+
+    if (name == "id")
+        return append(QCanPredicate::OP_ID);
+
+    if (name == "dlc")
+        return append(QCanPredicate::OP_DLC);
+
+    if (name == "ext")
+        return append(QCanPredicate::OP_EXT);
+
+    if (name == "data") {
+        if (!expect("["))
+            return false;
+
+        if (m_Token != T_NUMBER || m_Number < 0 || m_Number > 7 || m_Number != floor(m_Number))
+            return fail("Data index must be a number between 0 and 7");
+
+        int index = (int)m_Number;
+
+        return next() && expect("]") && append(QCanPredicate::OP_DATA, index);
+    }
+
+    // Signal reference: <bus>.<message>.<signal> or <message>.<signal>
+    QStringList parts = name.split(".");
+    QCanSignalContainer *message = NULL;
+    QCanSignal *signal = NULL;
+    QCanSignals *bus = NULL;
+
+    if (parts.size() == 3) {
+        bus = m_Predicate.m_Buses.value(parts[0], NULL);
+
+        if (!bus)
+            return fail(QString("Unknown bus '%1'").arg(parts[0]));
+
+        message = (*bus)[parts[1]];
+
+        if (message)
+            signal = (*message)[parts[2]];
+    } else if (parts.size() == 2) {
+        QHash<QString, QCanSignals*>::iterator iter;
+
+        for (iter = m_Predicate.m_Buses.begin(); iter != m_Predicate.m_Buses.end(); ++iter) {
+            QCanSignalContainer *m = (*iter.value())[parts[0]];
+            QCanSignal *s = m ? (*m)[parts[1]] : NULL;
+
+            if (!s)
+                continue;
+
+            if (signal)
+                return fail(QString("Ambiguous signal '%1', prefix bus name").arg(name));
+
+            bus = iter.value();
+            message = m;
+            signal = s;
+        }
+    }
+
+    if (!signal)
+        return fail(QString("Unknown name '%1'").arg(name));
+
+    QCanPredicate::SignalRef ref;
+
+    ref.signal = signal;
+    ref.key = message->isExt() ? (message->getCanId() | 0x80000000) : message->getCanId();
+    ref.channel = bus->getChannel();
+
+    int index;
+
+    for (index = 0; index < m_Predicate.m_Signals.size(); index++) {
+        if (m_Predicate.m_Signals[index].signal == signal)
+            break;
+    }
+
+    if (index == m_Predicate.m_Signals.size())
+        m_Predicate.m_Signals.push_back(ref);
+
+    return append(QCanPredicate::OP_SIGNAL, index);
+}
+
+QCanPredicate::QCanPredicate()
+{
+}
+
+QCanPredicate::~QCanPredicate()
+{
+}
+
+void QCanPredicate::addBus(const QString & name, QCanSignals *canSignals)
+{
+    m_Buses.insert(name, canSignals);
+}
+
+bool QCanPredicate::compile(const QString & expression)
+{
+    m_Expression = expression;
+    m_Error.clear();
+    m_Program.clear();
+    m_Constants.clear();
+    m_Signals.clear();
+
+    QCanPredicateCompiler compiler(*this, expression.toLatin1());
+
+    if (!compiler.run()) {
+        m_Program.clear();
+        return false;
+    }
+
+    return true;
+}
+
+static inline qint64 _toInt(double value)
+{
+    // Avoid undefined conversions of NaN and out of range values
+    if (!(value > -9.2e18 && value < 9.2e18))
+        return 0;
+
+    return (qint64)value;
+}
+
+double QCanPredicate::evaluateValue(const QCanMessage & frame, const QCanChannel *channel) const
+{
+    double stack[MAX_STACK_DEPTH];
+    int sp = -1;
+
+    const Instruction *program = m_Program.constData();
+    const double *constants = m_Constants.constData();
+    const SignalRef *signals_ = m_Signals.constData();
+    const int size = m_Program.size();
+    const quint32 key = frame.isExt ? (frame.id | 0x80000000) : frame.id;
+
+    for (int pc = 0; pc < size; pc++) {
+        const Instruction & i = program[pc];
+
+        switch (i.op) {
+        case OP_CONST:
+            stack[++sp] = constants[i.arg];
+            break;
+        case OP_SIGNAL: {
+            const SignalRef & ref = signals_[i.arg];
+
+            stack[++sp] = ref.key == key && (!channel || ref.channel == channel) ?
+                        ref.signal->physicalValueFromMessage(frame) :
+                        ref.signal->getPhysicalValue();
+            break;
+        }
+        case OP_ID:
+            stack[++sp] = frame.id;
+            break;
+        case OP_DLC:
+            stack[++sp] = frame.dlc;
+            break;
+        case OP_EXT:
+            stack[++sp] = frame.isExt ? 1.0 : 0.0;
+            break;
+        case OP_DATA:
+            stack[++sp] = i.arg < frame.dlc ? frame.data[i.arg] : 0.0;
+            break;
+
+        case OP_NEG:
+            stack[sp] = -stack[sp];
+            break;
+        case OP_NOT:
+            stack[sp] = stack[sp] == 0.0 ? 1.0 : 0.0;
+            break;
+        case OP_BIT_NOT:
+            stack[sp] = ~_toInt(stack[sp]);
+            break;
+        case OP_TO_BOOL:
+            stack[sp] = stack[sp] != 0.0 ? 1.0 : 0.0;
+            break;
+
+        case OP_MUL:     sp--; stack[sp] = stack[sp] * stack[sp + 1]; break;
+        case OP_DIV:     sp--; stack[sp] = stack[sp] / stack[sp + 1]; break;
+        case OP_MOD:     sp--; stack[sp] = fmod(stack[sp], stack[sp + 1]); break;
+        case OP_ADD:     sp--; stack[sp] = stack[sp] + stack[sp + 1]; break;
+        case OP_SUB:     sp--; stack[sp] = stack[sp] - stack[sp + 1]; break;
+        case OP_SHL:     sp--; stack[sp] = _toInt(stack[sp]) << (_toInt(stack[sp + 1]) & 63); break;
+        case OP_SHR:     sp--; stack[sp] = _toInt(stack[sp]) >> (_toInt(stack[sp + 1]) & 63); break;
+        case OP_LT:      sp--; stack[sp] = stack[sp] < stack[sp + 1]; break;
+        case OP_LE:      sp--; stack[sp] = stack[sp] <= stack[sp + 1]; break;
+        case OP_GT:      sp--; stack[sp] = stack[sp] > stack[sp + 1]; break;
+        case OP_GE:      sp--; stack[sp] = stack[sp] >= stack[sp + 1]; break;
+        case OP_EQ:      sp--; stack[sp] = stack[sp] == stack[sp + 1]; break;
+        case OP_NE:      sp--; stack[sp] = stack[sp] != stack[sp + 1]; break;
+        case OP_BIT_AND: sp--; stack[sp] = _toInt(stack[sp]) & _toInt(stack[sp + 1]); break;
+        case OP_BIT_XOR: sp--; stack[sp] = _toInt(stack[sp]) ^ _toInt(stack[sp + 1]); break;
+        case OP_BIT_OR:  sp--; stack[sp] = _toInt(stack[sp]) | _toInt(stack[sp + 1]); break;
+
+        case OP_JUMP_IF_FALSE:
+            if (stack[sp] == 0.0) {
+                stack[sp] = 0.0;
+                pc = i.arg - 1;
+            } else {
+                sp--;
+            }
+            break;
+        case OP_JUMP_IF_TRUE:
+            if (stack[sp] != 0.0) {
+                stack[sp] = 1.0;
+                pc = i.arg - 1;
+            } else {
+                sp--;
+            }
+            break;
+        }
+    }
+
+    return sp >= 0 ? stack[sp] : 0.0;
+}
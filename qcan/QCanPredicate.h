@@ -0,0 +1,157 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANPREDICATE_H_
+#define QCANPREDICATE_H_
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+class QCanSignal;
+class QCanSignals;
+class QCanChannel;
+struct QCanMessage;
+
+/**
+ * Boolean expression over decoded signals and raw frame fields, e.g.
+ *
+ *   Motor.ABS.Speed > 120 && id == 0x0B2
+ *   (data[0] & 0x0F) == 3 || !ext
+ *
+ * Signals are referenced as <bus>.<message>.<signal>, or <message>.<signal>
+ * when the name is unique. Frame fields are id, dlc, ext and data[0..7].
+ * Operators and precedence follow C: ! ~ - (unary), * / %, + -, << >>,
+ * < <= > >=, == !=, &, ^, |, && and ||.
+ *
+ * The expression is compiled once into a flat stack machine program, which
+ * is evaluated without any allocation or locking. Signals of the evaluated
+ * frame are decoded from the frame itself, all other signals use their last
+ * published value. A signal belongs to the channel of its bus, frames of
+ * other channels with the same identifier are not decoded into it.
+ */
+class QCanPredicate
+{
+public:
+    QCanPredicate();
+    ~QCanPredicate();
+
+    /**
+     * Make the signals of a bus available to expressions. Must be called
+     * before compile().
+     * @param name bus name used in expressions
+     */
+    void addBus(const QString & name, QCanSignals *canSignals);
+
+    /**
+     * Compile an expression
+     * @return false on syntax errors or unknown names, see getError()
+     */
+    bool compile(const QString & expression);
+
+    bool isValid() const { return !m_Program.isEmpty(); }
+
+    const QString & getExpression() const { return m_Expression; }
+    const QString & getError() const { return m_Error; }
+
+    /**
+     * Evaluate predicate against a frame. May be called from any thread,
+     * e.g. the CAN receive thread.
+     * @param channel channel the frame was received on, signals are only
+     *        decoded from frames of their own channel. NULL matches signals
+     *        by identifier only, which is unambiguous with a single bus.
+     */
+    bool evaluate(const QCanMessage & frame, const QCanChannel *channel = NULL) const {
+        return evaluateValue(frame, channel) != 0.0;
+    }
+
+    /// Evaluate expression and return its numeric value
+    double evaluateValue(const QCanMessage & frame, const QCanChannel *channel = NULL) const;
+
+private:
+    friend class QCanPredicateCompiler;
+
+    enum {
+        // Maximum depth of the evaluation stack
+        MAX_STACK_DEPTH = 64
+    };
+
+    typedef enum E_OPCODE {
+        OP_CONST = 0,
+        OP_SIGNAL,
+        OP_ID,
+        OP_DLC,
+        OP_EXT,
+        OP_DATA,
+
+        OP_NEG,
+        OP_NOT,
+        OP_BIT_NOT,
+        OP_TO_BOOL,
+
+        OP_MUL,
+        OP_DIV,
+        OP_MOD,
+        OP_ADD,
+        OP_SUB,
+        OP_SHL,
+        OP_SHR,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_EQ,
+        OP_NE,
+        OP_BIT_AND,
+        OP_BIT_XOR,
+        OP_BIT_OR,
+
+        // Short-circuit of && and ||, argument is the jump target
+        OP_JUMP_IF_FALSE,
+        OP_JUMP_IF_TRUE
+    } opcode_t;
+
+    struct Instruction {
+        quint32 op;
+        qint32 arg;
+    };
+
+    struct SignalRef {
+        QCanSignal *signal;
+
+        // CAN identifier of the message, bit 31 set for extended frames
+        quint32 key;
+
+        // Channel of the bus the signal was resolved on
+        const QCanChannel *channel;
+    };
+
+    QString m_Expression;
+    QString m_Error;
+
+    QHash<QString, QCanSignals*> m_Buses;
+
+    QVector<Instruction> m_Program;
+    QVector<double> m_Constants;
+    QVector<SignalRef> m_Signals;
+};
+
+#endif /* QCANPREDICATE_H_ */
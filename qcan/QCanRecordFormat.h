@@ -0,0 +1,179 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANRECORDFORMAT_H_
+#define QCANRECORDFORMAT_H_
+
+#include <QtGlobal>
+
+/*
+ * Layout of a recording file (all integers little endian):
+ *
+ *   QCanRecordFileHeader
+ *   chunk 0 .. n-1:
+ *     QCanRecordChunkHeader
+ *     quint32 ids[idCount]      dictionary, bit 31 set for extended frames
+ *     quint16 idChannels[idCount]
+ *                               channel of each dictionary entry, an index
+ *                               into names or QCAN_RECORD_NO_CHANNEL
+ *     char names[channelCount][QCAN_RECORD_CHANNEL_NAME_SIZE]
+ *                               interface names, zero padded
+ *     payload[payloadSize]      encoded frames
+ *   QCanRecordIndexEntry[chunkCount]
+ *   QCanRecordTrailer
+ *
+ * A frame is encoded as:
+ *   varint   zigzag encoded timestamp delta in us to the previous frame
+ *            (to baseTime_us for the first frame of a chunk)
+ *   varint   index into the chunk dictionary
+ *   quint8   dlc
+ *   quint8   data[dlc]
+ *
+ * idChannels and names are only present if channelCount is not 0, which is
+ * always the case for version 1 files. An identifier received on two
+ * channels has a dictionary entry per channel.
+ *
+ * If the trailer is missing (e.g. recording was aborted) readers rebuild the
+ * index by walking the chunk headers.
+ */
+
+#define QCAN_RECORD_FILE_MAGIC   "QCANREC"
+#define QCAN_RECORD_VERSION      2
+#define QCAN_RECORD_CHUNK_MAGIC  0x48434351U /* "QCCH" */
+#define QCAN_RECORD_INDEX_MAGIC  0x58494351U /* "QCIX" */
+
+#define QCAN_RECORD_BITMAP_BITS  2048
+#define QCAN_RECORD_EXT_FLAG     0x80000000U
+
+#define QCAN_RECORD_CHANNEL_NAME_SIZE 16
+#define QCAN_RECORD_NO_CHANNEL   0xffffU
+
+struct QCanRecordFileHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 reserved;
+} __attribute__((packed));
+
+struct QCanRecordChunkHeader
+{
+    quint32 magic;
+    quint32 frameCount;
+
+    quint64 baseTime_us;
+    quint64 minTime_us;
+    quint64 maxTime_us;
+
+    quint32 payloadSize;
+    quint16 idCount;
+    quint16 channelCount;
+
+    /// Bit per standard identifier, extended identifiers are hashed
+    quint8 idBitmap[QCAN_RECORD_BITMAP_BITS / 8];
+} __attribute__((packed));
+
+struct QCanRecordIndexEntry
+{
+    quint64 offset;
+    quint64 minTime_us;
+    quint64 maxTime_us;
+    quint32 frameCount;
+    quint32 reserved;
+} __attribute__((packed));
+
+struct QCanRecordTrailer
+{
+    quint64 indexOffset;
+    quint32 chunkCount;
+    quint32 magic;
+} __attribute__((packed));
+
+/// Size of the dictionary and channel table following a chunk header
+static inline quint64 qcanRecordDictionarySize(const QCanRecordChunkHeader *header)
+{
+    quint64 size = (quint64)header->idCount * sizeof(quint32);
+
+    if (header->channelCount)
+        size += (quint64)header->idCount * sizeof(quint16) +
+                (quint64)header->channelCount * QCAN_RECORD_CHANNEL_NAME_SIZE;
+
+    return size;
+}
+
+/// Dictionary key of a CAN identifier
+static inline quint32 qcanRecordKey(quint32 id, bool isExt)
+{
+    return isExt ? (id | QCAN_RECORD_EXT_FLAG) : id;
+}
+
+/// Bit of an identifier in QCanRecordChunkHeader::idBitmap
+static inline quint32 qcanRecordBitmapBit(quint32 key)
+{
+    if (!(key & QCAN_RECORD_EXT_FLAG))
+        return key & (QCAN_RECORD_BITMAP_BITS - 1);
+
+    return ((key * 2654435761U) >> 21) & (QCAN_RECORD_BITMAP_BITS - 1);
+}
+
+static inline quint8 *qcanRecordPutVarint(quint8 *p, quint64 value)
+{
+    while (value >= 0x80) {
+        *p++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+
+    *p++ = value;
+
+    return p;
+}
+
+/// @return NULL if the varint exceeds end
+static inline const quint8 *qcanRecordGetVarint(const quint8 *p, const quint8 *end, quint64 & value)
+{
+    int shift = 0;
+
+    value = 0;
+
+    while (p < end && shift < 64) {
+        quint8 b = *p++;
+
+        value |= (quint64)(b & 0x7f) << shift;
+
+        if (!(b & 0x80))
+            return p;
+
+        shift += 7;
+    }
+
+    return NULL;
+}
+
+static inline quint64 qcanRecordZigZag(qint64 value)
+{
+    return ((quint64)value << 1) ^ (quint64)(value >> 63);
+}
+
+static inline qint64 qcanRecordUnZigZag(quint64 value)
+{
+    return (qint64)(value >> 1) ^ -(qint64)(value & 1);
+}
+
+#endif /* QCANRECORDFORMAT_H_ */
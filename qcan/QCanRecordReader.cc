@@ -0,0 +1,385 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "QCanRecordReader.h"
+#include "QCanChannel.h"
+
+QCanRecordReader::QCanRecordReader()
+ : m_Data(NULL), m_Size(0), m_FrameCount(0), m_HasFilter(false),
+   m_Chunk(-1), m_ChunkHeader(NULL), m_ChunkIds(NULL), m_ChunkIdChannels(NULL), m_ChunkChannelNames(NULL),
+   m_FrameEntry(-1), m_Cursor(NULL), m_ChunkEnd(NULL), m_ChunkFramesLeft(0), m_Time_us(0)
+{
+    ::memset(m_FilterBitmap, 0, sizeof(m_FilterBitmap));
+}
+
+QCanRecordReader::~QCanRecordReader()
+{
+    close();
+}
+
+bool QCanRecordReader::isRecording(const char *data, size_t size)
+{
+    return size >= sizeof(QCanRecordFileHeader) &&
+           ::memcmp(data, QCAN_RECORD_FILE_MAGIC, sizeof(QCAN_RECORD_FILE_MAGIC)) == 0;
+}
+
+bool QCanRecordReader::open(const QString & filename)
+{
+    struct stat st;
+
+    close();
+
+    int fd = ::open(filename.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(QCanRecordFileHeader)) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (p != MAP_FAILED) {
+            m_Data = static_cast<const quint8 *>(p);
+            m_Size = st.st_size;
+        }
+    }
+
+    ::close(fd);
+
+    if (!m_Data)
+        return false;
+
+    if (!isRecording(reinterpret_cast<const char *>(m_Data), m_Size) || !loadIndex()) {
+        close();
+        return false;
+    }
+
+    rewind();
+
+    return true;
+}
+
+void QCanRecordReader::close()
+{
+    if (m_Data)
+        munmap(const_cast<quint8 *>(m_Data), m_Size);
+
+    m_Data = NULL;
+    m_Size = 0;
+    m_Index.clear();
+    m_FrameCount = 0;
+    m_Chunk = -1;
+    m_ChunkHeader = NULL;
+    m_ChunkFramesLeft = 0;
+}
+
+bool QCanRecordReader::loadIndex()
+{
+    const QCanRecordTrailer *trailer = NULL;
+
+    m_Index.clear();
+    m_FrameCount = 0;
+
+    if (m_Size >= sizeof(QCanRecordFileHeader) + sizeof(QCanRecordTrailer))
+        trailer = reinterpret_cast<const QCanRecordTrailer *>(m_Data + m_Size - sizeof(QCanRecordTrailer));
+
+    if (trailer && trailer->magic == QCAN_RECORD_INDEX_MAGIC &&
+        trailer->indexOffset + (quint64)trailer->chunkCount * sizeof(QCanRecordIndexEntry) + sizeof(QCanRecordTrailer) == m_Size) {
+        const QCanRecordIndexEntry *entries = reinterpret_cast<const QCanRecordIndexEntry *>(m_Data + trailer->indexOffset);
+
+        m_Index.resize(trailer->chunkCount);
+        ::memcpy(m_Index.data(), entries, trailer->chunkCount * sizeof(QCanRecordIndexEntry));
+    } else {
+        // No index, recording was not closed. Walk all complete chunks.
+        size_t offset = sizeof(QCanRecordFileHeader);
+
+        while (offset + sizeof(QCanRecordChunkHeader) <= m_Size) {
+            const QCanRecordChunkHeader *header = reinterpret_cast<const QCanRecordChunkHeader *>(m_Data + offset);
+            size_t size = sizeof(QCanRecordChunkHeader) + qcanRecordDictionarySize(header) + header->payloadSize;
+
+            if (header->magic != QCAN_RECORD_CHUNK_MAGIC || offset + size > m_Size)
+                break;
+
+            QCanRecordIndexEntry entry;
+            entry.offset = offset;
+            entry.minTime_us = header->minTime_us;
+            entry.maxTime_us = header->maxTime_us;
+            entry.frameCount = header->frameCount;
+            entry.reserved = 0;
+
+            m_Index.push_back(entry);
+            offset += size;
+        }
+    }
+
+    for (int i = 0; i < m_Index.size(); i++) {
+        const QCanRecordChunkHeader *header;
+
+        if (m_Index[i].offset + sizeof(QCanRecordChunkHeader) > m_Size)
+            return false;
+
+        header = reinterpret_cast<const QCanRecordChunkHeader *>(m_Data + m_Index[i].offset);
+
+        if (header->magic != QCAN_RECORD_CHUNK_MAGIC ||
+            m_Index[i].offset + sizeof(QCanRecordChunkHeader) + qcanRecordDictionarySize(header) + header->payloadSize > m_Size)
+            return false;
+
+        m_FrameCount += m_Index[i].frameCount;
+    }
+
+    return true;
+}
+
+quint64 QCanRecordReader::getStartTime() const
+{
+    return m_Index.isEmpty() ? 0 : m_Index.first().minTime_us;
+}
+
+quint64 QCanRecordReader::getEndTime() const
+{
+    return m_Index.isEmpty() ? 0 : m_Index.last().maxTime_us;
+}
+
+void QCanRecordReader::setIdFilter(const QVector<quint32> & keys)
+{
+    ::memset(m_FilterBitmap, 0, sizeof(m_FilterBitmap));
+    m_FilterKeys.clear();
+
+    for (int i = 0; i < keys.size(); i++) {
+        quint32 bit = qcanRecordBitmapBit(keys[i]);
+
+        m_FilterBitmap[bit >> 3] |= 1 << (bit & 7);
+        m_FilterKeys.insert(keys[i], true);
+    }
+
+    m_HasFilter = true;
+
+    // Re-evaluate dictionary of the current chunk
+    if (m_ChunkHeader)
+        updateAccepted();
+}
+
+void QCanRecordReader::clearIdFilter()
+{
+    m_HasFilter = false;
+    m_FilterKeys.clear();
+
+    if (m_ChunkHeader)
+        updateAccepted();
+}
+
+void QCanRecordReader::setChannelFilter(const QString & name)
+{
+    m_ChannelFilter = name.toLatin1().left(QCAN_RECORD_CHANNEL_NAME_SIZE);
+
+    if (m_ChunkHeader)
+        updateAccepted();
+}
+
+const char *QCanRecordReader::entryChannel(int index) const
+{
+    if (!m_ChunkIdChannels || m_ChunkIdChannels[index] >= m_ChunkHeader->channelCount)
+        return NULL;
+
+    return m_ChunkChannelNames + m_ChunkIdChannels[index] * QCAN_RECORD_CHANNEL_NAME_SIZE;
+}
+
+QString QCanRecordReader::getChannelName() const
+{
+    const char *name;
+
+    if (!m_ChunkHeader || m_FrameEntry < 0 || !(name = entryChannel(m_FrameEntry)))
+        return QString();
+
+    return QString::fromLatin1(name, strnlen(name, QCAN_RECORD_CHANNEL_NAME_SIZE));
+}
+
+void QCanRecordReader::updateAccepted()
+{
+    m_ChunkIdAccepted.resize(m_ChunkHeader->idCount);
+
+    for (int i = 0; i < m_ChunkHeader->idCount; i++) {
+        const char *channel = m_ChannelFilter.isEmpty() ? NULL : entryChannel(i);
+
+        m_ChunkIdAccepted[i] = (!m_HasFilter || m_FilterKeys.contains(m_ChunkIds[i])) &&
+                (!channel || strncmp(channel, m_ChannelFilter.constData(), QCAN_RECORD_CHANNEL_NAME_SIZE) == 0);
+    }
+}
+
+bool QCanRecordReader::chunkMatchesFilter(const QCanRecordChunkHeader *header) const
+{
+    if (!m_HasFilter)
+        return true;
+
+    for (size_t i = 0; i < sizeof(m_FilterBitmap); i++) {
+        if (header->idBitmap[i] & m_FilterBitmap[i])
+            return true;
+    }
+
+    return false;
+}
+
+bool QCanRecordReader::enterChunk(int chunk)
+{
+    if (chunk < 0 || chunk >= m_Index.size())
+        return false;
+
+    const quint8 *base = m_Data + m_Index[chunk].offset;
+
+    m_Chunk = chunk;
+    m_ChunkHeader = reinterpret_cast<const QCanRecordChunkHeader *>(base);
+    m_ChunkIds = reinterpret_cast<const quint32 *>(base + sizeof(QCanRecordChunkHeader));
+    m_ChunkIdChannels = NULL;
+    m_ChunkChannelNames = NULL;
+
+    if (m_ChunkHeader->channelCount) {
+        m_ChunkIdChannels = reinterpret_cast<const quint16 *>(m_ChunkIds + m_ChunkHeader->idCount);
+        m_ChunkChannelNames = reinterpret_cast<const char *>(m_ChunkIdChannels + m_ChunkHeader->idCount);
+    }
+
+    m_Cursor = base + sizeof(QCanRecordChunkHeader) + qcanRecordDictionarySize(m_ChunkHeader);
+    m_ChunkEnd = m_Cursor + m_ChunkHeader->payloadSize;
+    m_ChunkFramesLeft = m_ChunkHeader->frameCount;
+    m_Time_us = m_ChunkHeader->baseTime_us;
+    m_FrameEntry = -1;
+
+    updateAccepted();
+
+    return true;
+}
+
+void QCanRecordReader::rewind()
+{
+    m_Chunk = -1;
+    m_ChunkHeader = NULL;
+    m_ChunkFramesLeft = 0;
+}
+
+bool QCanRecordReader::seek(quint64 time_us)
+{
+    int lower = 0;
+    int upper = m_Index.size();
+
+    // First chunk containing frames not older than time_us
+    while (lower < upper) {
+        int middle = (lower + upper) / 2;
+
+        if (m_Index[middle].maxTime_us < time_us)
+            lower = middle + 1;
+        else
+            upper = middle;
+    }
+
+    if (lower >= m_Index.size())
+        return false;
+
+    // Decode up to the frame in question
+    for (int chunk = lower; chunk < m_Index.size(); chunk++) {
+        enterChunk(chunk);
+
+        while (m_ChunkFramesLeft > 0) {
+            const quint8 *cursor = m_Cursor;
+            quint32 left = m_ChunkFramesLeft;
+            quint64 time = m_Time_us;
+            quint64 delta;
+
+            const quint8 *p = qcanRecordGetVarint(m_Cursor, m_ChunkEnd, delta);
+            if (!p)
+                break;
+
+            if (m_Time_us + qcanRecordUnZigZag(delta) >= time_us) {
+                m_Cursor = cursor;
+                m_ChunkFramesLeft = left;
+                m_Time_us = time;
+                return true;
+            }
+
+            // Skip frame
+            quint64 index;
+            m_Time_us += qcanRecordUnZigZag(delta);
+            p = qcanRecordGetVarint(p, m_ChunkEnd, index);
+            if (!p || p >= m_ChunkEnd)
+                break;
+
+            m_Cursor = p + 1 + *p;
+            m_ChunkFramesLeft--;
+        }
+    }
+
+    return false;
+}
+
+bool QCanRecordReader::next(QCanMessage & message)
+{
+    for (;;) {
+        while (m_ChunkFramesLeft == 0) {
+            int chunk = m_Chunk + 1;
+
+            // Skip chunks without any of the filtered identifiers
+            while (chunk < m_Index.size() &&
+                   !chunkMatchesFilter(reinterpret_cast<const QCanRecordChunkHeader *>(m_Data + m_Index[chunk].offset)))
+                chunk++;
+
+            if (!enterChunk(chunk))
+                return false;
+        }
+
+        quint64 delta, index;
+        const quint8 *p = qcanRecordGetVarint(m_Cursor, m_ChunkEnd, delta);
+
+        if (p)
+            p = qcanRecordGetVarint(p, m_ChunkEnd, index);
+
+        if (!p || p >= m_ChunkEnd || index >= m_ChunkHeader->idCount || p + 1 + *p > m_ChunkEnd) {
+            // Corrupt chunk, continue with the next one
+            m_ChunkFramesLeft = 0;
+            continue;
+        }
+
+        quint8 dlc = *p++;
+
+        m_Time_us += qcanRecordUnZigZag(delta);
+        m_Cursor = p + dlc;
+        m_ChunkFramesLeft--;
+
+        if (!m_ChunkIdAccepted[index])
+            continue;
+
+        quint32 key = m_ChunkIds[index];
+
+        m_FrameEntry = index;
+
+        message.isExt = (key & QCAN_RECORD_EXT_FLAG) != 0;
+        message.id = key & ~QCAN_RECORD_EXT_FLAG;
+        message.dlc = dlc > 8 ? 8 : dlc;
+        ::memset(&message.data[0], 0, 8);
+        ::memcpy(&message.data[0], p, message.dlc);
+        message.tv.tv_sec = m_Time_us / 1000000ULL;
+        message.tv.tv_usec = m_Time_us % 1000000ULL;
+
+        return true;
+    }
+}
@@ -0,0 +1,131 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANRECORDREADER_H_
+#define QCANRECORDREADER_H_
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QByteArray>
+
+#include "QCanRecordFormat.h"
+
+struct QCanMessage;
+
+/**
+ * Reads files written by QCanRecorder.
+ *
+ * The file is memory mapped, seeking to a time is a binary search over the
+ * chunk index. With an identifier filter set, chunks not containing any of
+ * the identifiers are skipped by their identifier bitmap without decoding.
+ * Frames of recordings with several channels can be filtered by channel.
+ */
+class QCanRecordReader
+{
+public:
+    QCanRecordReader();
+    ~QCanRecordReader();
+
+    bool open(const QString & filename);
+    void close();
+
+    bool isOpen() const { return m_Data != NULL; }
+
+    /// Check if a file starts with the recording file magic
+    static bool isRecording(const char *data, size_t size);
+
+    int getChunkCount() const { return m_Index.size(); }
+    quint64 getFrameCount() const { return m_FrameCount; }
+
+    /// Time of the first/last frame in microseconds
+    quint64 getStartTime() const;
+    quint64 getEndTime() const;
+
+    /**
+     * Only return frames with the given identifiers
+     * @param keys identifiers, see qcanRecordKey()
+     */
+    void setIdFilter(const QVector<quint32> & keys);
+    void clearIdFilter();
+
+    /**
+     * Only return frames recorded on the given interface, empty to return
+     * frames of all channels. Frames without channel are always returned.
+     */
+    void setChannelFilter(const QString & name);
+
+    /// Interface of the frame last returned by next(), empty if unknown
+    QString getChannelName() const;
+
+    /**
+     * Position the reader at the first frame not older than time_us
+     * @return false if there is no such frame
+     */
+    bool seek(quint64 time_us);
+
+    /// Move to the first frame of the recording
+    void rewind();
+
+    /**
+     * Read the next frame passing the identifier filter
+     * @return false at the end of the recording
+     */
+    bool next(QCanMessage & message);
+
+private:
+    bool loadIndex();
+    bool enterChunk(int chunk);
+    bool chunkMatchesFilter(const QCanRecordChunkHeader *header) const;
+    void updateAccepted();
+
+    /// Interface name of a dictionary entry of the current chunk, NULL if unknown
+    const char *entryChannel(int index) const;
+
+    const quint8 *m_Data;
+    size_t m_Size;
+
+    QVector<QCanRecordIndexEntry> m_Index;
+    quint64 m_FrameCount;
+
+    // Identifier filter
+    bool m_HasFilter;
+    quint8 m_FilterBitmap[QCAN_RECORD_BITMAP_BITS / 8];
+    QHash<quint32, bool> m_FilterKeys;
+
+    // Channel filter, empty for all channels
+    QByteArray m_ChannelFilter;
+
+    // Decoder state
+    int m_Chunk;
+    const QCanRecordChunkHeader *m_ChunkHeader;
+    const quint32 *m_ChunkIds;
+    const quint16 *m_ChunkIdChannels;
+    const char *m_ChunkChannelNames;
+    QVector<bool> m_ChunkIdAccepted;
+    int m_FrameEntry;
+    const quint8 *m_Cursor;
+    const quint8 *m_ChunkEnd;
+    quint32 m_ChunkFramesLeft;
+    quint64 m_Time_us;
+};
+
+#endif /* QCANRECORDREADER_H_ */
@@ -0,0 +1,419 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+
+#include <QThread>
+#include <QWaitCondition>
+
+#include "QCanRecorder.h"
+#include "QCanChannel.h"
+#include "QCanMergeChannel.h"
+#include "QCanPredicate.h"
+
+// Upper bound of an encoded frame: 2 varints, dlc and data
+#define MAX_ENCODED_FRAME_SIZE (10 + 10 + 1 + 8)
+
+/**
+ * Writes serialized chunks in submission order. Buffers are recycled, new
+ * ones are only allocated while the disk is slower than the bus.
+ */
+class QCanRecordWriter : public QThread
+{
+public:
+    QCanRecordWriter(QFile *file, int bufferSize);
+    ~QCanRecordWriter();
+
+    /// Write all submitted buffers and terminate
+    void Stop();
+
+    /// Get an empty buffer, called by the recording thread
+    QByteArray *takeBuffer();
+
+    /// Queue a buffer returned by takeBuffer() for writing
+    void submit(QByteArray *buffer);
+
+protected:
+    void run();
+
+private:
+    QFile *m_File;
+
+    QMutex m_Lock;
+    QWaitCondition m_Wakeup;
+    bool m_TerminationRequested;
+
+    QVector<QByteArray*> m_Queue;
+    QVector<QByteArray*> m_Free;
+};
+
+QCanRecordWriter::QCanRecordWriter(QFile *file, int bufferSize)
+ : m_File(file), m_TerminationRequested(false)
+{
+    // Double buffered: one chunk is written while the next one fills up
+    for (int i = 0; i < 2; i++) {
+        QByteArray *buffer = new QByteArray();
+
+        buffer->reserve(bufferSize);
+        m_Free.push_back(buffer);
+    }
+}
+
+QCanRecordWriter::~QCanRecordWriter()
+{
+    Stop();
+
+    qDeleteAll(m_Queue);
+    qDeleteAll(m_Free);
+}
+
+void QCanRecordWriter::Stop()
+{
+    m_Lock.lock();
+    m_TerminationRequested = true;
+    m_Wakeup.wakeAll();
+    m_Lock.unlock();
+
+    wait();
+}
+
+QByteArray *QCanRecordWriter::takeBuffer()
+{
+    QMutexLocker locker(&m_Lock);
+
+    if (m_Free.isEmpty())
+        return new QByteArray();
+
+    QByteArray *buffer = m_Free.last();
+
+    m_Free.pop_back();
+
+    return buffer;
+}
+
+void QCanRecordWriter::submit(QByteArray *buffer)
+{
+    QMutexLocker locker(&m_Lock);
+
+    m_Queue.push_back(buffer);
+    m_Wakeup.wakeOne();
+}
+
+void QCanRecordWriter::run()
+{
+    m_Lock.lock();
+
+    for (;;) {
+        if (m_Queue.isEmpty()) {
+            if (m_TerminationRequested)
+                break;
+
+            m_Wakeup.wait(&m_Lock);
+            continue;
+        }
+
+        QByteArray *buffer = m_Queue.first();
+
+        m_Queue.remove(0);
+
+        // Write without holding the lock, the recording thread keeps submitting
+        m_Lock.unlock();
+        m_File->write(buffer->constData(), buffer->size());
+        m_Lock.lock();
+
+        m_Free.push_back(buffer);
+    }
+
+    m_Lock.unlock();
+}
+
+QCanRecorder::QCanRecorder(QObject *parent)
+ : QObject(parent), m_File(NULL), m_Writer(NULL), m_FileSize(0), m_Filter(NULL), m_ChunkFrames(4096),
+   m_FrameCount(0), m_PayloadSize(0), m_LastTime_us(0)
+{
+    resetChunk();
+}
+
+QCanRecorder::~QCanRecorder()
+{
+    close();
+}
+
+bool QCanRecorder::open(const QString & filename, quint32 chunkFrames)
+{
+    QMutexLocker locker(&m_Lock);
+    QCanRecordFileHeader header;
+
+    if (m_File)
+        return false;
+
+    m_File = new QFile(filename);
+
+    if (!m_File->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        delete m_File;
+        m_File = NULL;
+        return false;
+    }
+
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, QCAN_RECORD_FILE_MAGIC, sizeof(QCAN_RECORD_FILE_MAGIC));
+    header.version = QCAN_RECORD_VERSION;
+
+    m_File->write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_FileSize = sizeof(header);
+
+    m_ChunkFrames = chunkFrames ? chunkFrames : 4096;
+    m_FrameCount = 0;
+    m_Index.clear();
+
+    // Payload never grows while recording
+    m_Payload.resize(m_ChunkFrames * MAX_ENCODED_FRAME_SIZE);
+    resetChunk();
+
+    m_Writer = new QCanRecordWriter(m_File, sizeof(QCanRecordChunkHeader) + m_Payload.size());
+    m_Writer->start();
+
+    return true;
+}
+
+void QCanRecorder::close()
+{
+    QMutexLocker locker(&m_Lock);
+    QCanRecordTrailer trailer;
+
+    if (!m_File)
+        return;
+
+    flushChunk();
+
+    // Wait for all chunks to be written
+    delete m_Writer;
+    m_Writer = NULL;
+
+    trailer.indexOffset = m_FileSize;
+    trailer.chunkCount = m_Index.size();
+    trailer.magic = QCAN_RECORD_INDEX_MAGIC;
+
+    m_File->write(reinterpret_cast<const char *>(m_Index.constData()),
+                  m_Index.size() * sizeof(QCanRecordIndexEntry));
+    m_File->write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+
+    m_File->close();
+    delete m_File;
+    m_File = NULL;
+}
+
+void QCanRecorder::attach(QCanChannel *channel)
+{
+    QCanMergeChannel *merge = qobject_cast<QCanMergeChannel*>(channel);
+
+    if (m_Connections.contains(channel))
+        return;
+
+    // The channel is bound to the connection, signals of the filter are only
+    // decoded from frames of their own bus
+    if (merge) {
+        QVector<int> indexes;
+
+        for (int i = 0; i < merge->getInputCount(); i++)
+            indexes.push_back(addChannel(merge->getInput(i)->getName()));
+
+        m_Connections.insert(channel, QObject::connect(merge, &QCanMergeChannel::canMessageMerged, this,
+                                                       [this, merge, indexes](int input, const QCanMessage & frame) {
+            filterMessage(merge->getInput(input), indexes[input], frame);
+        }, Qt::DirectConnection));
+    } else {
+        const int index = addChannel(channel->getName());
+
+        m_Connections.insert(channel, QObject::connect(channel, &QCanChannel::canMessageReceived, this,
+                                                       [this, channel, index](const QCanMessage & frame) {
+            filterMessage(channel, index, frame);
+        }, Qt::DirectConnection));
+    }
+}
+
+void QCanRecorder::detach(QCanChannel *channel)
+{
+    QObject::disconnect(m_Connections.take(channel));
+}
+
+void QCanRecorder::canMessageReceived(const QCanMessage & frame)
+{
+    filterMessage(NULL, -1, frame);
+}
+
+void QCanRecorder::filterMessage(const QCanChannel *channel, int index, const QCanMessage & frame)
+{
+    if (m_Filter && !m_Filter->evaluate(frame, channel))
+        return;
+
+    writeMessage(frame, index);
+}
+
+int QCanRecorder::addChannel(const QString & name)
+{
+    QMutexLocker locker(&m_Lock);
+    QByteArray entry = name.toLatin1().left(QCAN_RECORD_CHANNEL_NAME_SIZE);
+    int i;
+
+    if (entry.isEmpty())
+        return -1;
+
+    entry.append(QByteArray(QCAN_RECORD_CHANNEL_NAME_SIZE - entry.size(), '\0'));
+
+    for (i = 0; i < m_ChannelNames.size(); i += QCAN_RECORD_CHANNEL_NAME_SIZE) {
+        if (::memcmp(m_ChannelNames.constData() + i, entry.constData(), QCAN_RECORD_CHANNEL_NAME_SIZE) == 0)
+            return i / QCAN_RECORD_CHANNEL_NAME_SIZE;
+    }
+
+    if (i / QCAN_RECORD_CHANNEL_NAME_SIZE >= (int)QCAN_RECORD_NO_CHANNEL)
+        return -1;
+
+    m_ChannelNames.append(entry);
+
+    return i / QCAN_RECORD_CHANNEL_NAME_SIZE;
+}
+
+void QCanRecorder::resetChunk()
+{
+    ::memset(&m_Chunk, 0, sizeof(m_Chunk));
+    m_Chunk.magic = QCAN_RECORD_CHUNK_MAGIC;
+
+    m_PayloadSize = 0;
+    m_Ids.clear();
+    m_IdChannels.clear();
+    m_IdIndex.clear();
+}
+
+void QCanRecorder::writeMessage(const QCanMessage & frame, int channel)
+{
+    QMutexLocker locker(&m_Lock);
+
+    if (!m_File)
+        return;
+
+    quint64 time_us = frame.tv.tv_sec * 1000000ULL + frame.tv.tv_usec;
+    quint32 key = qcanRecordKey(frame.id, frame.isExt);
+    quint16 channelIndex = channel < 0 ? QCAN_RECORD_NO_CHANNEL : channel;
+    quint64 entry = ((quint64)channelIndex << 32) | key;
+    quint16 index;
+
+    QHash<quint64, quint16>::const_iterator found = m_IdIndex.constFind(entry);
+
+    if (found == m_IdIndex.constEnd()) {
+        // Dictionary is full
+        if (m_Ids.size() == 0xffff) {
+            flushChunk();
+            resetChunk();
+        }
+
+        index = m_Ids.size();
+        m_Ids.push_back(key);
+        m_IdChannels.push_back(channelIndex);
+        m_IdIndex.insert(entry, index);
+
+        quint32 bit = qcanRecordBitmapBit(key);
+        m_Chunk.idBitmap[bit >> 3] |= 1 << (bit & 7);
+    } else {
+        index = *found;
+    }
+
+    if (m_Chunk.frameCount == 0) {
+        m_Chunk.baseTime_us = time_us;
+        m_Chunk.minTime_us = time_us;
+        m_Chunk.maxTime_us = time_us;
+        m_LastTime_us = time_us;
+    }
+
+    if (time_us < m_Chunk.minTime_us)
+        m_Chunk.minTime_us = time_us;
+
+    if (time_us > m_Chunk.maxTime_us)
+        m_Chunk.maxTime_us = time_us;
+
+    // Frames of several channels may arrive slightly out of order
+    quint8 *start = reinterpret_cast<quint8 *>(m_Payload.data()) + m_PayloadSize;
+    quint8 *p = start;
+    quint8 dlc = frame.dlc > 8 ? 8 : frame.dlc;
+
+    p = qcanRecordPutVarint(p, qcanRecordZigZag((qint64)(time_us - m_LastTime_us)));
+    p = qcanRecordPutVarint(p, index);
+    *p++ = dlc;
+    ::memcpy(p, &frame.data[0], dlc);
+    p += dlc;
+
+    m_PayloadSize += p - start;
+    m_LastTime_us = time_us;
+
+    m_Chunk.frameCount++;
+    m_FrameCount++;
+
+    if (m_Chunk.frameCount >= m_ChunkFrames) {
+        flushChunk();
+        resetChunk();
+    }
+}
+
+void QCanRecorder::flushChunk()
+{
+    QCanRecordIndexEntry entry;
+
+    if (m_Chunk.frameCount == 0)
+        return;
+
+    m_Chunk.payloadSize = m_PayloadSize;
+    m_Chunk.idCount = m_Ids.size();
+    m_Chunk.channelCount = m_ChannelNames.size() / QCAN_RECORD_CHANNEL_NAME_SIZE;
+
+    const int dictionarySize = qcanRecordDictionarySize(&m_Chunk);
+    const int size = sizeof(m_Chunk) + dictionarySize + m_PayloadSize;
+
+    entry.offset = m_FileSize;
+    entry.minTime_us = m_Chunk.minTime_us;
+    entry.maxTime_us = m_Chunk.maxTime_us;
+    entry.frameCount = m_Chunk.frameCount;
+    entry.reserved = 0;
+
+    // Serialize the chunk, the file is written by the writer thread
+    QByteArray *buffer = m_Writer->takeBuffer();
+
+    buffer->resize(size);
+
+    char *p = buffer->data();
+
+    ::memcpy(p, &m_Chunk, sizeof(m_Chunk));
+    p += sizeof(m_Chunk);
+    ::memcpy(p, m_Ids.constData(), m_Ids.size() * sizeof(quint32));
+    p += m_Ids.size() * sizeof(quint32);
+
+    if (m_Chunk.channelCount) {
+        ::memcpy(p, m_IdChannels.constData(), m_IdChannels.size() * sizeof(quint16));
+        p += m_IdChannels.size() * sizeof(quint16);
+        ::memcpy(p, m_ChannelNames.constData(), m_Chunk.channelCount * QCAN_RECORD_CHANNEL_NAME_SIZE);
+        p += m_Chunk.channelCount * QCAN_RECORD_CHANNEL_NAME_SIZE;
+    }
+
+    ::memcpy(p, m_Payload.constData(), m_PayloadSize);
+
+    m_Writer->submit(buffer);
+
+    m_FileSize += size;
+    m_Index.push_back(entry);
+}
@@ -0,0 +1,138 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANRECORDER_H_
+#define QCANRECORDER_H_
+
+#include <QObject>
+#include <QFile>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+
+#include "QCanRecordFormat.h"
+
+class QCanChannel;
+class QCanPredicate;
+class QCanRecordWriter;
+struct QCanMessage;
+
+/**
+ * Records CAN traffic into a compact, indexed binary file (see
+ * QCanRecordFormat.h) which can be read by QCanRecordReader.
+ *
+ * Frames are collected into chunks in memory. Attached channels are recorded
+ * on their receive thread, full chunks are handed to a writer thread so the
+ * receive thread never waits for the disk.
+ */
+class QCanRecorder : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void canMessageReceived(const QCanMessage & frame);
+
+public:
+    QCanRecorder(QObject *parent = NULL);
+    ~QCanRecorder();
+
+    /**
+     * Create recording file
+     * @param filename path of the file, an existing file is replaced
+     * @param chunkFrames number of frames per chunk
+     */
+    bool open(const QString & filename, quint32 chunkFrames = 4096);
+
+    /// Write pending frames and the index, closes the file
+    void close();
+
+    bool isOpen() const { return m_File != NULL; }
+
+    /**
+     * Record all frames received by channel, tagged with its interface name.
+     * Frames of a QCanMergeChannel are filtered and tagged with the input
+     * channel they were received on. Merge inputs must be added before.
+     */
+    void attach(QCanChannel *channel);
+    void detach(QCanChannel *channel);
+
+    /**
+     * Only record frames received from attached channels which match the
+     * predicate, NULL records everything. The predicate is not owned.
+     */
+    void setFilter(const QCanPredicate *filter) { m_Filter = filter; }
+
+    /**
+     * Register an interface name frames can be tagged with
+     * @return channel for writeMessage(), -1 for an empty name
+     */
+    int addChannel(const QString & name);
+
+    /**
+     * Add a frame to the recording, may be called from any thread
+     * @param channel channel returned by addChannel(), -1 if unknown
+     */
+    void writeMessage(const QCanMessage & frame, int channel = -1);
+
+    quint64 getFrameCount() const { return m_FrameCount; }
+
+private:
+    /// Apply the filter to a frame received on channel and record it
+    void filterMessage(const QCanChannel *channel, int index, const QCanMessage & frame);
+
+    void flushChunk();
+    void resetChunk();
+
+    QMutex m_Lock;
+    QFile *m_File;
+    QCanRecordWriter *m_Writer;
+
+    // Size of the file once all submitted chunks are written
+    quint64 m_FileSize;
+
+    const QCanPredicate *m_Filter;
+
+    // Receive connections of attached channels
+    QHash<QCanChannel*, QMetaObject::Connection> m_Connections;
+
+    quint32 m_ChunkFrames;
+    quint64 m_FrameCount;
+
+    // Current chunk
+    QCanRecordChunkHeader m_Chunk;
+    QByteArray m_Payload;
+    int m_PayloadSize;
+    quint64 m_LastTime_us;
+
+    QVector<quint32> m_Ids;
+    QVector<quint16> m_IdChannels;
+
+    // Dictionary index by channel (upper 32 bits) and identifier key
+    QHash<quint64, quint16> m_IdIndex;
+
+    // Registered interface names, QCAN_RECORD_CHANNEL_NAME_SIZE bytes each
+    QByteArray m_ChannelNames;
+
+    QVector<QCanRecordIndexEntry> m_Index;
+};
+
+#endif /* QCANRECORDER_H_ */
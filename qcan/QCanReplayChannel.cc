@@ -0,0 +1,441 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "QCanReplayChannel.h"
+#include "QCanRecordReader.h"
+
+static inline int _hexdigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+static inline const char *_skipspace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+
+    return p;
+}
+
+/// Parse a number with given base, returns number of parsed digits
+static inline int _parsenumber(const char *& p, const char *end, int base, quint64 & value)
+{
+    int digits = 0;
+
+    value = 0;
+
+    while (p < end) {
+        int d = _hexdigit(*p);
+
+        if (d < 0 || d >= base)
+            break;
+
+        value = value * base + d;
+        digits++;
+        p++;
+    }
+
+    return digits;
+}
+
+/// Parse "seconds.fraction" into microseconds
+static inline bool _parsetime(const char *& p, const char *end, quint64 & time_us)
+{
+    quint64 sec, frac;
+    int digits;
+
+    if (!_parsenumber(p, end, 10, sec))
+        return false;
+
+    time_us = sec * 1000000ULL;
+
+    if (p < end && *p == '.') {
+        p++;
+        digits = _parsenumber(p, end, 10, frac);
+
+        for (; digits < 6; digits++)
+            frac *= 10;
+        for (; digits > 6; digits--)
+            frac /= 10;
+
+        time_us += frac;
+    }
+
+    return true;
+}
+
+static inline bool _matchword(const char *p, const char *end, const char *word)
+{
+    size_t len = strlen(word);
+
+    return (size_t)(end - p) >= len && strncmp(p, word, len) == 0;
+}
+
+static quint64 _now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (quint64)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+QCanReplayChannel::QCanReplayChannel(const QString & filename, const QString & interface, double speed)
+ : m_Data(NULL), m_Size(0), m_Format(E_LOG_FORMAT_UNKNOWN), m_Interface(interface.toLatin1()),
+   m_Recording(NULL), m_Speed(speed), m_RebaseTimestamps(false),
+   m_AscHexIds(true), m_AscRelativeTimestamps(false), m_AscLastTimestamp_us(0),
+   m_ReplayedFrames(0)
+{
+    int fd = open(filename.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    // Recorders attached to the replay tag frames with the replayed interface
+    setName(interface);
+
+    if (fd < 0)
+        return;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+            m_Data = static_cast<const char *>(p);
+            m_Size = st.st_size;
+        }
+    }
+
+    close(fd);
+
+    if (!m_Data)
+        return;
+
+    if (QCanRecordReader::isRecording(m_Data, m_Size)) {
+        m_Recording = new QCanRecordReader();
+
+        if (m_Recording->open(filename))
+            m_Format = E_LOG_FORMAT_RECORDING;
+
+        if (!interface.isEmpty())
+            m_Recording->setChannelFilter(interface);
+
+        return;
+    }
+
+    // Detect format by the first non empty line
+    const char *p = _skipspace(m_Data, m_Data + m_Size);
+    while (p < m_Data + m_Size && *p == '\n')
+        p = _skipspace(p + 1, m_Data + m_Size);
+
+    if (p < m_Data + m_Size) {
+        if (*p == '(')
+            m_Format = E_LOG_FORMAT_CANDUMP;
+        else if (_matchword(p, m_Data + m_Size, "date") || _matchword(p, m_Data + m_Size, "base") ||
+                 (*p >= '0' && *p <= '9'))
+            m_Format = E_LOG_FORMAT_ASC;
+    }
+}
+
+QCanReplayChannel::~QCanReplayChannel()
+{
+    Stop();
+
+    delete m_Recording;
+
+    if (m_Data)
+        munmap(const_cast<char *>(m_Data), m_Size);
+}
+
+void QCanReplayChannel::Stop()
+{
+    m_TerminationRequested = true;
+
+    wait();
+}
+
+bool QCanReplayChannel::Send(const QCanMessage & message)
+{
+    Q_UNUSED(message);
+
+    return false;
+}
+
+/*
+ * (1436509052.249713) vcan0 044#2A366C2BBA
+ * (1436509052.249713) vcan0 12345678#R
+ */
+bool QCanReplayChannel::parseCandumpLine(const char *p, const char *end, QCanMessage & message)
+{
+    quint64 time_us, id, byte;
+    int digits;
+
+    p = _skipspace(p, end);
+    if (p >= end || *p++ != '(')
+        return false;
+
+    if (!_parsetime(p, end, time_us) || p >= end || *p++ != ')')
+        return false;
+
+    // Interface name
+    p = _skipspace(p, end);
+    const char *name = p;
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+
+    if (!m_Interface.isEmpty() &&
+        ((size_t)(p - name) != (size_t)m_Interface.size() || ::memcmp(name, m_Interface.constData(), p - name) != 0))
+        return false;
+
+    p = _skipspace(p, end);
+    digits = _parsenumber(p, end, 16, id);
+
+    if ((digits != 3 && digits != 8) || p >= end || *p++ != '#')
+        return false;
+
+    // CAN FD frames and remote requests are not supported
+    if (p < end && (*p == '#' || *p == 'R'))
+        return false;
+
+    // Error frames
+    if (digits == 8 && (id & CAN_ERR_FLAG))
+        return false;
+
+    message.isExt = digits == 8;
+    message.id = id & (message.isExt ? CAN_EFF_MASK : CAN_SFF_MASK);
+    message.dlc = 0;
+    ::memset(&message.data[0], 0, 8);
+
+    while (message.dlc < 8 && end - p >= 2) {
+        const char *b = p;
+
+        if (_parsenumber(b, p + 2, 16, byte) != 2)
+            break;
+
+        message.data[message.dlc++] = byte;
+        p += 2;
+
+        // candump -L/-l may separate bytes by '.'
+        if (p < end && *p == '.')
+            p++;
+    }
+
+    message.tv.tv_sec = time_us / 1000000ULL;
+    message.tv.tv_usec = time_us % 1000000ULL;
+
+    return true;
+}
+
+/*
+ * date Mon Jul 10 12:00:00.000 pm 2015
+ * base hex  timestamps absolute
+ *    0.010000 1  0B2             Rx   d 8 00 01 02 03 04 05 06 07
+ *    0.010200 2  18FEF100x       Rx   d 8 00 01 02 03 04 05 06 07
+ */
+bool QCanReplayChannel::parseAscLine(const char *p, const char *end, QCanMessage & message)
+{
+    quint64 time_us, channel, id, dlc, byte;
+
+    p = _skipspace(p, end);
+
+    if (_matchword(p, end, "base")) {
+        m_AscHexIds = !_matchword(_skipspace(p + 4, end), end, "dec");
+
+        for (const char *q = p; q < end; q++) {
+            if (_matchword(q, end, "relative"))
+                m_AscRelativeTimestamps = true;
+        }
+
+        return false;
+    }
+
+    if (!_parsetime(p, end, time_us))
+        return false;
+
+    if (m_AscRelativeTimestamps) {
+        time_us += m_AscLastTimestamp_us;
+        m_AscLastTimestamp_us = time_us;
+    }
+
+    p = _skipspace(p, end);
+    const char *name = p;
+    if (!_parsenumber(p, end, 10, channel))
+        return false;
+
+    if (!m_Interface.isEmpty() &&
+        ((size_t)(p - name) != (size_t)m_Interface.size() || ::memcmp(name, m_Interface.constData(), p - name) != 0))
+        return false;
+
+    p = _skipspace(p, end);
+    if (!_parsenumber(p, end, m_AscHexIds ? 16 : 10, id))
+        return false;
+
+    message.isExt = p < end && *p == 'x';
+    if (message.isExt)
+        p++;
+
+    // Direction
+    p = _skipspace(p, end);
+    if (!_matchword(p, end, "Rx") && !_matchword(p, end, "Tx"))
+        return false;
+
+    p = _skipspace(p + 2, end);
+    if (p >= end || *p++ != 'd')
+        return false;
+
+    p = _skipspace(p, end);
+    if (!_parsenumber(p, end, 16, dlc) || dlc > 8)
+        return false;
+
+    message.id = id & (message.isExt ? CAN_EFF_MASK : CAN_SFF_MASK);
+    message.dlc = dlc;
+    ::memset(&message.data[0], 0, 8);
+
+    for (quint64 i = 0; i < dlc; i++) {
+        p = _skipspace(p, end);
+
+        if (_parsenumber(p, end, 16, byte) == 0)
+            return false;
+
+        message.data[i] = byte;
+    }
+
+    message.tv.tv_sec = time_us / 1000000ULL;
+    message.tv.tv_usec = time_us % 1000000ULL;
+
+    return true;
+}
+
+bool QCanReplayChannel::readMessage(const char *& p, const char *end, QCanMessage & message)
+{
+    if (m_Format == E_LOG_FORMAT_RECORDING)
+        return m_Recording->next(message);
+
+    while (p < end) {
+        const char *eol = static_cast<const char *>(::memchr(p, '\n', end - p));
+        bool valid;
+
+        if (!eol)
+            eol = end;
+
+        if (m_Format == E_LOG_FORMAT_CANDUMP)
+            valid = parseCandumpLine(p, eol, message);
+        else
+            valid = parseAscLine(p, eol, message);
+
+        p = eol + 1;
+
+        if (valid)
+            return true;
+    }
+
+    return false;
+}
+
+void QCanReplayChannel::run()
+{
+    const char *p = m_Data;
+    const char *end = m_Data + m_Size;
+
+    quint64 first_us = 0;
+    quint64 start_us = 0;
+    quint64 wallclock_us = 0;
+    bool first = true;
+
+    m_AscHexIds = true;
+    m_AscRelativeTimestamps = false;
+    m_AscLastTimestamp_us = 0;
+    m_ReplayedFrames.store(0);
+
+    if (m_Recording)
+        m_Recording->rewind();
+
+    QCanMessage message;
+
+    while (!m_TerminationRequested && readMessage(p, end, message)) {
+        quint64 time_us = message.tv.tv_sec * 1000000ULL + message.tv.tv_usec;
+
+        if (first) {
+            struct timeval tv;
+
+            gettimeofday(&tv, NULL);
+
+            first_us = time_us;
+            start_us = _now_us();
+            wallclock_us = tv.tv_sec * 1000000ULL + tv.tv_usec;
+            first = false;
+        }
+
+        quint64 offset_us = time_us > first_us ? time_us - first_us : 0;
+
+        if (m_Speed > 0.0) {
+            quint64 due_us = start_us + static_cast<quint64>(offset_us / m_Speed);
+
+            // Sleep in small steps to stay responsive to Stop()
+            for (;;) {
+                quint64 now_us = _now_us();
+
+                if (now_us >= due_us || m_TerminationRequested)
+                    break;
+
+                quint64 wait_us = due_us - now_us;
+                if (wait_us > 10000)
+                    wait_us = 10000;
+
+                struct timespec ts;
+                ts.tv_sec = 0;
+                ts.tv_nsec = wait_us * 1000;
+
+                while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+                    ;
+            }
+        }
+
+        if (m_RebaseTimestamps) {
+            quint64 replay_us = wallclock_us + (_now_us() - start_us);
+
+            message.tv.tv_sec = replay_us / 1000000ULL;
+            message.tv.tv_usec = replay_us % 1000000ULL;
+        }
+
+        canMessageReceived(message);
+        m_ReplayedFrames++;
+    }
+
+    if (!m_TerminationRequested)
+        replayFinished();
+}
@@ -0,0 +1,115 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANREPLAYCHANNEL_H_
+#define QCANREPLAYCHANNEL_H_
+
+#include <QString>
+#include <QByteArray>
+#include <QAtomicInteger>
+
+#include "QCanChannel.h"
+
+class QCanRecordReader;
+
+/**
+ * Channel replaying a recorded log file instead of a SocketCAN interface.
+ *
+ * Supports candump log files (candump -l), Vector ASC files and recordings
+ * written by QCanRecorder. The file is memory mapped and parsed while
+ * replaying. Frames are emitted with
+ * their recorded timestamps, either in real time, scaled by a speed factor
+ * or as fast as possible. Frames sent to the channel are dropped.
+ */
+class QCanReplayChannel : public QCanChannel
+{
+    Q_OBJECT
+
+signals:
+    /// All frames of the log file were replayed
+    void replayFinished();
+
+public:
+    typedef enum E_LOG_FORMAT {
+        E_LOG_FORMAT_UNKNOWN = 0,
+        E_LOG_FORMAT_CANDUMP,
+        E_LOG_FORMAT_ASC,
+        E_LOG_FORMAT_RECORDING
+    } log_format_t;
+
+    /**
+     * @param filename path of the log file
+     * @param interface only replay frames of this interface (candump,
+     *        recordings) or channel number (ASC), empty to replay all frames
+     * @param speed replay speed, 1.0 is real time, 0 replays unthrottled
+     */
+    QCanReplayChannel(const QString & filename, const QString & interface = QString(), double speed = 1.0);
+    virtual ~QCanReplayChannel();
+
+    virtual bool IsValid() { return m_Data != NULL && m_Format != E_LOG_FORMAT_UNKNOWN; }
+    virtual void Stop();
+
+    /// Frames can't be sent to a log file, they are dropped
+    virtual bool Send(const QCanMessage & message);
+
+    /// Change replay speed, must be called before Start()
+    void setSpeed(double speed) { m_Speed = speed; }
+    double getSpeed() const { return m_Speed; }
+
+    /**
+     * Replace recorded timestamps by the time the frame is replayed,
+     * useful for consumers showing wall clock time (e.g. QRealtimePlotter)
+     */
+    void setRebaseTimestamps(bool rebase) { m_RebaseTimestamps = rebase; }
+
+    log_format_t getFormat() const { return m_Format; }
+
+    /// Number of frames emitted so far
+    quint64 getReplayedFrames() const { return m_ReplayedFrames.load(); }
+
+protected:
+    void run();
+
+private:
+    bool readMessage(const char *& p, const char *end, QCanMessage & message);
+    bool parseCandumpLine(const char *line, const char *end, QCanMessage & message);
+    bool parseAscLine(const char *line, const char *end, QCanMessage & message);
+
+    const char *m_Data;
+    size_t m_Size;
+
+    log_format_t m_Format;
+    QByteArray m_Interface;
+
+    QCanRecordReader *m_Recording;
+
+    double m_Speed;
+    bool m_RebaseTimestamps;
+
+    // ASC settings
+    bool m_AscHexIds;
+    bool m_AscRelativeTimestamps;
+    quint64 m_AscLastTimestamp_us;
+
+    QAtomicInteger<quint64> m_ReplayedFrames;
+};
+
+#endif /* QCANREPLAYCHANNEL_H_ */
@@ -0,0 +1,95 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSEQLOCK_H_
+#define QCANSEQLOCK_H_
+
+#include <QAtomicInt>
+
+#include <atomic>
+
+/**
+ * Sequence lock protecting a small block of data written by the CAN receive
+ * thread and read by any number of other threads.
+ *
+ * Readers never block writers, they retry if a write happened while they
+ * copied the data. Writers are serialized by spinning on an odd sequence.
+ */
+class QCanSeqLock
+{
+public:
+    QCanSeqLock() : m_Sequence(0) {}
+
+    /// Enter write section, spins while another writer is active
+    void beginWrite() {
+        for (;;) {
+            int s = m_Sequence.loadAcquire();
+
+            if (!(s & 1) && m_Sequence.testAndSetAcquire(s, s + 1))
+                return;
+        }
+    }
+
+    /// Leave write section, publishes data written since beginWrite()
+    void endWrite() { m_Sequence.fetchAndAddRelease(1); }
+
+    /**
+     * Start reading the protected data
+     * @return sequence to be passed to retryRead()
+     */
+    int beginRead() const {
+        int s;
+
+        while ((s = m_Sequence.loadAcquire()) & 1)
+            ;
+
+        return s;
+    }
+
+    /**
+     * Non-blocking variant of beginRead() for writers in other processes,
+     * which may terminate inside a write section
+     * @return false while a write is in progress
+     */
+    bool tryBeginRead(int & sequence) const {
+        sequence = m_Sequence.loadAcquire();
+
+        return !(sequence & 1);
+    }
+
+    /**
+     * @param sequence value returned by beginRead()
+     * @return true if data was modified while reading and must be read again
+     */
+    bool retryRead(int sequence) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return m_Sequence.loadAcquire() != sequence;
+    }
+
+    /// Number of completed write sections
+    quint32 getWriteCount() const { return static_cast<quint32>(m_Sequence.loadAcquire()) >> 1; }
+
+private:
+    QAtomicInt m_Sequence;
+};
+
+#endif /* QCANSEQLOCK_H_ */
@@ -0,0 +1,106 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSHAREDFORMAT_H_
+#define QCANSHAREDFORMAT_H_
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+
+#include "QCanSeqLock.h"
+
+/*
+ * Layout of the shared memory segment published by QCanSharedSignals:
+ *
+ *   QCanSharedHeader
+ *   QCanSharedSignalEntry[signalCount]   one cache line per signal
+ *   char names[]                         "<bus>.<message>.<signal>\0" ...
+ *
+ * The layout is fixed once the segment is created. Signals are ordered by
+ * bus, message and signal as given by the signal database, layoutHash is
+ * calculated over the name table so readers can detect a different
+ * database.
+ *
+ * The dynamic part of an entry is protected by its seqlock. An entry
+ * increments its changeCount when its raw value changes, the header
+ * changeSequence is incremented after all entries of a frame were written.
+ * Readers only have to scan entries if changeSequence moved.
+ */
+
+#define QCAN_SHARED_MAGIC    "QCANSHM"
+#define QCAN_SHARED_VERSION  1
+
+struct QCanSharedHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 signalCount;
+    quint32 layoutHash;
+    quint32 writerPid;
+
+    /// Size of the segment and offset of the name table in bytes
+    quint64 size;
+    quint64 namesOffset;
+
+    QAtomicInteger<quint64> changeSequence;
+
+    quint8 reserved[16];
+};
+
+struct QCanSharedSignalEntry
+{
+    QCanSeqLock lock;
+
+    /// Offset of the name in the name table
+    quint32 nameOffset;
+
+    // Protected by lock
+    quint64 changeCount;
+    quint64 rawValue;
+    double physicalValue;
+    quint64 timestamp_us;
+
+    // Static signal description
+    double lower;
+    double upper;
+    quint32 messageKey;
+    quint32 reserved;
+};
+
+Q_STATIC_ASSERT(sizeof(QCanSharedHeader) == 64);
+Q_STATIC_ASSERT(sizeof(QCanSharedSignalEntry) == 64);
+
+/**
+ * FNV-1a hash of the name table
+ */
+static inline quint32 qcanSharedLayoutHash(const char *names, size_t size)
+{
+    quint32 hash = 2166136261U;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (quint8)names[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+#endif /* QCANSHAREDFORMAT_H_ */
@@ -0,0 +1,226 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+
+#include "QCanSharedSignals.h"
+#include "QCanChannel.h"
+
+// True if a segment exists and the process which published it is alive
+static bool _isSegmentInUse(const char *path)
+{
+    struct stat st;
+    bool inUse = false;
+    int fd = shm_open(path, O_RDONLY, 0);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(QCanSharedHeader)) {
+        void *memory = mmap(NULL, sizeof(QCanSharedHeader), PROT_READ, MAP_SHARED, fd, 0);
+
+        if (memory != MAP_FAILED) {
+            const QCanSharedHeader *header = static_cast<const QCanSharedHeader *>(memory);
+
+            inUse = ::memcmp(header->magic, QCAN_SHARED_MAGIC, sizeof(QCAN_SHARED_MAGIC)) == 0 &&
+                    (kill(header->writerPid, 0) == 0 || errno == EPERM);
+
+            munmap(memory, sizeof(QCanSharedHeader));
+        }
+    }
+
+    close(fd);
+
+    return inUse;
+}
+
+QCanSharedSignals::QCanSharedSignals(const QString & name, QObject *parent)
+ : QObject(parent), m_Name(name), m_Fd(-1), m_Memory(NULL), m_Size(0), m_SignalCount(0),
+   m_Header(NULL), m_Entries(NULL)
+{
+}
+
+QCanSharedSignals::~QCanSharedSignals()
+{
+    destroy();
+}
+
+void QCanSharedSignals::addBus(const QString & bus, QCanSignals *canSignals)
+{
+    m_Busses.push_back(qMakePair(bus, canSignals));
+}
+
+bool QCanSharedSignals::create()
+{
+    if (m_Memory)
+        return false;
+
+    QByteArray names;
+    QVector<quint32> nameOffsets;
+
+    m_FirstEntry.clear();
+
+    for (int b = 0; b < m_Busses.size(); b++) {
+        QCanSignalContainer *sc;
+
+        foreach(sc, m_Busses[b].second->getMessageList()) {
+            QCanSignal *s;
+
+            m_FirstEntry.insert(sc, nameOffsets.size());
+
+            foreach(s, sc->getSignalList()) {
+                QString fullName = QString("%1.%2.%3").arg(m_Busses[b].first).arg(sc->getName()).arg(s->getName());
+
+                nameOffsets.push_back(names.size());
+                names.append(fullName.toUtf8());
+                names.append('\0');
+            }
+        }
+    }
+
+    m_SignalCount = nameOffsets.size();
+
+    const size_t namesOffset = sizeof(QCanSharedHeader) + m_SignalCount * sizeof(QCanSharedSignalEntry);
+    const QByteArray path = QString("/%1").arg(m_Name).toUtf8();
+
+    m_Size = namesOffset + names.size();
+
+    // Never take over the segment of a running publisher, a stale segment
+    // left by a terminated one is replaced
+    if (_isSegmentInUse(path.constData()))
+        return false;
+
+    shm_unlink(path.constData());
+
+    m_Fd = shm_open(path.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    if (m_Fd < 0)
+        return false;
+
+    if (ftruncate(m_Fd, m_Size) < 0 ||
+        (m_Memory = mmap(NULL, m_Size, PROT_READ | PROT_WRITE, MAP_SHARED, m_Fd, 0)) == MAP_FAILED) {
+        m_Memory = NULL;
+        destroy();
+        return false;
+    }
+
+    m_Header = static_cast<QCanSharedHeader *>(m_Memory);
+    m_Entries = reinterpret_cast<QCanSharedSignalEntry *>(m_Header + 1);
+
+    ::memcpy(static_cast<char *>(m_Memory) + namesOffset, names.constData(), names.size());
+
+    m_Header->version = QCAN_SHARED_VERSION;
+    m_Header->signalCount = m_SignalCount;
+    m_Header->layoutHash = qcanSharedLayoutHash(names.constData(), names.size());
+    m_Header->writerPid = getpid();
+    m_Header->size = m_Size;
+    m_Header->namesOffset = namesOffset;
+
+    QHash<QCanSignalContainer*, int>::const_iterator iter;
+
+    for (iter = m_FirstEntry.constBegin(); iter != m_FirstEntry.constEnd(); ++iter) {
+        QCanSignalContainer *sc = iter.key();
+        const quint32 key = sc->isExt() ? (sc->getCanId() | 0x80000000U) : sc->getCanId();
+
+        for (int i = 0; i < sc->getSignalList().size(); i++) {
+            QCanSignal *s = sc->getSignalList()[i];
+            QCanSharedSignalEntry & e = m_Entries[iter.value() + i];
+
+            e.nameOffset = nameOffsets[iter.value() + i];
+            e.messageKey = key;
+            e.rawValue = s->getRawValue();
+            e.physicalValue = s->getPhysicalValue();
+            s->getLimit(e.lower, e.upper);
+        }
+
+        sc->addObserver(this);
+    }
+
+    // Readers check the magic, publish it once the layout is complete
+    std::atomic_thread_fence(std::memory_order_release);
+    ::memcpy(m_Header->magic, QCAN_SHARED_MAGIC, sizeof(QCAN_SHARED_MAGIC));
+
+    return true;
+}
+
+void QCanSharedSignals::destroy()
+{
+    QHash<QCanSignalContainer*, int>::const_iterator iter;
+
+    for (iter = m_FirstEntry.constBegin(); iter != m_FirstEntry.constEnd(); ++iter)
+        iter.key()->removeObserver(this);
+
+    m_FirstEntry.clear();
+
+    if (m_Memory)
+        munmap(m_Memory, m_Size);
+
+    if (m_Fd >= 0) {
+        close(m_Fd);
+        shm_unlink(QString("/%1").arg(m_Name).toUtf8().constData());
+    }
+
+    m_Fd = -1;
+    m_Memory = NULL;
+    m_Header = NULL;
+    m_Entries = NULL;
+}
+
+void QCanSharedSignals::messageDispatched(QCanSignalContainer *message, const QCanMessage & frame)
+{
+    QHash<QCanSignalContainer*, int>::const_iterator found = m_FirstEntry.constFind(message);
+
+    if (found == m_FirstEntry.constEnd())
+        return;
+
+    const QVector<QCanSignal*> & signalList = message->getSignalList();
+    const quint64 timestamp = (quint64)frame.tv.tv_sec * 1000000 + frame.tv.tv_usec;
+    QCanSharedSignalEntry *e = &m_Entries[found.value()];
+    bool changed = false;
+
+    for (int i = 0; i < signalList.size(); i++, e++) {
+        const quint64 raw = signalList[i]->getRawValue();
+
+        e->lock.beginWrite();
+
+        if (e->rawValue != raw) {
+            e->rawValue = raw;
+            e->physicalValue = signalList[i]->getPhysicalValue();
+            e->changeCount++;
+            changed = true;
+        }
+
+        e->timestamp_us = timestamp;
+
+        e->lock.endWrite();
+    }
+
+    if (changed)
+        m_Header->changeSequence.fetchAndAddRelease(1);
+}
@@ -0,0 +1,96 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSHAREDSIGNALS_H_
+#define QCANSHAREDSIGNALS_H_
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+
+#include "QCanSignals.h"
+#include "QCanSharedFormat.h"
+
+/**
+ * Publishes decoded signal values in a POSIX shared memory segment
+ * (see QCanSharedFormat.h), other processes attach with
+ * QCanSharedSignalsClient instead of decoding the bus again.
+ *
+ * Values are written by the thread decoding the frames, use
+ * QCanSignals::E_DECODE_RX_THREAD to publish directly from the receive
+ * thread.
+ */
+class QCanSharedSignals : public QObject, public QCanMessageObserver
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @param name name of the segment, e.g. "qcan" for /dev/shm/qcan
+     */
+    QCanSharedSignals(const QString & name, QObject *parent = NULL);
+    ~QCanSharedSignals();
+
+    /**
+     * Add all signals of a bus, must be called before create()
+     * @param bus bus name used as first part of the signal names
+     */
+    void addBus(const QString & bus, QCanSignals *canSignals);
+
+    /**
+     * Create the segment and start publishing. An existing segment of the
+     * same name is replaced if its publisher has terminated.
+     * @return false if another running process publishes under this name
+     */
+    bool create();
+
+    /// Stop publishing and remove the segment
+    void destroy();
+
+    const QString & getName() const { return m_Name; }
+    int getSignalCount() const { return m_SignalCount; }
+
+    quint64 getChangeSequence() const {
+        return m_Header ? m_Header->changeSequence.loadAcquire() : 0;
+    }
+
+    void messageDispatched(QCanSignalContainer *message, const QCanMessage & frame);
+
+private:
+    QString m_Name;
+
+    QVector<QPair<QString, QCanSignals*> > m_Busses;
+
+    // Index of the first entry of each message
+    QHash<QCanSignalContainer*, int> m_FirstEntry;
+
+    int m_Fd;
+    void *m_Memory;
+    size_t m_Size;
+    int m_SignalCount;
+
+    QCanSharedHeader *m_Header;
+    QCanSharedSignalEntry *m_Entries;
+};
+
+#endif /* QCANSHAREDSIGNALS_H_ */
@@ -0,0 +1,253 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "QCanSharedSignalsClient.h"
+
+// Attempts to get a consistent copy of an entry. A write section only
+// copies a few values, a writer holding it longer has most likely died.
+#define MAX_READ_RETRIES 10000
+
+QCanSharedSignal::QCanSharedSignal(QCanSharedSignalsClient *client, int index, const QString & name)
+ : QObject(client), m_Client(client), m_Index(index), m_Name(name),
+   m_Entry(client->entry(index)), m_LastChangeCount(0)
+{
+}
+
+double QCanSharedSignal::getPhysicalValue() const
+{
+    return m_Client->getPhysicalValue(m_Index);
+}
+
+quint64 QCanSharedSignal::getRawValue() const
+{
+    QCanSharedValue value;
+
+    if (!m_Client->read(m_Index, value))
+        return ULONG_MAX;
+
+    return value.rawValue;
+}
+
+QCanSharedSignalsClient::QCanSharedSignalsClient(QObject *parent)
+ : QObject(parent), m_Fd(-1), m_Memory(NULL), m_Size(0), m_Header(NULL),
+   m_Entries(NULL), m_Names(NULL), m_LastChangeSequence(0)
+{
+    m_PollTimer.setInterval(10);
+
+    QObject::connect(&m_PollTimer, SIGNAL(timeout()), this, SLOT(poll()));
+}
+
+QCanSharedSignalsClient::~QCanSharedSignalsClient()
+{
+    detach();
+}
+
+bool QCanSharedSignalsClient::attach(const QString & name)
+{
+    struct stat st;
+
+    if (m_Memory)
+        return false;
+
+    m_Fd = shm_open(QString("/%1").arg(name).toUtf8().constData(), O_RDONLY, 0);
+
+    if (m_Fd < 0)
+        return false;
+
+    if (fstat(m_Fd, &st) < 0 || (size_t)st.st_size < sizeof(QCanSharedHeader)) {
+        detach();
+        return false;
+    }
+
+    m_Size = st.st_size;
+    m_Memory = mmap(NULL, m_Size, PROT_READ, MAP_SHARED, m_Fd, 0);
+
+    if (m_Memory == MAP_FAILED) {
+        m_Memory = NULL;
+        detach();
+        return false;
+    }
+
+    const QCanSharedHeader *header = static_cast<const QCanSharedHeader *>(m_Memory);
+
+    if (::memcmp(header->magic, QCAN_SHARED_MAGIC, sizeof(QCAN_SHARED_MAGIC)) != 0 ||
+        header->version != QCAN_SHARED_VERSION || header->size > m_Size ||
+        header->namesOffset != sizeof(QCanSharedHeader) + header->signalCount * sizeof(QCanSharedSignalEntry)) {
+        detach();
+        return false;
+    }
+
+    m_Header = header;
+    m_Entries = reinterpret_cast<const QCanSharedSignalEntry *>(m_Header + 1);
+    m_Names = static_cast<const char *>(m_Memory) + m_Header->namesOffset;
+
+    for (quint32 i = 0; i < m_Header->signalCount; i++)
+        m_Index.insert(getSignalName(i), i);
+
+    m_LastChangeSequence = getChangeSequence();
+    m_PollTimer.start();
+
+    return true;
+}
+
+void QCanSharedSignalsClient::detach()
+{
+    m_PollTimer.stop();
+
+    qDeleteAll(m_Proxies);
+    m_Proxies.clear();
+    m_Index.clear();
+
+    if (m_Memory)
+        munmap(m_Memory, m_Size);
+
+    if (m_Fd >= 0)
+        close(m_Fd);
+
+    m_Fd = -1;
+    m_Memory = NULL;
+    m_Header = NULL;
+    m_Entries = NULL;
+    m_Names = NULL;
+}
+
+bool QCanSharedSignalsClient::isWriterAlive() const
+{
+    if (!m_Header)
+        return false;
+
+    return kill(m_Header->writerPid, 0) == 0 || errno == EPERM;
+}
+
+QString QCanSharedSignalsClient::getSignalName(int index) const
+{
+    if (!m_Header || index < 0 || index >= (int)m_Header->signalCount)
+        return QString();
+
+    const char *name = m_Names + m_Entries[index].nameOffset;
+    const char *end = static_cast<const char *>(m_Memory) + m_Header->size;
+
+    return QString::fromUtf8(name, strnlen(name, end - name));
+}
+
+bool QCanSharedSignalsClient::read(int index, QCanSharedValue & value) const
+{
+    if (!m_Header || index < 0 || index >= (int)m_Header->signalCount)
+        return false;
+
+    const QCanSharedSignalEntry & e = m_Entries[index];
+    QCanSharedValue copy;
+    quint64 timestamp;
+    int sequence;
+    int retries;
+
+    for (retries = 0; ; retries++) {
+        if (retries == MAX_READ_RETRIES)
+            return false;
+
+        if (!e.lock.tryBeginRead(sequence))
+            continue;
+
+        copy.changeCount = e.changeCount;
+        copy.rawValue = e.rawValue;
+        copy.physicalValue = e.physicalValue;
+        timestamp = e.timestamp_us;
+
+        if (!e.lock.retryRead(sequence))
+            break;
+    }
+
+    value = copy;
+    value.tv.tv_sec = timestamp / 1000000;
+    value.tv.tv_usec = timestamp % 1000000;
+
+    return true;
+}
+
+double QCanSharedSignalsClient::getPhysicalValue(int index) const
+{
+    QCanSharedValue value;
+
+    if (!read(index, value))
+        return 0.0;
+
+    return value.physicalValue;
+}
+
+QCanSharedSignal * QCanSharedSignalsClient::getSignal(const QString & name)
+{
+    int index = indexOf(name);
+
+    if (index < 0)
+        return NULL;
+
+    for (int i = 0; i < m_Proxies.size(); i++) {
+        if (m_Proxies[i]->m_Index == index)
+            return m_Proxies[i];
+    }
+
+    QCanSharedSignal *s = new QCanSharedSignal(this, index, name);
+    QCanSharedValue value;
+
+    if (read(index, value))
+        s->m_LastChangeCount = value.changeCount;
+
+    m_Proxies.push_back(s);
+
+    return s;
+}
+
+void QCanSharedSignalsClient::poll()
+{
+    const quint64 sequence = getChangeSequence();
+
+    if (sequence == m_LastChangeSequence) {
+        if (!isWriterAlive()) {
+            m_PollTimer.stop();
+            emit writerTerminated();
+        }
+
+        return;
+    }
+
+    m_LastChangeSequence = sequence;
+
+    for (int i = 0; i < m_Proxies.size(); i++) {
+        QCanSharedSignal *s = m_Proxies[i];
+        QCanSharedValue value;
+
+        if (!read(s->m_Index, value) || value.changeCount == s->m_LastChangeCount)
+            continue;
+
+        s->m_LastChangeCount = value.changeCount;
+
+        emit s->valueChanged(value.tv, value.physicalValue);
+        emit s->valueHasChanged();
+    }
+}
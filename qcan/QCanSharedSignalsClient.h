@@ -0,0 +1,170 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSHAREDSIGNALSCLIENT_H_
+#define QCANSHAREDSIGNALSCLIENT_H_
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QTimer>
+
+#include <sys/time.h>
+
+#include "QCanSignals.h"
+#include "QCanSharedFormat.h"
+
+class QCanSharedSignalsClient;
+
+/**
+ * Consistent copy of a shared signal entry
+ */
+struct QCanSharedValue
+{
+    quint64 changeCount;
+    quint64 rawValue;
+    double physicalValue;
+    struct timeval tv;
+};
+
+/**
+ * Shared signal with the notification interface of QCanSignal, so it can be
+ * used by QML bindings and QRealtimePlotter. Changes are detected by polling
+ * the segment, see QCanSharedSignalsClient::setPollInterval().
+ */
+class QCanSharedSignal : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(double value
+               READ getPhysicalValue
+               NOTIFY valueHasChanged);
+
+signals:
+    void valueChanged(const struct timeval & val, double value);
+    void valueHasChanged();
+
+public:
+    double getPhysicalValue() const;
+    quint64 getRawValue() const;
+
+    const QString & getName() const { return m_Name; }
+
+    void getLimit(double & lower, double & upper) const {
+        lower = m_Entry->lower;
+        upper = m_Entry->upper;
+    }
+
+private:
+    friend class QCanSharedSignalsClient;
+
+    QCanSharedSignal(QCanSharedSignalsClient *client, int index, const QString & name);
+
+    QCanSharedSignalsClient *m_Client;
+    const int m_Index;
+    const QString m_Name;
+    const QCanSharedSignalEntry *m_Entry;
+
+    quint64 m_LastChangeCount;
+};
+
+/**
+ * Read-only access to signal values published by QCanSharedSignals in
+ * another process. Values are read directly from the mapped segment.
+ */
+class QCanSharedSignalsClient : public QObject
+{
+    Q_OBJECT
+
+signals:
+    /// The publishing process has terminated, values are no longer updated
+    void writerTerminated();
+
+public:
+    QCanSharedSignalsClient(QObject *parent = NULL);
+    ~QCanSharedSignalsClient();
+
+    /**
+     * Map a segment read-only
+     * @param name name of the segment given to QCanSharedSignals
+     */
+    bool attach(const QString & name);
+    void detach();
+
+    bool isAttached() const { return m_Header != NULL; }
+
+    /// False if the publishing process has terminated
+    bool isWriterAlive() const;
+
+    int getSignalCount() const { return m_Header ? m_Header->signalCount : 0; }
+    quint32 getLayoutHash() const { return m_Header ? m_Header->layoutHash : 0; }
+
+    /// Name of a signal, "<bus>.<message>.<signal>"
+    QString getSignalName(int index) const;
+
+    /// @return index of a signal or -1 if unknown
+    int indexOf(const QString & name) const { return m_Index.value(name, -1); }
+
+    /**
+     * Read a signal without locking the writer. May be called from any thread.
+     * @return false if the entry stays locked by the writer, e.g. because
+     *         the writer terminated during an update
+     */
+    bool read(int index, QCanSharedValue & value) const;
+
+    double getPhysicalValue(int index) const;
+
+    /// Incremented by the writer whenever a value has changed
+    quint64 getChangeSequence() const { return m_Header ? m_Header->changeSequence.loadAcquire() : 0; }
+
+    /**
+     * Get notifying signal object, created on first use and owned by the client
+     * @param name "<bus>.<message>.<signal>"
+     */
+    QCanSharedSignal * getSignal(const QString & name);
+
+    /// Poll interval for notifying signal objects in ms (default: 10)
+    void setPollInterval(int interval_ms) { m_PollTimer.setInterval(interval_ms); }
+
+private slots:
+    void poll();
+
+private:
+    friend class QCanSharedSignal;
+
+    const QCanSharedSignalEntry * entry(int index) const { return &m_Entries[index]; }
+
+    int m_Fd;
+    void *m_Memory;
+    size_t m_Size;
+
+    const QCanSharedHeader *m_Header;
+    const QCanSharedSignalEntry *m_Entries;
+    const char *m_Names;
+
+    QHash<QString, int> m_Index;
+
+    QVector<QCanSharedSignal*> m_Proxies;
+    quint64 m_LastChangeSequence;
+    QTimer m_PollTimer;
+};
+
+#endif /* QCANSHAREDSIGNALSCLIENT_H_ */
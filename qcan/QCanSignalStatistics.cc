@@ -0,0 +1,323 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <math.h>
+#include <string.h>
+
+#include <QtNumeric>
+
+#include "QCanSignalStatistics.h"
+#include "QCanChannel.h"
+
+void QCanSignalStatistic::SampleQueue::push_back(const Sample & s)
+{
+    if (m_Count == m_Data.size()) {
+        QVector<Sample> data(m_Data.size() * 2);
+
+        for (int i = 0; i < m_Count; i++)
+            data[i] = m_Data[(m_Head + i) & (m_Data.size() - 1)];
+
+        m_Data.swap(data);
+        m_Head = 0;
+    }
+
+    m_Data[(m_Head + m_Count) & (m_Data.size() - 1)] = s;
+    m_Count++;
+}
+
+QCanSignalStatistic::QCanSignalStatistic(QCanSignalStatistics *parent, QCanSignal *signal,
+                                         quint32 window_ms, int bins)
+ : QObject(parent), m_Parent(parent), m_Signal(signal), m_Window_us((quint64)window_ms * 1000),
+   m_Mean(0.0), m_M2(0.0), m_Histogram(bins > 0 ? bins : 1, 0), m_Dirty(false)
+{
+    double lower, upper;
+
+    signal->getLimit(lower, upper);
+
+    // Range of the raw values, limits are often left open (+-Inf) by the KCD
+    const int length = qMin<int>(signal->getLength(), 64);
+    double rawMin = 0.0;
+    double rawMax = ldexp(1.0, length) - 1.0;
+
+    if (signal->isSigned()) {
+        rawMin = -ldexp(1.0, length - 1);
+        rawMax = ldexp(1.0, length - 1) - 1.0;
+    }
+
+    const double a = rawMin * signal->getSlope() + signal->getIntercept();
+    const double b = rawMax * signal->getSlope() + signal->getIntercept();
+
+    m_Lower = qMin(a, b);
+    upper = qIsFinite(upper) ? qMin(upper, qMax(a, b)) : qMax(a, b);
+
+    if (qIsFinite(lower))
+        m_Lower = qMax(m_Lower, lower);
+
+    m_BinWidth = qIsFinite(upper - m_Lower) && upper > m_Lower ? (upper - m_Lower) / m_Histogram.size() : 1.0;
+
+    ::memset(&m_Values, 0, sizeof(m_Values));
+}
+
+int QCanSignalStatistic::bin(double value) const
+{
+    // Compare as double, NaN and out of range values must not reach the cast
+    const double b = (value - m_Lower) / m_BinWidth;
+
+    if (!(b >= 0.0))
+        return 0;
+
+    if (b >= m_Histogram.size())
+        return m_Histogram.size() - 1;
+
+    return (int)b;
+}
+
+void QCanSignalStatistic::expire(quint64 time_us)
+{
+    if (time_us < m_Window_us)
+        return;
+
+    const quint64 cutoff = time_us - m_Window_us;
+
+    while (!m_Samples.isEmpty() && m_Samples.front().time_us < cutoff) {
+        const double value = m_Samples.front().value;
+        const int n = m_Samples.size() - 1;
+
+        m_Samples.pop_front();
+        m_Histogram[bin(value)]--;
+
+        // Welford update in reverse
+        if (n == 0) {
+            m_Mean = 0.0;
+            m_M2 = 0.0;
+        } else {
+            const double delta = value - m_Mean;
+
+            m_Mean -= delta / n;
+            m_M2 -= delta * (value - m_Mean);
+        }
+
+        m_Dirty = true;
+    }
+
+    while (!m_MinQueue.isEmpty() && m_MinQueue.front().time_us < cutoff)
+        m_MinQueue.pop_front();
+
+    while (!m_MaxQueue.isEmpty() && m_MaxQueue.front().time_us < cutoff)
+        m_MaxQueue.pop_front();
+}
+
+void QCanSignalStatistic::addSample(quint64 time_us, double value)
+{
+    // Would break the running mean and the min/max queues
+    if (!qIsFinite(value))
+        return;
+
+    // Keep the window ordered if timestamps jump back
+    if (!m_Samples.isEmpty() && time_us < m_Samples.back().time_us)
+        time_us = m_Samples.back().time_us;
+
+    expire(time_us);
+
+    Sample s;
+
+    s.time_us = time_us;
+    s.value = value;
+
+    m_Samples.push_back(s);
+    m_Histogram[bin(value)]++;
+
+    const double delta = value - m_Mean;
+
+    m_Mean += delta / m_Samples.size();
+    m_M2 += delta * (value - m_Mean);
+
+    // Front of the queues is the minimum/maximum of the window
+    while (!m_MinQueue.isEmpty() && m_MinQueue.back().value >= value)
+        m_MinQueue.pop_back();
+
+    m_MinQueue.push_back(s);
+
+    while (!m_MaxQueue.isEmpty() && m_MaxQueue.back().value <= value)
+        m_MaxQueue.pop_back();
+
+    m_MaxQueue.push_back(s);
+
+    m_Dirty = true;
+}
+
+double QCanSignalStatistic::quantile(double p) const
+{
+    const int n = m_Samples.size();
+
+    if (n == 0)
+        return 0.0;
+
+    const double min = m_MinQueue.front().value;
+    const double max = m_MaxQueue.front().value;
+    const double rank = qBound(0.0, p, 1.0) * (n - 1);
+    quint32 cumulative = 0;
+
+    for (int b = 0; b < m_Histogram.size(); b++) {
+        const quint32 count = m_Histogram[b];
+
+        if (cumulative + count > rank) {
+            // Samples are assumed to be evenly spread within a bin
+            double value = m_Lower + (b + (rank - cumulative + 0.5) / count) * m_BinWidth;
+
+            return qBound(min, value, max);
+        }
+
+        cumulative += count;
+    }
+
+    return max;
+}
+
+void QCanSignalStatistic::compute(QCanStatisticsValues & values) const
+{
+    const int n = m_Samples.size();
+
+    ::memset(&values, 0, sizeof(values));
+
+    if (n == 0)
+        return;
+
+    values.count = n;
+    values.min = m_MinQueue.front().value;
+    values.max = m_MaxQueue.front().value;
+    values.mean = m_Mean;
+    values.stddev = n > 1 && m_M2 > 0.0 ? sqrt(m_M2 / (n - 1)) : 0.0;
+    values.p50 = quantile(0.50);
+    values.p95 = quantile(0.95);
+    values.p99 = quantile(0.99);
+}
+
+double QCanSignalStatistic::percentile(double p) const
+{
+    QMutexLocker locker(&m_Parent->m_Lock);
+
+    return quantile(p);
+}
+
+QCanSignalStatistics::QCanSignalStatistics(QObject *parent)
+ : QObject(parent), m_Latest_us(0)
+{
+    m_UpdateTimer.setInterval(100);
+
+    QObject::connect(&m_UpdateTimer, SIGNAL(timeout()), this, SLOT(update()));
+
+    m_UpdateTimer.start();
+}
+
+QCanSignalStatistics::~QCanSignalStatistics()
+{
+    QHash<QCanSignalContainer*, QVector<QCanSignalStatistic*> >::const_iterator iter;
+
+    for (iter = m_MessageMap.constBegin(); iter != m_MessageMap.constEnd(); ++iter)
+        iter.key()->removeObserver(this);
+}
+
+QCanSignalStatistic * QCanSignalStatistics::addSignal(QCanSignalContainer *message, QCanSignal *signal,
+                                                      quint32 window_ms, int bins)
+{
+    QCanSignalStatistic *s = m_SignalMap.value(signal, NULL);
+
+    if (s)
+        return s;
+
+    s = new QCanSignalStatistic(this, signal, window_ms, bins);
+
+    if (!m_MessageMap.contains(message))
+        message->addObserver(this);
+
+    m_MessageMap[message].push_back(s);
+    m_SignalMap.insert(signal, s);
+    m_Statistics.push_back(s);
+
+    return s;
+}
+
+bool QCanSignalStatistics::getValues(QCanSignal *signal, QCanStatisticsValues & values) const
+{
+    QCanSignalStatistic *s = m_SignalMap.value(signal, NULL);
+
+    if (!s)
+        return false;
+
+    QMutexLocker locker(&m_Lock);
+
+    s->compute(values);
+
+    return true;
+}
+
+void QCanSignalStatistics::messageDispatched(QCanSignalContainer *message, const QCanMessage & frame)
+{
+    QHash<QCanSignalContainer*, QVector<QCanSignalStatistic*> >::const_iterator found = m_MessageMap.constFind(message);
+
+    if (found == m_MessageMap.constEnd())
+        return;
+
+    const quint64 time_us = (quint64)frame.tv.tv_sec * 1000000 + frame.tv.tv_usec;
+    const QVector<QCanSignalStatistic*> & list = found.value();
+
+    QMutexLocker locker(&m_Lock);
+
+    if (time_us > m_Latest_us)
+        m_Latest_us = time_us;
+
+    // Decode from the frame, the published value may already be newer
+    for (int i = 0; i < list.size(); i++)
+        list[i]->addSample(time_us, list[i]->m_Signal->physicalValueFromMessage(frame));
+}
+
+void QCanSignalStatistics::update()
+{
+    QVector<QCanSignalStatistic*> changed;
+    QVector<QCanStatisticsValues> values;
+
+    m_Lock.lock();
+
+    for (int i = 0; i < m_Statistics.size(); i++) {
+        QCanSignalStatistic *s = m_Statistics[i];
+
+        // Signals no longer received age out with the other signals
+        s->expire(m_Latest_us);
+
+        if (!s->m_Dirty)
+            continue;
+
+        QCanStatisticsValues v;
+
+        s->compute(v);
+        s->m_Dirty = false;
+
+        changed.push_back(s);
+        values.push_back(v);
+    }
+
+    m_Lock.unlock();
+
+    for (int i = 0; i < changed.size(); i++) {
+        changed[i]->m_Values = values[i];
+        emit changed[i]->statisticsChanged();
+    }
+}
@@ -0,0 +1,214 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSIGNALSTATISTICS_H_
+#define QCANSIGNALSTATISTICS_H_
+
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+
+#include "QCanSignals.h"
+
+/**
+ * Aggregates of a signal over its sliding window
+ */
+struct QCanStatisticsValues
+{
+    quint32 count;
+
+    double min;
+    double max;
+    double mean;
+    double stddev;
+
+    double p50;
+    double p95;
+    double p99;
+};
+
+class QCanSignalStatistics;
+
+/**
+ * Sliding window statistics of a single signal, the values are published
+ * as properties for QML bindings.
+ */
+class QCanSignalStatistic : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ getCount NOTIFY statisticsChanged);
+    Q_PROPERTY(double min READ getMin NOTIFY statisticsChanged);
+    Q_PROPERTY(double max READ getMax NOTIFY statisticsChanged);
+    Q_PROPERTY(double mean READ getMean NOTIFY statisticsChanged);
+    Q_PROPERTY(double stddev READ getStdDev NOTIFY statisticsChanged);
+    Q_PROPERTY(double p50 READ getP50 NOTIFY statisticsChanged);
+    Q_PROPERTY(double p95 READ getP95 NOTIFY statisticsChanged);
+    Q_PROPERTY(double p99 READ getP99 NOTIFY statisticsChanged);
+
+signals:
+    void statisticsChanged();
+
+public:
+    /// Values as of the last update, see QCanSignalStatistics::setUpdateInterval()
+    const QCanStatisticsValues & getValues() const { return m_Values; }
+
+    int getCount() const { return m_Values.count; }
+    double getMin() const { return m_Values.min; }
+    double getMax() const { return m_Values.max; }
+    double getMean() const { return m_Values.mean; }
+    double getStdDev() const { return m_Values.stddev; }
+    double getP50() const { return m_Values.p50; }
+    double getP95() const { return m_Values.p95; }
+    double getP99() const { return m_Values.p99; }
+
+    /// Current percentile of the window, p in [0, 1]
+    Q_INVOKABLE double percentile(double p) const;
+
+    QCanSignal * getSignal() const { return m_Signal; }
+
+private:
+    friend class QCanSignalStatistics;
+
+    struct Sample {
+        quint64 time_us;
+        double value;
+    };
+
+    /// Growing ring buffer of samples
+    class SampleQueue {
+    public:
+        SampleQueue() : m_Head(0), m_Count(0) { m_Data.resize(16); }
+
+        bool isEmpty() const { return m_Count == 0; }
+        int size() const { return m_Count; }
+
+        const Sample & front() const { return m_Data[m_Head]; }
+        const Sample & back() const { return m_Data[(m_Head + m_Count - 1) & (m_Data.size() - 1)]; }
+
+        void push_back(const Sample & s);
+        void pop_front() { m_Head = (m_Head + 1) & (m_Data.size() - 1); m_Count--; }
+        void pop_back() { m_Count--; }
+
+    private:
+        QVector<Sample> m_Data;
+        int m_Head;
+        int m_Count;
+    };
+
+    QCanSignalStatistic(QCanSignalStatistics *parent, QCanSignal *signal, quint32 window_ms, int bins);
+
+    void addSample(quint64 time_us, double value);
+    void expire(quint64 time_us);
+
+    /// @return bin of a value in the histogram
+    int bin(double value) const;
+
+    /// Compute values, caller holds the lock of the parent
+    void compute(QCanStatisticsValues & values) const;
+    double quantile(double p) const;
+
+    QCanSignalStatistics *m_Parent;
+    QCanSignal *m_Signal;
+    const quint64 m_Window_us;
+
+    // Samples in the window, monotonic queues of window minima/maxima
+    SampleQueue m_Samples;
+    SampleQueue m_MinQueue;
+    SampleQueue m_MaxQueue;
+
+    // Welford mean and sum of squared deviations
+    double m_Mean;
+    double m_M2;
+
+    // Histogram over the signal limits for percentiles
+    QVector<quint32> m_Histogram;
+    double m_Lower;
+    double m_BinWidth;
+
+    bool m_Dirty;
+
+    QCanStatisticsValues m_Values;
+};
+
+/**
+ * Computes min/max/mean/stddev and percentiles of signals over sliding time
+ * windows.
+ *
+ * Samples are added on the decoding thread for every received frame with an
+ * O(1) amortized update: monotonic queues for min/max, Welford updates with
+ * removal for mean and variance and a histogram over the signal limits for
+ * percentiles. The window is based on frame timestamps. Published values are
+ * refreshed periodically on the thread owning the statistics.
+ */
+class QCanSignalStatistics : public QObject, public QCanMessageObserver
+{
+    Q_OBJECT
+
+public:
+    QCanSignalStatistics(QObject *parent = NULL);
+    ~QCanSignalStatistics();
+
+    /**
+     * Collect statistics of a signal
+     * @param message message the signal belongs to
+     * @param window_ms length of the sliding window
+     * @param bins histogram resolution for percentiles
+     * @return statistics object owned by this object
+     */
+    QCanSignalStatistic * addSignal(QCanSignalContainer *message, QCanSignal *signal,
+                                    quint32 window_ms = 10000, int bins = 1024);
+
+    /// @return statistics of a signal or NULL if not collected
+    QCanSignalStatistic * getStatistic(QCanSignal *signal) const { return m_SignalMap.value(signal, NULL); }
+
+    /**
+     * Compute current values of a signal. May be called from any thread.
+     * @return false if the signal is not collected
+     */
+    bool getValues(QCanSignal *signal, QCanStatisticsValues & values) const;
+
+    /// Interval of property updates in ms (default: 100)
+    void setUpdateInterval(int interval_ms) { m_UpdateTimer.setInterval(interval_ms); }
+
+    virtual void messageDispatched(QCanSignalContainer *message, const QCanMessage & frame);
+
+private slots:
+    void update();
+
+private:
+    friend class QCanSignalStatistic;
+
+    QHash<QCanSignalContainer*, QVector<QCanSignalStatistic*> > m_MessageMap;
+    QHash<QCanSignal*, QCanSignalStatistic*> m_SignalMap;
+    QVector<QCanSignalStatistic*> m_Statistics;
+
+    // Protects all sample windows, frames may be dispatched by a receive thread
+    mutable QMutex m_Lock;
+
+    // Latest frame timestamp, expires windows of signals no longer received
+    quint64 m_Latest_us;
+
+    QTimer m_UpdateTimer;
+};
+
+#endif /* QCANSIGNALSTATISTICS_H_ */
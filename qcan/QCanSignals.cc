@@ -24,14 +24,15 @@
 
 #include "QCanSignals.h"
 #include "QCanChannel.h"
+#include "QCanTrace.h"
 
 //-----------------------------------------------------------------------------
 /**
  * QCanSignals
  */
-QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QDomElement & e)
+QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QDomElement & e, decode_mode_t mode)
 {
-    QCanSignals *s = new QCanSignals(channel);
+    QCanSignals *s = new QCanSignals(channel, mode);
 
     QDomNode messageNode = e.firstChild();
 
@@ -47,9 +48,16 @@ QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QDomElement
                quint32 mlength   = messageElem.attribute("length", "0").toLong();
                quint32 mlength_auto = 0;
 
+               quint32 interval = messageElem.attribute("interval", "0").toLong();
+               bool triggered = messageElem.attribute("triggered", interval ? "false" : "true").compare("true") == 0;
+
                QCanSignalContainer *sc = new QCanSignalContainer(name, id, ext);
 
-               QObject::connect(sc, SIGNAL(canMessageSend(const QCanMessage &)), channel, SLOT(canMessageSend(const QCanMessage &)));
+               sc->setInterval(interval);
+               sc->setTriggered(triggered);
+
+               if (channel)
+                   QObject::connect(sc, SIGNAL(canMessageSend(const QCanMessage &)), channel, SLOT(canMessageSend(const QCanMessage &)));
 
                // Find all "Signal" nodes
                for (QDomNode signalNode = messageElem.firstChild(); !signalNode.isNull(); signalNode = signalNode.nextSibling()) {
@@ -114,7 +122,7 @@ QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QDomElement
     return s;
 }
 
-QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QString & kcdfile, const QString & bus)
+QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QString & kcdfile, const QString & bus, decode_mode_t mode)
 {
     QDomDocument doc;
 
@@ -139,7 +147,7 @@ QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QString & kc
                 if (e.attribute("name").compare(bus) == 0) {
                     file.close();
 
-                    return createFromKCD(channel, e);
+                    return createFromKCD(channel, e, mode);
                 }
             }
         }
@@ -152,22 +160,111 @@ QCanSignals* QCanSignals::createFromKCD(QCanChannel* channel, const QString & kc
     return NULL;
 }
 
-QCanSignals::QCanSignals(QCanChannel* channel) : m_CanChannel(channel)
+QCanSignals::QCanSignals(QCanChannel* channel, decode_mode_t mode)
+ : m_CanChannel(channel), m_DecodeMode(mode), m_PublishPending(0)
 {
-    QObject::connect(m_CanChannel, SIGNAL(canMessageReceived(const QCanMessage &)), this, SLOT(canMessageReceived(const QCanMessage &)));
+    // valueChanged() is queued to the receivers when decoding on the receive thread
+    qRegisterMetaType<struct timeval>("timeval");
+
+    // Without a channel the messages are only used as description
+    if (!m_CanChannel)
+        return;
+
+    // In receive thread mode the slot is called directly by QCanChannel::run()
+    Qt::ConnectionType type = m_DecodeMode == E_DECODE_RX_THREAD ? Qt::DirectConnection : Qt::AutoConnection;
+
+    QObject::connect(m_CanChannel, SIGNAL(canMessageReceived(const QCanMessage &)), this, SLOT(canMessageReceived(const QCanMessage &)), type);
 }
 
 QCanSignals::~QCanSignals()
 {
 }
 
+static inline quint32 _messageKey(quint32 id, bool isExt)
+{
+    return isExt ? (id | 0x80000000U) : id;
+}
+
+void QCanSignals::addMessage(QCanSignalContainer* message)
+{
+    m_Messages.push_back(message);
+    m_MessageIndex[_messageKey(message->getCanId(), message->isExt())].push_back(message);
+}
+
 void QCanSignals::canMessageReceived(const QCanMessage & frame)
 {
-    QVector<QCanSignalContainer*>::iterator iter = m_Messages.begin();
+    QHash<quint32, QVector<QCanSignalContainer*> >::const_iterator found =
+            m_MessageIndex.constFind(_messageKey(frame.id, frame.isExt));
+
+    if (found == m_MessageIndex.constEnd())
+        return;
+
+    QVector<QCanSignalContainer*>::const_iterator iter = found->constBegin();
+
+    if (m_DecodeMode == E_DECODE_GUI_THREAD) {
+        while(iter != found->constEnd()) {
+            (*iter)->dispatchMessage(frame);
+            ++iter;
+        }
+
+        QCAN_TRACE(E_TRACE_DECODE, frame.tv);
+
+        return;
+    }
+
+    // Running on the receive thread: decode and publish values, emit
+    // valueChanged() for sample based consumers (queued by Qt) and collect
+    // valueHasChanged() notifications for a single queued publish call.
+    bool pending = false;
+
+    while(iter != found->constEnd()) {
+        QCanSignalContainer *sc = *iter++;
+        quint64 changed = sc->decodeMessage(frame);
+
+        if (!changed)
+            continue;
 
-    while(iter != m_Messages.end()) {
-        (*iter)->dispatchMessage(frame);
-        ++iter;
+        QVector<QCanSignal*> & signalList = sc->getSignalList();
+        for (int i = 0; i < signalList.size() && i < 64; i++) {
+            if (changed & (Q_UINT64_C(1) << i))
+                signalList[i]->notifyValueChanged(frame.tv);
+        }
+
+        sc->addPendingChanges(changed);
+        pending = true;
+    }
+
+    QCAN_TRACE(E_TRACE_DECODE, frame.tv);
+
+    if (pending && m_PublishPending.testAndSetAcquire(0, 1))
+        QMetaObject::invokeMethod(this, "publishChangedSignals", Qt::QueuedConnection);
+}
+
+void QCanSignals::snapshotAll(QVector<QCanMessageSnapshot> & snapshots) const
+{
+    snapshots.resize(m_Messages.size());
+
+    for (int i = 0; i < m_Messages.size(); i++)
+        m_Messages[i]->snapshot(snapshots[i]);
+}
+
+void QCanSignals::publishChangedSignals()
+{
+    // Reset first, changes arriving from now on will queue another call
+    m_PublishPending.storeRelease(0);
+
+    QCanSignalContainer *sc;
+    foreach(sc, m_Messages) {
+        quint64 changed = sc->takePendingChanges();
+
+        if (!changed)
+            continue;
+
+        QVector<QCanSignal*> & signalList = sc->getSignalList();
+        for (int i = 0; i < signalList.size() && i < 64; i++) {
+            if (changed & (Q_UINT64_C(1) << i))
+                signalList[i]->notifyValueHasChanged();
+        }
     }
 }
 
@@ -178,21 +275,100 @@ void QCanSignals::canMessageReceived(const QCanMessage & frame)
 
 void QCanSignalContainer::dispatchMessage(const QCanMessage & frame)
 {
-    if (frame.id == m_CanId && frame.isExt == frame.isExt) {
-        ::memcpy(&m_Data[0], &frame.data[0], 8);
-        QVector<QCanSignal*>::iterator iter = m_Signals.begin();
+    quint64 changed = decodeMessage(frame);
 
-        while(iter != m_Signals.end())
-            (*iter++)->decodeFromMessage(frame);
+    for (int i = 0; changed && i < m_Signals.size() && i < 64; i++) {
+        if (changed & (Q_UINT64_C(1) << i)) {
+            m_Signals[i]->notifyValueChanged(frame.tv);
+            m_Signals[i]->notifyValueHasChanged();
+        }
     }
 }
 
+quint64 QCanSignalContainer::decodeMessage(const QCanMessage & frame)
+{
+    quint64 changed = 0;
+
+    if (frame.id != m_CanId || frame.isExt != m_IsExt)
+        return 0;
+
+    double *values = m_Values.data();
+
+    m_SeqLock.beginWrite();
+
+    m_Timestamp = frame.tv;
+    ::memcpy(&m_Data[0], &frame.data[0], 8);
+
+    for (int i = 0; i < m_Signals.size(); i++) {
+        // Only 64 signals fit into a CAN frame
+        if (m_Signals[i]->decode(frame) && i < 64)
+            changed |= Q_UINT64_C(1) << i;
+
+        values[i] = m_Signals[i]->getPhysicalValue();
+    }
+
+    m_SeqLock.endWrite();
+
+    for (int i = 0; i < m_Observers.size(); i++)
+        m_Observers[i]->messageDispatched(this, frame);
+
+    return changed;
+}
+
+void QCanSignalContainer::snapshot(QCanMessageSnapshot & snapshot) const
+{
+    int count = m_Values.size();
+    int sequence;
+
+    snapshot.values.resize(count);
+
+    do {
+        sequence = m_SeqLock.beginRead();
+
+        snapshot.tv = m_Timestamp;
+        ::memcpy(&snapshot.data[0], &m_Data[0], 8);
+        ::memcpy(snapshot.values.data(), m_Values.constData(), count * sizeof(double));
+    } while (m_SeqLock.retryRead(sequence));
+
+    snapshot.sequence = static_cast<quint32>(sequence) >> 1;
+}
+
+QVariantMap QCanSignalContainer::getSnapshot() const
+{
+    QCanMessageSnapshot s;
+    QVariantMap map;
+
+    snapshot(s);
+
+    map.insert("timestamp", (s.tv.tv_sec * 1000.0) + (s.tv.tv_usec / 1000.0));
+    map.insert("sequence", s.sequence);
+
+    for (int i = 0; i < m_Signals.size(); i++)
+        map.insert(m_Signals[i]->getName(), s.values[i]);
+
+    return map;
+}
+
 //-----------------------------------------------------------------------------
 /**
  * QCanSignal
  */
 
 
+static inline quint64 _tobits(double value)
+{
+    quint64 bits;
+    ::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline double _frombits(quint64 bits)
+{
+    double value;
+    ::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
 static quint64 _getvalue(const quint8 * const data, quint32 offset, quint32 length, ENDIANESS byteOrder)
 {
     quint64 d;
@@ -217,42 +393,87 @@ static quint64 _getvalue(const quint8 * const data, quint32 offset, quint32 leng
     return o;
 }
 
+double QCanSignal::getPhysicalValue() const
+{
+    return _frombits(m_PhysicalValue.loadAcquire());
+}
+
 void QCanSignal::setPhysicalValue(double val)
 {
-    m_PhysicalValue = val;
+    quint64 raw = (quint64)((val - m_Intercept) / m_Slope);
 
-    m_RawValue = (quint64)((m_PhysicalValue - m_Intercept) / m_Slope);
+    m_PhysicalValue.storeRelease(_tobits(val));
+    m_RawValue.storeRelease(raw);
 
-    canMessageValueSend(m_Offset, m_Length, m_Order, m_RawValue);
+    canMessageValueSend(m_Offset, m_Length, m_Order, raw);
 }
 
 void QCanSignal::decodeFromMessage(const QCanMessage & message)
 {
-    quint64 value = _getvalue(&message.data[0], m_Offset, m_Length, m_Order);
-    bool changed = value != m_RawValue;
+    if (decode(message)) {
+        notifyValueChanged(message.tv);
+        notifyValueHasChanged();
+    }
+}
 
-    m_RawValue = value;
+double QCanSignal::rawToPhysical(quint64 value) const
+{
+    double physicalValue;
 
     // Convert from 2s complement
-    if ((m_RawValue & (1 << (m_Length - 1))) && m_IsSigned) {
-        qint32 tmp = -1 * (~((~Q_UINT64_C(0) << m_Length) | m_RawValue) + 1);
-        m_PhysicalValue = (tmp * m_Slope) + m_Intercept;
+    if ((value & (1 << (m_Length - 1))) && m_IsSigned) {
+        qint32 tmp = -1 * (~((~Q_UINT64_C(0) << m_Length) | value) + 1);
+        physicalValue = (tmp * m_Slope) + m_Intercept;
     }
     else {
-        m_PhysicalValue = (m_RawValue * m_Slope) + m_Intercept;
+        physicalValue = (value * m_Slope) + m_Intercept;
     }
 
-    if (m_PhysicalValue < m_Lower)
-        m_PhysicalValue = m_Lower;
+    if (physicalValue < m_Lower)
+        physicalValue = m_Lower;
 
-    if (m_PhysicalValue > m_Upper)
-        m_PhysicalValue = m_Upper;
+    if (physicalValue > m_Upper)
+        physicalValue = m_Upper;
 
-    if (changed)
-    {
-        emit valueChanged(message.tv, m_PhysicalValue);
-        emit valueHasChanged();
-    }
+    return physicalValue;
+}
+
+double QCanSignal::physicalValueFromMessage(const QCanMessage & message) const
+{
+    return rawToPhysical(_getvalue(&message.data[0], m_Offset, m_Length, m_Order));
+}
+
+bool QCanSignal::decode(const QCanMessage & message)
+{
+    quint64 value = _getvalue(&message.data[0], m_Offset, m_Length, m_Order);
+    bool changed = value != m_RawValue.loadAcquire();
+
+    m_PhysicalValue.storeRelease(_tobits(rawToPhysical(value)));
+    m_RawValue.storeRelease(value);
+
+    if (Q_UNLIKELY(QCanTrace::isEnabled()))
+        m_Timestamp_us.storeRelease((quint64)message.tv.tv_sec * 1000000 + message.tv.tv_usec);
+
+    return changed;
+}
+
+void QCanSignal::notifyValueChanged(const struct timeval & tv)
+{
+    emit valueChanged(tv, getPhysicalValue());
+}
+
+void QCanSignal::notifyValueHasChanged()
+{
+    QCAN_TRACE(E_TRACE_NOTIFY, m_Timestamp_us.loadAcquire());
+
+    emit valueHasChanged();
+}
+
+double QCanSignal::getPropertyValue() const
+{
+    QCAN_TRACE(E_TRACE_PROPERTY, m_Timestamp_us.loadAcquire());
+
+    return getPhysicalValue();
 }
 
 bool _setvalue(quint32 offset, quint32 bitLength, ENDIANESS endianess, quint8 data[8], quint64 raw_value)
@@ -293,12 +514,37 @@ bool _setvalue(quint32 offset, quint32 bitLength, ENDIANESS endianess, quint8 da
 
 void QCanSignalContainer::canMessageValueSend(quint32 offset, quint32 bitLength, ENDIANESS endianess, quint64 value)
 {
-    if(_setvalue(offset, bitLength, endianess, &m_Data[0], value)) {
-        QCanMessage message;
+    QCanMessage message;
+
+    m_SeqLock.beginWrite();
+    bool changed = _setvalue(offset, bitLength, endianess, &m_Data[0], value);
+    ::memcpy(&message.data[0], &m_Data[0], 8);
+    m_SeqLock.endWrite();
+
+    // Pure cyclic messages are picked up by the scheduler
+    if (m_IsScheduled && !m_IsTriggered)
+        return;
+
+    if(changed) {
         message.isExt = m_IsExt;
         message.id = m_CanId;
         message.dlc = m_Length;
-        ::memcpy(&message.data[0], &m_Data[0], 8);
         canMessageSend(message);
     }
 }
+
+void QCanSignalContainer::buildMessage(QCanMessage & message) const
+{
+    int sequence;
+
+    do {
+        sequence = m_SeqLock.beginRead();
+        ::memcpy(&message.data[0], &m_Data[0], 8);
+    } while (m_SeqLock.retryRead(sequence));
+
+    message.tv.tv_sec = 0;
+    message.tv.tv_usec = 0;
+    message.isExt = m_IsExt;
+    message.id = m_CanId;
+    message.dlc = m_Length;
+}
@@ -23,14 +23,20 @@
 #define QCANSIGNALS_H_
 
 #include <QVector>
+#include <QHash>
 #include <QString>
 
 #include <QObject>
+#include <QAtomicInteger>
+#include <QVariantMap>
 
 #include <QDomElement>
 #include <QMetaType>
 
 #include <limits.h>
+#include <sys/time.h>
+
+#include "QCanSeqLock.h"
 
 class QCanChannel;
 struct QCanMessage;
@@ -50,7 +56,7 @@ class QCanSignal : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(double value
-               READ getPhysicalValue
+               READ getPropertyValue
                WRITE setPhysicalValue
                NOTIFY valueHasChanged);
 
@@ -63,7 +69,7 @@ public:
     QCanSignal(QString & name, quint8 offset, quint32 length, ENDIANESS order)
      : m_Name(name), m_Offset(offset), m_Length(length), m_Order(order),
        m_Slope(1.0), m_Intercept(0.0), m_RawValue(ULONG_MAX), m_PhysicalValue(0),
-       m_IsSigned(false) {
+       m_Timestamp_us(0), m_IsSigned(false) {
         m_Lower = 0.0;
         m_Upper = (1 << m_Length) - 1; 
     }
@@ -71,7 +77,7 @@ public:
     ~QCanSignal() {}
 
     void setLimit(double lower, double upper) { m_Lower = lower; m_Upper = upper; }
-    void getLimit(double & lower, double & upper) { lower = m_Lower; upper = m_Upper; }
+    void getLimit(double & lower, double & upper) const { lower = m_Lower; upper = m_Upper; }
 
     void setEquationOperands(double slope, double intercept) {
         m_Slope = slope;
@@ -80,15 +86,47 @@ public:
 
     void decodeFromMessage(const QCanMessage & message);
 
-    double getPhysicalValue() { return m_PhysicalValue; }
+    /**
+     * Decode and publish the signal value without emitting any Qt signal.
+     * Safe to call from the CAN receive thread.
+     * @return true if the raw value has changed
+     */
+    bool decode(const QCanMessage & message);
+
+    /**
+     * Extract the physical value from a frame without publishing it.
+     * Safe to call from any thread.
+     */
+    double physicalValueFromMessage(const QCanMessage & message) const;
+
+    /// Emit valueChanged() with the currently published value
+    void notifyValueChanged(const struct timeval & tv);
+
+    /// Emit valueHasChanged(), used by QML bindings
+    void notifyValueHasChanged();
+
+    double getPhysicalValue() const;
     void setPhysicalValue(double val);
-    quint64 getRawValue() { return m_RawValue; }
+
+    /// Read accessor of the value property, traces QML reads
+    double getPropertyValue() const;
+    quint64 getRawValue() const { return m_RawValue.loadAcquire(); }
 
     const QString & getName() { return m_Name; }
 
     void setIsSigned(bool isSigned) { m_IsSigned = isSigned; }
+    bool isSigned() const { return m_IsSigned; }
+
+    // Signal layout and scaling
+    quint8 getOffset() const { return m_Offset; }
+    quint32 getLength() const { return m_Length; }
+    ENDIANESS getOrder() const { return m_Order; }
+    double getSlope() const { return m_Slope; }
+    double getIntercept() const { return m_Intercept; }
 
 private:
+    double rawToPhysical(quint64 value) const;
+
     QString m_Name;
     const quint8 m_Offset;
     const quint32 m_Length;
@@ -100,12 +138,48 @@ private:
     double m_Slope;
     double m_Intercept;
 
-    quint64 m_RawValue;
-    double m_PhysicalValue;
+    // Published values, may be written by the CAN receive thread while
+    // the GUI thread reads them (physical value is stored as IEEE-754 bits)
+    QAtomicInteger<quint64> m_RawValue;
+    QAtomicInteger<quint64> m_PhysicalValue;
+
+    // Frame timestamp of the value, only maintained while tracing
+    QAtomicInteger<quint64> m_Timestamp_us;
 
     bool m_IsSigned;
 };
 
+/**
+ * Consistent copy of all decoded values of a CAN message
+ */
+struct QCanMessageSnapshot
+{
+    /// Timestamp of the frame the values were decoded from
+    struct timeval tv;
+
+    /// Number of updates of the message, 0 if nothing was received yet
+    quint32 sequence;
+
+    quint8 data[8];
+
+    /// Physical values in order of QCanSignalContainer::getSignalList()
+    QVector<double> values;
+};
+
+class QCanSignalContainer;
+
+/**
+ * Interface to get notified about every frame dispatched to a message.
+ * Called on the decoding thread, implementations have to be cheap.
+ */
+class QCanMessageObserver
+{
+public:
+    virtual ~QCanMessageObserver() {}
+
+    virtual void messageDispatched(QCanSignalContainer *message, const QCanMessage & frame) = 0;
+};
+
 /**
  * This object describes a CAN message holding certain CAN signals
  */
@@ -115,16 +189,83 @@ class QCanSignalContainer : public QObject
 
 public:
     QCanSignalContainer(QString & name, quint32 id, bool isExt)
-     : m_Name(name), m_CanId(id), m_IsExt(isExt), m_Length(0), m_Data() {}
+     : m_Name(name), m_CanId(id), m_IsExt(isExt), m_Length(0),
+       m_Interval(0), m_IsTriggered(true), m_IsScheduled(false), m_Data() {
+        m_Timestamp.tv_sec = 0;
+        m_Timestamp.tv_usec = 0;
+    }
     ~QCanSignalContainer() {}
 
     const QString & getName() { return m_Name; }
 
-    void addSignal(QCanSignal* signal) { m_Signals.push_back(signal); }
+    void addSignal(QCanSignal* signal) {
+        m_Signals.push_back(signal);
+        m_Values.push_back(signal->getPhysicalValue());
+    }
 
+    /**
+     * Decode frame and notify all changed signals
+     */
     void dispatchMessage(const QCanMessage & frame);
 
+    /**
+     * Decode frame into all signals without emitting any Qt signal.
+     * @return bit mask of signals (index in signal list) which have changed
+     */
+    quint64 decodeMessage(const QCanMessage & frame);
+
+    /// Remember changed signals to be published later on by takePendingChanges()
+    void addPendingChanges(quint64 changed) { m_PendingChanges.fetchAndOrRelease(changed); }
+
+    /// Return and clear changed signals collected by addPendingChanges()
+    quint64 takePendingChanges() { return m_PendingChanges.fetchAndStoreAcquire(0); }
+
+    /**
+     * Copy all values decoded from the same frame without locking the
+     * receive path. May be called from any thread.
+     * @param snapshot receives the values, storage is reused between calls
+     */
+    void snapshot(QCanMessageSnapshot & snapshot) const;
+
+    /**
+     * QML friendly variant of snapshot(), maps signal names to values and
+     * provides "timestamp" (ms since epoch) and "sequence".
+     */
+    Q_INVOKABLE QVariantMap getSnapshot() const;
+
     void setLength(quint32 length) { m_Length = length; }
+    quint32 getLength() const { return m_Length; }
+
+    quint32 getCanId() const { return m_CanId; }
+    bool isExt() const { return m_IsExt; }
+
+    /// Cycle time in ms as declared by the KCD "interval" attribute, 0 if not cyclic
+    void setInterval(quint32 interval_ms) { m_Interval = interval_ms; }
+    quint32 getInterval() const { return m_Interval; }
+
+    /// Message is sent on every value change (KCD "triggered" attribute)
+    void setTriggered(bool triggered) { m_IsTriggered = triggered; }
+    bool isTriggered() const { return m_IsTriggered; }
+
+    /**
+     * Mark message as sent cyclically by a scheduler. Value changes of
+     * scheduled messages, which are not triggered, are only sent with the
+     * next cycle.
+     */
+    void setScheduled(bool scheduled) { m_IsScheduled = scheduled; }
+    bool isScheduled() const { return m_IsScheduled; }
+
+    /**
+     * Build a frame from the current message data. May be called from any thread.
+     */
+    void buildMessage(QCanMessage & message) const;
+
+    /**
+     * Register an observer called for every frame of this message. Observers
+     * must be added before the channel is started.
+     */
+    void addObserver(QCanMessageObserver *observer) { m_Observers.push_back(observer); }
+    void removeObserver(QCanMessageObserver *observer) { m_Observers.removeAll(observer); }
 
     QCanSignal * operator[](const QString & name) {
         QVector<QCanSignal*>::iterator iter = m_Signals.begin();
@@ -150,9 +291,22 @@ private:
     const quint32 m_CanId;
     const bool m_IsExt;
     quint32 m_Length;
+
+    quint32 m_Interval;
+    bool m_IsTriggered;
+    bool m_IsScheduled;
+
+    // Protects m_Timestamp, m_Data and m_Values. Written by the decoding
+    // thread and the send path, read by snapshot()
+    QCanSeqLock m_SeqLock;
+    struct timeval m_Timestamp;
     quint8 m_Data[8];
+    QVector<double> m_Values;
+
+    QAtomicInteger<quint64> m_PendingChanges;
 
     QVector<QCanSignal*> m_Signals;
+    QVector<QCanMessageObserver*> m_Observers;
 };
 
 /**
@@ -163,25 +317,47 @@ class QCanSignals : public QObject
     Q_OBJECT
 
 public:
-    QCanSignals(QCanChannel* channel);
+    typedef enum E_DECODE_MODE {
+        /// Frames are queued to and decoded by the thread owning QCanSignals
+        E_DECODE_GUI_THREAD = 0,
+        /// Frames are decoded by the channel receive thread, only a compact
+        /// change notification is queued to the thread owning QCanSignals
+        E_DECODE_RX_THREAD
+    } decode_mode_t;
+
+    /**
+     * @param channel channel to decode, NULL to only describe the messages,
+     * e.g. to decode frames with QCanSignal::physicalValueFromMessage()
+     * @param mode thread used to decode received frames
+     */
+    QCanSignals(QCanChannel* channel, decode_mode_t mode = E_DECODE_GUI_THREAD);
     ~QCanSignals();
 
     /**
      * Create CAN signals from a channel and KCD DOM bus description
-     * @param channel CAN channel to attached to
+     * @param channel CAN channel to attached to, may be NULL
      * @param e "bus" root level DOM element
+     * @param mode thread used to decode received frames
      */
-    static QCanSignals* createFromKCD(QCanChannel* channel, const QDomElement & e);
+    static QCanSignals* createFromKCD(QCanChannel* channel, const QDomElement & e,
+                                      decode_mode_t mode = E_DECODE_GUI_THREAD);
 
     /**
      * Create CAN signals from a channel and KCD DOM bus description
-     * @param channel CAN channel to attached to
+     * @param channel CAN channel to attached to, may be NULL
      * @param kcdfile path to KCD XML file
      * @param bus name of the bus to use defined in KCD XML file path to KCD XML file
+     * @param mode thread used to decode received frames
      */
-    static QCanSignals* createFromKCD(QCanChannel* channel, const QString & kcdfile, const QString & bus);
+    static QCanSignals* createFromKCD(QCanChannel* channel, const QString & kcdfile, const QString & bus,
+                                      decode_mode_t mode = E_DECODE_GUI_THREAD);
 
-    void addMessage(QCanSignalContainer* message) { m_Messages.push_back(message); }
+    decode_mode_t getDecodeMode() const { return m_DecodeMode; }
+
+    /// Channel the signals are received on, may be NULL
+    QCanChannel* getChannel() const { return m_CanChannel; }
+
+    void addMessage(QCanSignalContainer* message);
 
     QCanSignalContainer * operator[](const QString & name) {
         QVector<QCanSignalContainer*>::iterator iter = m_Messages.begin();
@@ -196,13 +372,29 @@ public:
 
     QVector<QCanSignalContainer*> & getMessageList() { return m_Messages; }
 
+    /**
+     * Take a consistent snapshot of every message, e.g. for periodic exporters
+     * @param snapshots one entry per message in order of getMessageList()
+     */
+    void snapshotAll(QVector<QCanMessageSnapshot> & snapshots) const;
+
 private slots:
     void canMessageReceived(const QCanMessage & frame);
 
+    /// Emit valueHasChanged() of all signals changed by the receive thread
+    void publishChangedSignals();
+
 private:
     QCanChannel* m_CanChannel;
+    const decode_mode_t m_DecodeMode;
+
+    // Set while a publishChangedSignals() call is queued
+    QAtomicInt m_PublishPending;
 
     QVector<QCanSignalContainer*> m_Messages;
+
+    // Messages by CAN identifier (bit 31 set for extended frames)
+    QHash<quint32, QVector<QCanSignalContainer*> > m_MessageIndex;
 };
 
 #endif /* QCANSIGNALS_H_ */
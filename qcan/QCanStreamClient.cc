@@ -0,0 +1,286 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <QElapsedTimer>
+
+#include "QCanStreamClient.h"
+#include "QCanStreamFormat.h"
+
+QCanStreamSignal::QCanStreamSignal(QCanStreamClient *client, const QString & name, double lower, double upper)
+ : QObject(client), m_Name(name), m_Lower(lower), m_Upper(upper), m_RawValue(0), m_PhysicalValue(0.0)
+{
+}
+
+QCanStreamClient::QCanStreamClient(QObject *parent)
+ : QObject(parent), m_HasDictionary(false), m_Timestamp_us(0), m_BytesReceived(0)
+{
+    m_Socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    QObject::connect(&m_Socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+}
+
+QCanStreamClient::~QCanStreamClient()
+{
+    disconnectFromServer();
+}
+
+bool QCanStreamClient::connectToServer(const QString & host, quint16 port, int timeout_ms)
+{
+    QElapsedTimer timer;
+
+    disconnectFromServer();
+
+    timer.start();
+    m_Socket.connectToHost(host, port);
+
+    if (!m_Socket.waitForConnected(timeout_ms))
+        return false;
+
+    // readyRead() processes the dictionary
+    while (!m_HasDictionary) {
+        int remaining = timeout_ms - timer.elapsed();
+
+        if (remaining <= 0 || !m_Socket.waitForReadyRead(remaining)) {
+            disconnectFromServer();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void QCanStreamClient::disconnectFromServer()
+{
+    m_Socket.abort();
+
+    for (int i = 0; i < m_Signals.size(); i++)
+        delete m_Signals[i].proxy;
+
+    m_Signals.clear();
+    m_Index.clear();
+    m_Buffer.clear();
+    m_HasDictionary = false;
+    m_Timestamp_us = 0;
+}
+
+QString QCanStreamClient::getSignalName(int index) const
+{
+    if (index < 0 || index >= m_Signals.size())
+        return QString();
+
+    return m_Signals[index].name;
+}
+
+QCanStreamSignal * QCanStreamClient::getSignal(const QString & name)
+{
+    int index = indexOf(name);
+
+    if (index < 0)
+        return NULL;
+
+    SignalInfo & info = m_Signals[index];
+
+    if (!info.proxy) {
+        info.proxy = new QCanStreamSignal(this, name, info.lower, info.upper);
+        subscribe();
+    }
+
+    return info.proxy;
+}
+
+void QCanStreamClient::subscribe()
+{
+    QByteArray payload, message;
+    int count = 0, last = 0;
+
+    for (int i = 0; i < m_Signals.size(); i++) {
+        if (m_Signals[i].proxy)
+            count++;
+    }
+
+    qcanStreamPutVarint(payload, count);
+
+    for (int i = 0; i < m_Signals.size(); i++) {
+        if (!m_Signals[i].proxy)
+            continue;
+
+        qcanStreamPutVarint(payload, i - last);
+        last = i;
+    }
+
+    qcanStreamPutMessage(message, QCAN_STREAM_SUBSCRIBE, payload);
+    m_Socket.write(message);
+}
+
+void QCanStreamClient::readyRead()
+{
+    QByteArray data = m_Socket.readAll();
+
+    m_BytesReceived += data.size();
+    m_Buffer.append(data);
+
+    for (;;) {
+        const quint8 *payload, *end;
+        quint8 type;
+        int size = qcanStreamGetMessage(m_Buffer, type, payload, end);
+
+        if (size == 0)
+            return;
+
+        if (size < 0 || !processMessage(type, payload, end)) {
+            qWarning("Corrupt stream from %s", qPrintable(m_Socket.peerName()));
+            m_Socket.abort();
+            m_Buffer.clear();
+            return;
+        }
+
+        m_Buffer.remove(0, size);
+    }
+}
+
+bool QCanStreamClient::processMessage(quint8 type, const quint8 *p, const quint8 *end)
+{
+    switch (type) {
+    case QCAN_STREAM_DICTIONARY:
+        return processDictionary(p, end);
+    case QCAN_STREAM_UPDATE:
+        return m_HasDictionary && processUpdate(p, end);
+    default:
+        // Unknown messages are ignored for compatibility
+        return true;
+    }
+}
+
+bool QCanStreamClient::processDictionary(const quint8 *p, const quint8 *end)
+{
+    quint64 version, count;
+
+    if (m_HasDictionary)
+        return false;
+
+    if (!(p = qcanRecordGetVarint(p, end, version)) || version != QCAN_STREAM_VERSION)
+        return false;
+
+    if (!(p = qcanRecordGetVarint(p, end, count)))
+        return false;
+
+    for (quint64 i = 0; i < count; i++) {
+        SignalInfo info;
+        quint64 size, length;
+
+        if (!(p = qcanRecordGetVarint(p, end, size)) || (quint64)(end - p) < size)
+            return false;
+
+        info.name = QString::fromUtf8(reinterpret_cast<const char *>(p), size);
+        p += size;
+
+        if (!(p = qcanRecordGetVarint(p, end, length)) || length < 1 || length > 64 || p >= end)
+            return false;
+
+        info.length = length;
+        info.isSigned = *p++ != 0;
+
+        if (!(p = qcanStreamGetDouble(p, end, info.slope)) ||
+            !(p = qcanStreamGetDouble(p, end, info.intercept)) ||
+            !(p = qcanStreamGetDouble(p, end, info.lower)) ||
+            !(p = qcanStreamGetDouble(p, end, info.upper)))
+            return false;
+
+        info.rawValue = 0;
+        info.proxy = NULL;
+
+        m_Index.insert(info.name, m_Signals.size());
+        m_Signals.push_back(info);
+    }
+
+    m_HasDictionary = true;
+
+    return true;
+}
+
+bool QCanStreamClient::processUpdate(const quint8 *p, const quint8 *end)
+{
+    quint64 delta, count;
+    int index = 0;
+
+    if (!(p = qcanRecordGetVarint(p, end, delta)) || !(p = qcanRecordGetVarint(p, end, count)))
+        return false;
+
+    m_Timestamp_us += qcanRecordUnZigZag(delta);
+
+    for (quint64 i = 0; i < count; i++) {
+        quint64 indexDelta, rawDelta, timeDelta;
+
+        if (!(p = qcanRecordGetVarint(p, end, indexDelta)) ||
+            !(p = qcanRecordGetVarint(p, end, rawDelta)) ||
+            !(p = qcanRecordGetVarint(p, end, timeDelta)))
+            return false;
+
+        index += indexDelta;
+
+        if (index >= m_Signals.size())
+            return false;
+
+        SignalInfo & info = m_Signals[index];
+
+        info.rawValue += qcanRecordUnZigZag(rawDelta);
+
+        QCanStreamSignal *s = info.proxy;
+
+        if (!s)
+            continue;
+
+        const quint64 timestamp = m_Timestamp_us + qcanRecordUnZigZag(timeDelta);
+        struct timeval tv;
+
+        tv.tv_sec = timestamp / 1000000;
+        tv.tv_usec = timestamp % 1000000;
+
+        s->m_RawValue = info.rawValue;
+        s->m_PhysicalValue = rawToPhysical(info, info.rawValue);
+
+        emit s->valueChanged(tv, s->m_PhysicalValue);
+        emit s->valueHasChanged();
+    }
+
+    return true;
+}
+
+double QCanStreamClient::rawToPhysical(const SignalInfo & info, quint64 value) const
+{
+    double physicalValue;
+
+    // Convert from 2s complement
+    if (info.isSigned && (value & (Q_UINT64_C(1) << (info.length - 1)))) {
+        qint64 tmp = info.length < 64 ? (qint64)(value | (~Q_UINT64_C(0) << info.length)) : (qint64)value;
+        physicalValue = (tmp * info.slope) + info.intercept;
+    }
+    else {
+        physicalValue = (value * info.slope) + info.intercept;
+    }
+
+    if (physicalValue < info.lower)
+        physicalValue = info.lower;
+
+    if (physicalValue > info.upper)
+        physicalValue = info.upper;
+
+    return physicalValue;
+}
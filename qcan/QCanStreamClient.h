@@ -0,0 +1,150 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSTREAMCLIENT_H_
+#define QCANSTREAMCLIENT_H_
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QByteArray>
+#include <QTcpSocket>
+
+#include <sys/time.h>
+
+class QCanStreamClient;
+
+/**
+ * Streamed signal with the notification interface of QCanSignal, so it can be
+ * used by QML bindings and QRealtimePlotter.
+ */
+class QCanStreamSignal : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(double value
+               READ getPhysicalValue
+               NOTIFY valueHasChanged);
+
+signals:
+    void valueChanged(const struct timeval & val, double value);
+    void valueHasChanged();
+
+public:
+    double getPhysicalValue() const { return m_PhysicalValue; }
+    quint64 getRawValue() const { return m_RawValue; }
+
+    const QString & getName() const { return m_Name; }
+
+    void getLimit(double & lower, double & upper) const {
+        lower = m_Lower;
+        upper = m_Upper;
+    }
+
+private:
+    friend class QCanStreamClient;
+
+    QCanStreamSignal(QCanStreamClient *client, const QString & name, double lower, double upper);
+
+    const QString m_Name;
+    const double m_Lower;
+    const double m_Upper;
+
+    quint64 m_RawValue;
+    double m_PhysicalValue;
+};
+
+/**
+ * Receives signal values streamed by QCanStreamServer. Only signals requested
+ * by getSignal() are subscribed.
+ */
+class QCanStreamClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    QCanStreamClient(QObject *parent = NULL);
+    ~QCanStreamClient();
+
+    /**
+     * Connect to a server and wait for its signal dictionary
+     * @param timeout_ms maximum time to wait
+     */
+    bool connectToServer(const QString & host, quint16 port, int timeout_ms = 3000);
+    void disconnectFromServer();
+
+    bool isConnected() const { return m_Socket.state() == QAbstractSocket::ConnectedState && m_HasDictionary; }
+
+    int getSignalCount() const { return m_Signals.size(); }
+
+    /// Name of a signal, "<bus>.<message>.<signal>"
+    QString getSignalName(int index) const;
+
+    /// @return index of a signal or -1 if unknown
+    int indexOf(const QString & name) const { return m_Index.value(name, -1); }
+
+    /**
+     * Get notifying signal object and subscribe to it, created on first use
+     * and owned by the client
+     * @param name "<bus>.<message>.<signal>"
+     */
+    QCanStreamSignal * getSignal(const QString & name);
+
+    quint64 getBytesReceived() const { return m_BytesReceived; }
+
+private slots:
+    void readyRead();
+
+private:
+    struct SignalInfo {
+        QString name;
+        int length;
+        bool isSigned;
+        double slope;
+        double intercept;
+        double lower;
+        double upper;
+
+        quint64 rawValue;
+        QCanStreamSignal *proxy;
+    };
+
+    bool processMessage(quint8 type, const quint8 *p, const quint8 *end);
+    bool processDictionary(const quint8 *p, const quint8 *end);
+    bool processUpdate(const quint8 *p, const quint8 *end);
+
+    /// Same conversion as QCanSignal
+    double rawToPhysical(const SignalInfo & info, quint64 raw) const;
+
+    void subscribe();
+
+    QTcpSocket m_Socket;
+    QByteArray m_Buffer;
+
+    bool m_HasDictionary;
+    QVector<SignalInfo> m_Signals;
+    QHash<QString, int> m_Index;
+
+    quint64 m_Timestamp_us;
+    quint64 m_BytesReceived;
+};
+
+#endif /* QCANSTREAMCLIENT_H_ */
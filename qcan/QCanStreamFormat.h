@@ -0,0 +1,141 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSTREAMFORMAT_H_
+#define QCANSTREAMFORMAT_H_
+
+#include <QtGlobal>
+#include <QByteArray>
+
+#include <string.h>
+#include <endian.h>
+
+#include "QCanRecordFormat.h"
+
+/*
+ * Signal streaming protocol used by QCanStreamServer and QCanStreamClient.
+ *
+ * Every message is prefixed by its size as varint followed by a type byte.
+ * Integers are varints (see QCanRecordFormat.h), signed values are zigzag
+ * encoded, doubles are 8 bytes little endian IEEE-754, strings are a varint
+ * size followed by UTF-8.
+ *
+ * Server to client:
+ *   DICTIONARY  varint version, varint count, per signal:
+ *               string name, varint length, quint8 signed,
+ *               double slope, double intercept, double lower, double upper
+ *   UPDATE      zigzag timestamp delta in us to the previous update,
+ *               varint count, per changed signal (ascending index):
+ *               varint index delta to the previous entry,
+ *               zigzag raw value delta to the last value sent for the signal,
+ *               zigzag timestamp of the change relative to the update
+ *
+ * Client to server:
+ *   SUBSCRIBE   varint count, varint index deltas (ascending), replaces the
+ *               current subscription. The current value of newly subscribed
+ *               signals is sent with the next update.
+ */
+
+#define QCAN_STREAM_VERSION        1
+
+#define QCAN_STREAM_DICTIONARY     1
+#define QCAN_STREAM_UPDATE         2
+#define QCAN_STREAM_SUBSCRIBE      3
+
+/// Upper bound of the message size prefix and type
+#define QCAN_STREAM_HEADER_SIZE    (10 + 1)
+
+static inline void qcanStreamPutVarint(QByteArray & buffer, quint64 value)
+{
+    quint8 tmp[10];
+
+    buffer.append(reinterpret_cast<const char *>(tmp), qcanRecordPutVarint(tmp, value) - tmp);
+}
+
+static inline void qcanStreamPutDouble(QByteArray & buffer, double value)
+{
+    quint64 bits;
+
+    ::memcpy(&bits, &value, sizeof(bits));
+    bits = htole64(bits);
+    buffer.append(reinterpret_cast<const char *>(&bits), sizeof(bits));
+}
+
+static inline void qcanStreamPutString(QByteArray & buffer, const QByteArray & value)
+{
+    qcanStreamPutVarint(buffer, value.size());
+    buffer.append(value);
+}
+
+/// @return NULL if the value exceeds end
+static inline const quint8 *qcanStreamGetDouble(const quint8 *p, const quint8 *end, double & value)
+{
+    quint64 bits;
+
+    if (end - p < (int)sizeof(bits))
+        return NULL;
+
+    ::memcpy(&bits, p, sizeof(bits));
+    bits = le64toh(bits);
+    ::memcpy(&value, &bits, sizeof(value));
+
+    return p + sizeof(bits);
+}
+
+/// Wrap a payload into a message with size prefix and type
+static inline void qcanStreamPutMessage(QByteArray & buffer, quint8 type, const QByteArray & payload)
+{
+    qcanStreamPutVarint(buffer, payload.size() + 1);
+    buffer.append(static_cast<char>(type));
+    buffer.append(payload);
+}
+
+/**
+ * Split the next complete message off a receive buffer
+ * @return size of the message including its header, 0 if incomplete,
+ *         -1 if the buffer is corrupt
+ */
+static inline int qcanStreamGetMessage(const QByteArray & buffer, quint8 & type,
+                                       const quint8 *& payload, const quint8 *& payloadEnd)
+{
+    const quint8 *begin = reinterpret_cast<const quint8 *>(buffer.constData());
+    const quint8 *end = begin + buffer.size();
+    quint64 size;
+
+    const quint8 *p = qcanRecordGetVarint(begin, end, size);
+
+    if (!p)
+        return buffer.size() >= 10 ? -1 : 0;
+
+    if (size == 0 || size > (1 << 24))
+        return -1;
+
+    if ((quint64)(end - p) < size)
+        return 0;
+
+    type = *p;
+    payload = p + 1;
+    payloadEnd = p + size;
+
+    return payloadEnd - begin;
+}
+
+#endif /* QCANSTREAMFORMAT_H_ */
@@ -0,0 +1,317 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <sys/time.h>
+
+#include <QTcpSocket>
+
+#include "QCanStreamServer.h"
+#include "QCanStreamFormat.h"
+#include "QCanChannel.h"
+
+// Updates are skipped for clients which can't keep up
+#define MAX_PENDING_BYTES (1024 * 1024)
+
+QCanStreamServer::QCanStreamServer(QObject *parent)
+ : QObject(parent), m_BytesSent(0)
+{
+    m_UpdateTimer.setInterval(20);
+
+    QObject::connect(&m_Server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+    QObject::connect(&m_UpdateTimer, SIGNAL(timeout()), this, SLOT(sendUpdates()));
+}
+
+QCanStreamServer::~QCanStreamServer()
+{
+    close();
+
+    QHash<QCanSignalContainer*, int>::const_iterator iter;
+
+    for (iter = m_FirstSignal.constBegin(); iter != m_FirstSignal.constEnd(); ++iter)
+        iter.key()->removeObserver(this);
+
+    qDeleteAll(m_Signals);
+}
+
+void QCanStreamServer::addBus(const QString & bus, QCanSignals *canSignals)
+{
+    QCanSignalContainer *sc;
+
+    foreach(sc, canSignals->getMessageList()) {
+        QCanSignal *s;
+
+        m_FirstSignal.insert(sc, m_Signals.size());
+
+        foreach(s, sc->getSignalList()) {
+            SignalState *st = new SignalState;
+            QByteArray name = QString("%1.%2.%3").arg(bus).arg(sc->getName()).arg(s->getName()).toUtf8();
+            double lower, upper;
+
+            st->signal = s;
+            st->lastRaw = s->getRawValue();
+            st->changed.storeRelease(0);
+            st->timestamp_us.storeRelease(0);
+
+            m_Signals.push_back(st);
+
+            s->getLimit(lower, upper);
+
+            qcanStreamPutString(m_DictionaryEntries, name);
+            qcanStreamPutVarint(m_DictionaryEntries, s->getLength());
+            m_DictionaryEntries.append(static_cast<char>(s->isSigned() ? 1 : 0));
+            qcanStreamPutDouble(m_DictionaryEntries, s->getSlope());
+            qcanStreamPutDouble(m_DictionaryEntries, s->getIntercept());
+            qcanStreamPutDouble(m_DictionaryEntries, lower);
+            qcanStreamPutDouble(m_DictionaryEntries, upper);
+        }
+
+        sc->addObserver(this);
+    }
+}
+
+bool QCanStreamServer::listen(quint16 port, const QHostAddress & address)
+{
+    QByteArray payload;
+
+    qcanStreamPutVarint(payload, QCAN_STREAM_VERSION);
+    qcanStreamPutVarint(payload, m_Signals.size());
+    payload.append(m_DictionaryEntries);
+
+    m_Dictionary.clear();
+    qcanStreamPutMessage(m_Dictionary, QCAN_STREAM_DICTIONARY, payload);
+
+    if (!m_Server.listen(address, port))
+        return false;
+
+    m_UpdateTimer.start();
+
+    return true;
+}
+
+void QCanStreamServer::close()
+{
+    m_UpdateTimer.stop();
+    m_Server.close();
+
+    QHash<QTcpSocket*, Client*>::iterator iter;
+
+    for (iter = m_Clients.begin(); iter != m_Clients.end(); ++iter) {
+        iter.key()->disconnect(this);
+        iter.key()->abort();
+        iter.key()->deleteLater();
+        delete iter.value();
+    }
+
+    m_Clients.clear();
+}
+
+void QCanStreamServer::messageDispatched(QCanSignalContainer *message, const QCanMessage & frame)
+{
+    QHash<QCanSignalContainer*, int>::const_iterator found = m_FirstSignal.constFind(message);
+
+    if (found == m_FirstSignal.constEnd())
+        return;
+
+    const quint64 timestamp = (quint64)frame.tv.tv_sec * 1000000 + frame.tv.tv_usec;
+    const int count = message->getSignalList().size();
+
+    for (int i = 0; i < count; i++) {
+        SignalState *st = m_Signals[found.value() + i];
+        const quint64 raw = st->signal->getRawValue();
+
+        // The first decode is always sent, it may match the initial raw value
+        if (raw == st->lastRaw && st->timestamp_us.load())
+            continue;
+
+        st->lastRaw = raw;
+        st->timestamp_us.storeRelease(timestamp);
+        st->changed.storeRelease(1);
+    }
+}
+
+void QCanStreamServer::newConnection()
+{
+    QTcpSocket *socket;
+
+    while ((socket = m_Server.nextPendingConnection()) != NULL) {
+        Client *client = new Client;
+
+        client->socket = socket;
+        client->subscribed.fill(false, m_Signals.size());
+        client->pending.fill(false, m_Signals.size());
+        client->lastRaw.fill(0, m_Signals.size());
+        client->lastTimestamp_us = 0;
+
+        // Latency matters more than packet count for live values
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        m_Clients.insert(socket, client);
+
+        QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(clientReadyRead()));
+        QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+
+        socket->write(m_Dictionary);
+        m_BytesSent += m_Dictionary.size();
+    }
+}
+
+void QCanStreamServer::clientDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    Client *client = m_Clients.take(socket);
+
+    if (!client)
+        return;
+
+    socket->deleteLater();
+    delete client;
+}
+
+void QCanStreamServer::clientReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    Client *client = m_Clients.value(socket, NULL);
+
+    if (!client)
+        return;
+
+    client->buffer.append(socket->readAll());
+
+    for (;;) {
+        const quint8 *payload, *end;
+        quint8 type;
+        int size = qcanStreamGetMessage(client->buffer, type, payload, end);
+
+        if (size < 0) {
+            socket->abort();
+            return;
+        }
+
+        if (size == 0)
+            return;
+
+        processMessage(client, type, payload, end);
+        client->buffer.remove(0, size);
+    }
+}
+
+void QCanStreamServer::processMessage(Client *client, quint8 type, const quint8 *p, const quint8 *end)
+{
+    if (type != QCAN_STREAM_SUBSCRIBE)
+        return;
+
+    QVector<bool> subscribed(m_Signals.size(), false);
+    quint64 count, delta, index = 0;
+
+    if (!(p = qcanRecordGetVarint(p, end, count)))
+        return;
+
+    for (quint64 i = 0; i < count; i++) {
+        if (!(p = qcanRecordGetVarint(p, end, delta)))
+            return;
+
+        index += delta;
+
+        if (index >= (quint64)m_Signals.size())
+            return;
+
+        subscribed[index] = true;
+    }
+
+    for (int i = 0; i < m_Signals.size(); i++) {
+        // Send current value of new subscriptions
+        client->pending[i] = subscribed[i] && (client->pending[i] || !client->subscribed[i]);
+    }
+
+    client->subscribed = subscribed;
+}
+
+void QCanStreamServer::sendUpdates()
+{
+    for (int i = 0; i < m_Signals.size(); i++) {
+        if (!m_Signals[i]->changed.fetchAndStoreAcquire(0))
+            continue;
+
+        QHash<QTcpSocket*, Client*>::iterator iter;
+
+        for (iter = m_Clients.begin(); iter != m_Clients.end(); ++iter) {
+            if (iter.value()->subscribed[i])
+                iter.value()->pending[i] = true;
+        }
+    }
+
+    QHash<QTcpSocket*, Client*>::iterator iter;
+
+    for (iter = m_Clients.begin(); iter != m_Clients.end(); ++iter)
+        sendUpdate(iter.value());
+}
+
+void QCanStreamServer::sendUpdate(Client *client)
+{
+    if (client->socket->bytesToWrite() > MAX_PENDING_BYTES)
+        return;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    const quint64 now = (quint64)tv.tv_sec * 1000000 + tv.tv_usec;
+    int count = 0;
+    int last = 0;
+
+    m_Payload.clear();
+
+    for (int i = 0; i < m_Signals.size(); i++) {
+        if (!client->pending[i])
+            continue;
+
+        const quint64 timestamp = m_Signals[i]->timestamp_us.loadAcquire();
+
+        client->pending[i] = false;
+
+        // Not decoded yet, the first change marks it pending again
+        if (!timestamp)
+            continue;
+
+        const quint64 raw = m_Signals[i]->signal->getRawValue();
+
+        qcanStreamPutVarint(m_Payload, i - last);
+        qcanStreamPutVarint(m_Payload, qcanRecordZigZag((qint64)(raw - client->lastRaw[i])));
+        qcanStreamPutVarint(m_Payload, qcanRecordZigZag((qint64)(timestamp - now)));
+
+        client->lastRaw[i] = raw;
+        last = i;
+        count++;
+    }
+
+    if (!count)
+        return;
+
+    QByteArray header;
+
+    qcanStreamPutVarint(header, qcanRecordZigZag((qint64)(now - client->lastTimestamp_us)));
+    qcanStreamPutVarint(header, count);
+    client->lastTimestamp_us = now;
+
+    m_Message.clear();
+    qcanStreamPutMessage(m_Message, QCAN_STREAM_UPDATE, header + m_Payload);
+
+    client->socket->write(m_Message);
+    m_BytesSent += m_Message.size();
+}
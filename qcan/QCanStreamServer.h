@@ -0,0 +1,118 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANSTREAMSERVER_H_
+#define QCANSTREAMSERVER_H_
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QByteArray>
+#include <QTimer>
+#include <QTcpServer>
+#include <QHostAddress>
+#include <QAtomicInteger>
+
+#include "QCanSignals.h"
+
+class QTcpSocket;
+
+/**
+ * Streams decoded signal values to remote QCanStreamClient instances over
+ * TCP, see QCanStreamFormat.h for the protocol.
+ *
+ * Changes are detected on the decoding thread, the server sends the changed
+ * values of subscribed signals as raw value deltas at a fixed update
+ * interval. Sockets are served by the thread owning the server.
+ */
+class QCanStreamServer : public QObject, public QCanMessageObserver
+{
+    Q_OBJECT
+
+public:
+    QCanStreamServer(QObject *parent = NULL);
+    ~QCanStreamServer();
+
+    /**
+     * Add all signals of a bus, must be called before listen()
+     * @param bus bus name used as first part of the signal names
+     */
+    void addBus(const QString & bus, QCanSignals *canSignals);
+
+    bool listen(quint16 port, const QHostAddress & address = QHostAddress::Any);
+    void close();
+
+    /// Interval between two updates in ms (default: 20)
+    void setUpdateInterval(int interval_ms) { m_UpdateTimer.setInterval(interval_ms); }
+
+    int getClientCount() const { return m_Clients.size(); }
+    quint64 getBytesSent() const { return m_BytesSent; }
+
+    void messageDispatched(QCanSignalContainer *message, const QCanMessage & frame);
+
+private slots:
+    void newConnection();
+    void clientReadyRead();
+    void clientDisconnected();
+    void sendUpdates();
+
+private:
+    struct SignalState {
+        QCanSignal *signal;
+
+        // Written by the decoding thread
+        quint64 lastRaw;
+        QAtomicInt changed;
+        QAtomicInteger<quint64> timestamp_us;
+    };
+
+    struct Client {
+        QTcpSocket *socket;
+        QByteArray buffer;
+
+        QVector<bool> subscribed;
+        QVector<bool> pending;
+        QVector<quint64> lastRaw;
+        quint64 lastTimestamp_us;
+    };
+
+    void processMessage(Client *client, quint8 type, const quint8 *p, const quint8 *end);
+    void sendUpdate(Client *client);
+
+    QVector<SignalState*> m_Signals;
+    QByteArray m_DictionaryEntries;
+    QByteArray m_Dictionary;
+
+    // Index of the first signal of each message
+    QHash<QCanSignalContainer*, int> m_FirstSignal;
+
+    QTcpServer m_Server;
+    QHash<QTcpSocket*, Client*> m_Clients;
+
+    QTimer m_UpdateTimer;
+    quint64 m_BytesSent;
+
+    // Reused encode buffers
+    QByteArray m_Payload;
+    QByteArray m_Message;
+};
+
+#endif /* QCANSTREAMSERVER_H_ */
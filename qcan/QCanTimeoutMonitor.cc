@@ -0,0 +1,213 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+#include <time.h>
+
+#include "QCanTimeoutMonitor.h"
+#include "QCanChannel.h"
+
+static quint64 _now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (quint64)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+QCanTimeoutMonitor::QCanTimeoutMonitor(quint32 resolution_ms, QObject *parent)
+ : QObject(parent), m_Resolution_ms(resolution_ms ? resolution_ms : 1),
+   m_Start_ms(0), m_IsRunning(false)
+{
+    m_Timer.setTimerType(Qt::PreciseTimer);
+
+    QObject::connect(&m_Timer, SIGNAL(timeout()), this, SLOT(checkTimeouts()));
+}
+
+QCanTimeoutMonitor::~QCanTimeoutMonitor()
+{
+    Stop();
+
+    Entry *e;
+    foreach(e, m_Entries) {
+        e->message->removeObserver(this);
+        delete e;
+    }
+}
+
+bool QCanTimeoutMonitor::addMessage(QCanSignalContainer *message, quint32 timeout_ms)
+{
+    if (m_IsRunning || m_EntryMap.contains(message))
+        return false;
+
+    if (timeout_ms == 0)
+        timeout_ms = 3 * message->getInterval();
+
+    if (timeout_ms == 0)
+        return false;
+
+    Entry *e = new Entry();
+
+    e->message = message;
+    e->timeout_ticks = (timeout_ms + m_Resolution_ms - 1) / m_Resolution_ms;
+    memset(&e->last, 0, sizeof(e->last));
+    memset(&e->timing, 0, sizeof(e->timing));
+
+    m_Entries.push_back(e);
+    m_EntryMap.insert(message, e);
+
+    message->addObserver(this);
+
+    return true;
+}
+
+int QCanTimeoutMonitor::addMessages(QCanSignals *canSignals)
+{
+    int count = 0;
+
+    QCanSignalContainer *sc;
+    foreach(sc, canSignals->getMessageList()) {
+        if (sc->getInterval() && addMessage(sc))
+            count++;
+    }
+
+    return count;
+}
+
+quint64 QCanTimeoutMonitor::currentTick() const
+{
+    return (_now_ms() - m_Start_ms) / m_Resolution_ms;
+}
+
+void QCanTimeoutMonitor::Start()
+{
+    QMutexLocker locker(&m_Lock);
+    Entry *e;
+
+    foreach(e, m_Entries)
+        m_Wheel.cancel(e);
+
+    m_Start_ms = _now_ms();
+    m_Wheel = QCanTimingWheel(0);
+
+    // Messages never received time out after their first timeout period
+    foreach(e, m_Entries)
+        m_Wheel.schedule(e, e->timeout_ticks);
+
+    m_IsRunning = true;
+    m_Timer.start(m_Resolution_ms);
+}
+
+void QCanTimeoutMonitor::Stop()
+{
+    QMutexLocker locker(&m_Lock);
+
+    m_Timer.stop();
+    m_IsRunning = false;
+
+    Entry *e;
+    foreach(e, m_Entries)
+        m_Wheel.cancel(e);
+}
+
+bool QCanTimeoutMonitor::getTiming(QCanSignalContainer *message, QCanMessageTiming & timing) const
+{
+    QMutexLocker locker(&m_Lock);
+    Entry *e = m_EntryMap.value(message, NULL);
+
+    if (!e)
+        return false;
+
+    timing = e->timing;
+
+    return true;
+}
+
+void QCanTimeoutMonitor::messageDispatched(QCanSignalContainer *message, const QCanMessage & frame)
+{
+    Entry *e = m_EntryMap.value(message, NULL);
+    bool recovered = false;
+
+    if (!e)
+        return;
+
+    m_Lock.lock();
+
+    if (!m_IsRunning) {
+        m_Lock.unlock();
+        return;
+    }
+
+    m_Wheel.schedule(e, currentTick() + e->timeout_ticks);
+
+    QCanMessageTiming & t = e->timing;
+
+    if (t.count > 0) {
+        double period = (frame.tv.tv_sec - e->last.tv_sec) * 1000.0 +
+                        (frame.tv.tv_usec - e->last.tv_usec) / 1000.0;
+        double deviation = period - message->getInterval();
+        quint64 n = t.count;
+
+        if (n == 1 || period < t.minPeriod_ms)
+            t.minPeriod_ms = period;
+
+        if (n == 1 || period > t.maxPeriod_ms)
+            t.maxPeriod_ms = period;
+
+        t.lastPeriod_ms = period;
+        t.meanPeriod_ms += (period - t.meanPeriod_ms) / n;
+        t.jitter_ms += ((deviation < 0 ? -deviation : deviation) - t.jitter_ms) / n;
+    }
+
+    t.count++;
+    e->last = frame.tv;
+
+    if (t.isTimedOut) {
+        t.isTimedOut = false;
+        recovered = true;
+    }
+
+    m_Lock.unlock();
+
+    if (recovered)
+        emit messageRecovered(message);
+}
+
+void QCanTimeoutMonitor::checkTimeouts()
+{
+    m_Lock.lock();
+
+    m_Expired.clear();
+    m_Wheel.advance(currentTick(), m_Expired);
+
+    for (int i = 0; i < m_Expired.size(); i++) {
+        Entry *e = static_cast<Entry *>(m_Expired[i]);
+
+        e->timing.isTimedOut = true;
+        e->timing.timeouts++;
+    }
+
+    m_Lock.unlock();
+
+    // Entries stay valid, they are only deleted by the destructor
+    for (int i = 0; i < m_Expired.size(); i++)
+        emit messageTimeout(static_cast<Entry *>(m_Expired[i])->message);
+}
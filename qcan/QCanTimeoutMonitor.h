@@ -0,0 +1,133 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANTIMEOUTMONITOR_H_
+#define QCANTIMEOUTMONITOR_H_
+
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+
+#include "QCanSignals.h"
+#include "QCanTimingWheel.h"
+
+/**
+ * Reception timing of a monitored message. Periods are measured between
+ * frame timestamps, jitter is the mean absolute deviation from the
+ * nominal interval.
+ */
+struct QCanMessageTiming
+{
+    quint64 count;
+    quint32 timeouts;
+    bool isTimedOut;
+
+    double lastPeriod_ms;
+    double minPeriod_ms;
+    double maxPeriod_ms;
+    double meanPeriod_ms;
+    double jitter_ms;
+};
+
+/**
+ * Monitors cyclic messages and reports if they stop arriving.
+ *
+ * Every dispatched frame re-arms a deadline of timeout_ms in a hierarchical
+ * timing wheel, so the cost per frame is O(1) independent of the number of
+ * monitored messages. Expired deadlines are collected by a timer of the
+ * thread owning the monitor.
+ */
+class QCanTimeoutMonitor : public QObject, public QCanMessageObserver
+{
+    Q_OBJECT
+
+signals:
+    /// Message was not received within its timeout
+    void messageTimeout(QCanSignalContainer *message);
+
+    /// Message is received again after a timeout
+    void messageRecovered(QCanSignalContainer *message);
+
+public:
+    /**
+     * @param resolution_ms granularity of timeout detection
+     */
+    QCanTimeoutMonitor(quint32 resolution_ms = 5, QObject *parent = NULL);
+    ~QCanTimeoutMonitor();
+
+    /**
+     * Monitor a message, must be called before Start()
+     * @param timeout_ms timeout, 0 uses three times the KCD interval
+     * @return false if no timeout could be determined
+     */
+    bool addMessage(QCanSignalContainer *message, quint32 timeout_ms = 0);
+
+    /**
+     * Monitor all messages with a KCD interval
+     * @return number of added messages
+     */
+    int addMessages(QCanSignals *canSignals);
+
+    void Start();
+    void Stop();
+
+    /**
+     * Read reception timing of a message. May be called from any thread.
+     * @return false if message is not monitored
+     */
+    bool getTiming(QCanSignalContainer *message, QCanMessageTiming & timing) const;
+
+    virtual void messageDispatched(QCanSignalContainer *message, const QCanMessage & frame);
+
+private slots:
+    void checkTimeouts();
+
+private:
+    struct Entry : public QCanTimer {
+        QCanSignalContainer *message;
+
+        quint64 timeout_ticks;
+        struct timeval last;
+
+        QCanMessageTiming timing;
+    };
+
+    quint64 currentTick() const;
+
+    const quint32 m_Resolution_ms;
+    quint64 m_Start_ms;
+    bool m_IsRunning;
+
+    QVector<Entry*> m_Entries;
+    QHash<QCanSignalContainer*, Entry*> m_EntryMap;
+
+    // Protects the wheel and all entries, frames may be dispatched
+    // by a receive thread
+    mutable QMutex m_Lock;
+    QCanTimingWheel m_Wheel;
+    QVector<QCanTimer*> m_Expired;
+
+    QTimer m_Timer;
+};
+
+#endif /* QCANTIMEOUTMONITOR_H_ */
@@ -0,0 +1,172 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+
+#include "QCanTimingWheel.h"
+
+QCanTimingWheel::QCanTimingWheel(quint64 now)
+ : m_Current(now), m_Count(0)
+{
+    ::memset(m_Slots, 0, sizeof(m_Slots));
+}
+
+void QCanTimingWheel::insert(QCanTimer *timer)
+{
+    quint64 delta = timer->m_Expiry - m_Current;
+    int level = 0;
+
+    // Timers beyond the last level are kept there and re-inserted
+    // every time their slot is cascaded
+    while (level < WHEEL_LEVELS - 1 && delta >= (Q_UINT64_C(1) << (WHEEL_BITS * (level + 1))))
+        level++;
+
+    int slot = level * WHEEL_SIZE + ((timer->m_Expiry >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+    timer->m_Slot = slot;
+    timer->m_Prev = NULL;
+    timer->m_Next = m_Slots[slot];
+
+    if (timer->m_Next)
+        timer->m_Next->m_Prev = timer;
+
+    m_Slots[slot] = timer;
+}
+
+void QCanTimingWheel::cascade(int level)
+{
+    int slot = level * WHEEL_SIZE + ((m_Current >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    QCanTimer *timer = m_Slots[slot];
+
+    m_Slots[slot] = NULL;
+
+    while (timer) {
+        QCanTimer *next = timer->m_Next;
+
+        insert(timer);
+        timer = next;
+    }
+}
+
+void QCanTimingWheel::schedule(QCanTimer *timer, quint64 expiry)
+{
+    cancel(timer);
+
+    // Expired timers are put into the next slot to be visited
+    if (expiry <= m_Current)
+        expiry = m_Current + 1;
+
+    timer->m_Expiry = expiry;
+    insert(timer);
+
+    m_Count++;
+}
+
+void QCanTimingWheel::cancel(QCanTimer *timer)
+{
+    if (timer->m_Slot < 0)
+        return;
+
+    if (timer->m_Prev)
+        timer->m_Prev->m_Next = timer->m_Next;
+    else
+        m_Slots[timer->m_Slot] = timer->m_Next;
+
+    if (timer->m_Next)
+        timer->m_Next->m_Prev = timer->m_Prev;
+
+    timer->m_Next = NULL;
+    timer->m_Prev = NULL;
+    timer->m_Slot = -1;
+
+    m_Count--;
+}
+
+void QCanTimingWheel::advance(quint64 now, QVector<QCanTimer*> & expired)
+{
+    while (m_Current < now) {
+        if (m_Count == 0) {
+            m_Current = now;
+            break;
+        }
+
+        m_Current++;
+
+        // Entering a new slot of an upper level moves its timers down
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if (m_Current & ((Q_UINT64_C(1) << (WHEEL_BITS * level)) - 1))
+                break;
+
+            cascade(level);
+        }
+
+        QCanTimer *timer = m_Slots[m_Current & WHEEL_MASK];
+
+        while (timer) {
+            QCanTimer *next = timer->m_Next;
+
+            cancel(timer);
+            expired.push_back(timer);
+
+            timer = next;
+        }
+    }
+}
+
+bool QCanTimingWheel::getNextExpiry(quint64 & expiry) const
+{
+    bool found = false;
+
+    if (m_Count == 0)
+        return false;
+
+    // Level 0 slots hold exactly one tick, the first used one is the earliest
+    for (quint64 i = 1; i < WHEEL_SIZE; i++) {
+        if (m_Slots[(m_Current + i) & WHEEL_MASK]) {
+            expiry = m_Current + i;
+            found = true;
+            break;
+        }
+    }
+
+    // Upper levels may hold timers scheduled earlier which expire before that,
+    // check the first used slot of every level
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        quint64 index = m_Current >> (WHEEL_BITS * level);
+
+        for (quint64 i = 1; i <= WHEEL_SIZE; i++) {
+            const QCanTimer *timer = m_Slots[level * WHEEL_SIZE + ((index + i) & WHEEL_MASK)];
+
+            if (!timer)
+                continue;
+
+            for (; timer; timer = timer->m_Next) {
+                if (!found || timer->m_Expiry < expiry) {
+                    expiry = timer->m_Expiry;
+                    found = true;
+                }
+            }
+
+            break;
+        }
+    }
+
+    return found;
+}
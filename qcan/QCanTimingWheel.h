@@ -0,0 +1,114 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANTIMINGWHEEL_H_
+#define QCANTIMINGWHEEL_H_
+
+#include <QVector>
+
+/**
+ * Timer entry managed by a QCanTimingWheel. Embed it into the object which
+ * has to be notified, the wheel never allocates memory for its entries.
+ */
+class QCanTimer
+{
+public:
+    QCanTimer() : m_Expiry(0), m_Next(NULL), m_Prev(NULL), m_Slot(-1) {}
+
+    bool isArmed() const { return m_Slot >= 0; }
+
+    /// Tick the timer expires at
+    quint64 getExpiry() const { return m_Expiry; }
+
+private:
+    friend class QCanTimingWheel;
+
+    quint64 m_Expiry;
+
+    QCanTimer *m_Next;
+    QCanTimer *m_Prev;
+
+    int m_Slot;
+};
+
+/**
+ * Hierarchical timing wheel. Level 0 has one slot per tick, every further
+ * level covers 256 slots of the level below. Timers are moved down one
+ * level when the wheel reaches their slot, so scheduling, canceling and
+ * expiring a timer are O(1) no matter how many timers are armed.
+ *
+ * The wheel is not thread safe, all calls must be done by the same thread.
+ */
+class QCanTimingWheel
+{
+public:
+    /**
+     * @param now current tick
+     */
+    QCanTimingWheel(quint64 now = 0);
+
+    /**
+     * Arm or re-arm a timer. A timer expiring in the past expires on
+     * the next call to advance().
+     * @param timer timer to arm
+     * @param expiry absolute tick to expire at
+     */
+    void schedule(QCanTimer *timer, quint64 expiry);
+
+    /// Disarm timer, does nothing if it is not armed
+    void cancel(QCanTimer *timer);
+
+    /**
+     * Move the wheel forward and collect all expired timers
+     * @param now current tick
+     * @param expired receives expired (disarmed) timers, not cleared
+     */
+    void advance(quint64 now, QVector<QCanTimer*> & expired);
+
+    /**
+     * Find the tick of the next expiring timer
+     * @return false if no timer is armed
+     */
+    bool getNextExpiry(quint64 & expiry) const;
+
+    quint64 getCurrentTick() const { return m_Current; }
+
+    int getCount() const { return m_Count; }
+    bool isEmpty() const { return m_Count == 0; }
+
+private:
+    enum {
+        WHEEL_BITS = 8,
+        WHEEL_SIZE = 1 << WHEEL_BITS,
+        WHEEL_MASK = WHEEL_SIZE - 1,
+        WHEEL_LEVELS = 4
+    };
+
+    void insert(QCanTimer *timer);
+    void cascade(int level);
+
+    QCanTimer *m_Slots[WHEEL_LEVELS * WHEEL_SIZE];
+
+    quint64 m_Current;
+    int m_Count;
+};
+
+#endif /* QCANTIMINGWHEEL_H_ */
@@ -0,0 +1,214 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <time.h>
+
+#include <QFile>
+#include <QTextStream>
+
+#include "QCanTrace.h"
+
+QAtomicInt QCanTrace::s_Enabled(0);
+QAtomicInteger<quint64> QCanTrace::s_LastProperty_us(0);
+QCanLatencyHistogram QCanTrace::s_Histograms[QCanTrace::E_TRACE_NUM_STAGES];
+
+static const char *s_StageNames[QCanTrace::E_TRACE_NUM_STAGES] = {
+    "receive", "decode", "notify", "property", "render"
+};
+
+QCanLatencyHistogram::QCanLatencyHistogram()
+{
+    reset();
+}
+
+void QCanLatencyHistogram::reset()
+{
+    for (int i = 0; i < QCAN_TRACE_BUCKETS; i++)
+        m_Buckets[i].store(0);
+
+    m_Count.store(0);
+    m_Sum.store(0);
+    m_Min.store(~Q_UINT64_C(0));
+    m_Max.store(0);
+}
+
+int QCanLatencyHistogram::bucket(quint64 value_ns)
+{
+    if (value_ns < QCAN_TRACE_SUB_BUCKETS)
+        return value_ns;
+
+    const int msb = 63 - __builtin_clzll(value_ns);
+    const int shift = msb - QCAN_TRACE_SUB_BUCKET_BITS;
+
+    if (shift + 1 > QCAN_TRACE_MAGNITUDES)
+        return QCAN_TRACE_BUCKETS - 1;
+
+    return (shift + 1) * QCAN_TRACE_SUB_BUCKETS + (int)((value_ns >> shift) - QCAN_TRACE_SUB_BUCKETS);
+}
+
+quint64 QCanLatencyHistogram::bucketValue(int bucket)
+{
+    const int magnitude = bucket / QCAN_TRACE_SUB_BUCKETS;
+    const quint64 sub = bucket % QCAN_TRACE_SUB_BUCKETS;
+
+    if (magnitude == 0)
+        return sub;
+
+    return (QCAN_TRACE_SUB_BUCKETS + sub) << (magnitude - 1);
+}
+
+void QCanLatencyHistogram::add(quint64 value_ns)
+{
+    m_Buckets[bucket(value_ns)].fetchAndAddRelaxed(1);
+    m_Sum.fetchAndAddRelaxed(value_ns);
+    m_Count.fetchAndAddRelaxed(1);
+
+    quint64 current = m_Min.load();
+    while (value_ns < current && !m_Min.testAndSetRelaxed(current, value_ns, current))
+        ;
+
+    current = m_Max.load();
+    while (value_ns > current && !m_Max.testAndSetRelaxed(current, value_ns, current))
+        ;
+}
+
+quint64 QCanLatencyHistogram::getMin() const
+{
+    return getCount() ? m_Min.load() : 0;
+}
+
+double QCanLatencyHistogram::getMean() const
+{
+    const quint64 count = getCount();
+
+    return count ? (double)m_Sum.load() / count : 0.0;
+}
+
+quint64 QCanLatencyHistogram::percentile(double p) const
+{
+    const quint64 count = getCount();
+
+    if (!count)
+        return 0;
+
+    const quint64 rank = p >= 1.0 ? count : (quint64)(p * count) + 1;
+    quint64 cumulative = 0;
+
+    for (int i = 0; i < QCAN_TRACE_BUCKETS; i++) {
+        cumulative += m_Buckets[i].load();
+
+        // Highest value equivalent to the bucket
+        if (cumulative >= rank)
+            return qMin(bucketValue(i + 1) - 1, getMax());
+    }
+
+    return getMax();
+}
+
+void QCanTrace::record(stage_t stage, quint64 time_us)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    const quint64 now_ns = (quint64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    const quint64 time_ns = time_us * 1000;
+
+    if (stage == E_TRACE_PROPERTY)
+        s_LastProperty_us.store(time_us);
+
+    // Timestamps from another clock (e.g. replayed frames) are ignored
+    if (time_ns > now_ns || now_ns - time_ns > 60ULL * 1000000000ULL)
+        return;
+
+    s_Histograms[stage].add(now_ns - time_ns);
+}
+
+void QCanTrace::record(stage_t stage, const struct timeval & tv)
+{
+    record(stage, (quint64)tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+void QCanTrace::recordRendered()
+{
+    if (!isEnabled())
+        return;
+
+    // Every read value is accounted for the first frame showing it
+    const quint64 time_us = s_LastProperty_us.fetchAndStoreRelaxed(0);
+
+    if (time_us)
+        record(E_TRACE_RENDER, time_us);
+}
+
+const char * QCanTrace::getStageName(stage_t stage)
+{
+    return s_StageNames[stage];
+}
+
+void QCanTrace::reset()
+{
+    for (int i = 0; i < E_TRACE_NUM_STAGES; i++)
+        s_Histograms[i].reset();
+
+    s_LastProperty_us.store(0);
+}
+
+bool QCanTrace::dump(const QString & filename)
+{
+    QFile file(filename);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QTextStream out(&file);
+
+    out << "# stage count min mean p50 p90 p99 p99.9 max (us)\n";
+
+    for (int i = 0; i < E_TRACE_NUM_STAGES; i++) {
+        const QCanLatencyHistogram & h = s_Histograms[i];
+
+        out << s_StageNames[i] << " " << h.getCount()
+            << " " << h.getMin() / 1000.0
+            << " " << h.getMean() / 1000.0
+            << " " << h.percentile(0.5) / 1000.0
+            << " " << h.percentile(0.9) / 1000.0
+            << " " << h.percentile(0.99) / 1000.0
+            << " " << h.percentile(0.999) / 1000.0
+            << " " << h.getMax() / 1000.0 << "\n";
+    }
+
+    out << "\n# stage bucket_start_us count\n";
+
+    for (int i = 0; i < E_TRACE_NUM_STAGES; i++) {
+        const QCanLatencyHistogram & h = s_Histograms[i];
+
+        for (int b = 0; b < QCAN_TRACE_BUCKETS; b++) {
+            quint64 count = h.getBucketCount(b);
+
+            if (count)
+                out << s_StageNames[i] << " " << QCanLatencyHistogram::bucketValue(b) / 1000.0 << " " << count << "\n";
+        }
+    }
+
+    out.flush();
+
+    return file.error() == QFile::NoError;
+}
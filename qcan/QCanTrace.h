@@ -0,0 +1,127 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANTRACE_H_
+#define QCANTRACE_H_
+
+#include <QtGlobal>
+#include <QString>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+#include <sys/time.h>
+
+/**
+ * Latency histogram with logarithmic buckets, each power of two is split
+ * into linear sub-buckets (HDR histogram style). The relative error of a
+ * percentile is below 1 / QCAN_TRACE_SUB_BUCKETS. Values can be added from
+ * any number of threads without locking.
+ */
+#define QCAN_TRACE_SUB_BUCKET_BITS  4
+#define QCAN_TRACE_SUB_BUCKETS      (1 << QCAN_TRACE_SUB_BUCKET_BITS)
+#define QCAN_TRACE_MAGNITUDES       40
+#define QCAN_TRACE_BUCKETS          ((QCAN_TRACE_MAGNITUDES + 1) * QCAN_TRACE_SUB_BUCKETS)
+
+class QCanLatencyHistogram
+{
+public:
+    QCanLatencyHistogram();
+
+    void add(quint64 value_ns);
+    void reset();
+
+    quint64 getCount() const { return m_Count.load(); }
+    quint64 getMin() const;
+    quint64 getMax() const { return m_Max.load(); }
+    double getMean() const;
+
+    /// Value below which a fraction p of all values lies, p in [0, 1]
+    quint64 percentile(double p) const;
+
+    quint64 getBucketCount(int bucket) const { return m_Buckets[bucket].load(); }
+
+    static int bucket(quint64 value_ns);
+
+    /// Smallest value of a bucket
+    static quint64 bucketValue(int bucket);
+
+private:
+    QAtomicInteger<quint64> m_Buckets[QCAN_TRACE_BUCKETS];
+
+    QAtomicInteger<quint64> m_Count;
+    QAtomicInteger<quint64> m_Sum;
+    QAtomicInteger<quint64> m_Min;
+    QAtomicInteger<quint64> m_Max;
+};
+
+/**
+ * Optional tracepoints measuring the latency from the kernel receive
+ * timestamp of a frame to each stage of the processing pipeline.
+ *
+ * Tracing is disabled by default, a disabled tracepoint costs a relaxed
+ * load and a predicted branch.
+ */
+class QCanTrace
+{
+public:
+    typedef enum E_TRACE_STAGE {
+        E_TRACE_RECEIVE = 0,    ///< Frame read by the receive thread
+        E_TRACE_DECODE,         ///< Frame decoded by QCanSignals
+        E_TRACE_NOTIFY,         ///< valueHasChanged() emitted on the GUI thread
+        E_TRACE_PROPERTY,       ///< Value read through the QML property
+        E_TRACE_RENDER,         ///< Frame showing a read value was swapped
+        E_TRACE_NUM_STAGES
+    } stage_t;
+
+    static bool isEnabled() { return s_Enabled.load() != 0; }
+    static void setEnabled(bool enabled) { s_Enabled.store(enabled ? 1 : 0); }
+
+    /// Record the latency of a stage for a frame received at tv (wall clock)
+    static void record(stage_t stage, const struct timeval & tv);
+    static void record(stage_t stage, quint64 time_us);
+
+    /**
+     * Record E_TRACE_RENDER for the latest value read through a property,
+     * to be called when a frame was presented (e.g. QQuickWindow::frameSwapped)
+     */
+    static void recordRendered();
+
+    static const QCanLatencyHistogram & getHistogram(stage_t stage) { return s_Histograms[stage]; }
+    static const char * getStageName(stage_t stage);
+
+    static void reset();
+
+    /// Write percentiles and buckets of all stages as text
+    static bool dump(const QString & filename);
+
+private:
+    static QAtomicInt s_Enabled;
+    static QAtomicInteger<quint64> s_LastProperty_us;
+    static QCanLatencyHistogram s_Histograms[E_TRACE_NUM_STAGES];
+};
+
+#define QCAN_TRACE(stage, tv) \
+    do { \
+        if (Q_UNLIKELY(QCanTrace::isEnabled())) \
+            QCanTrace::record(QCanTrace::stage, tv); \
+    } while (0)
+
+#endif /* QCANTRACE_H_ */
@@ -0,0 +1,238 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/select.h>
+#include <sys/timerfd.h>
+
+#include "QCanTxScheduler.h"
+#include "QCanSignals.h"
+#include "QCanChannel.h"
+
+static quint64 _now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (quint64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+QCanTxScheduler::QCanTxScheduler(QCanChannel *channel, quint32 resolution_us)
+ : m_CanChannel(channel), m_Resolution_ns(resolution_us ? resolution_us * 1000ULL : 1000000ULL),
+   m_TerminationRequested(false)
+{
+    m_TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+}
+
+QCanTxScheduler::~QCanTxScheduler()
+{
+    Stop();
+
+    if (m_TimerFd >= 0)
+        close(m_TimerFd);
+
+    qDeleteAll(m_Entries);
+}
+
+bool QCanTxScheduler::addMessage(QCanSignalContainer *message, quint32 interval_ms)
+{
+    if (isRunning() || m_EntryMap.contains(message))
+        return false;
+
+    if (interval_ms == 0)
+        interval_ms = message->getInterval();
+
+    if (interval_ms == 0)
+        return false;
+
+    Entry *e = new Entry();
+
+    e->message = message;
+    e->interval_ns = interval_ms * 1000000ULL;
+    e->deadline_ns = 0;
+    memset(&e->stats, 0, sizeof(e->stats));
+
+    m_Entries.push_back(e);
+    m_EntryMap.insert(message, e);
+
+    message->setScheduled(true);
+
+    return true;
+}
+
+int QCanTxScheduler::addMessages(QCanSignals *canSignals)
+{
+    int count = 0;
+
+    QCanSignalContainer *sc;
+    foreach(sc, canSignals->getMessageList()) {
+        if (sc->getInterval() && addMessage(sc))
+            count++;
+    }
+
+    return count;
+}
+
+bool QCanTxScheduler::Start()
+{
+    if (m_TimerFd < 0 || !m_CanChannel->IsValid())
+        return false;
+
+    m_TerminationRequested = false;
+
+    QThread::start(QThread::TimeCriticalPriority);
+
+    return true;
+}
+
+void QCanTxScheduler::Stop()
+{
+    m_TerminationRequested = true;
+
+    wait();
+}
+
+bool QCanTxScheduler::getStatistics(QCanSignalContainer *message, QCanTxStatistics & stats) const
+{
+    Entry *e = m_EntryMap.value(message, NULL);
+    int sequence;
+
+    if (!e)
+        return false;
+
+    do {
+        sequence = e->lock.beginRead();
+        stats = e->stats;
+    } while (e->lock.retryRead(sequence));
+
+    return true;
+}
+
+void QCanTxScheduler::transmit(Entry *e, quint64 now_ns)
+{
+    QCanMessage message;
+    qint64 jitter;
+
+    e->message->buildMessage(message);
+    m_CanChannel->Send(message);
+
+    jitter = (qint64)(_now_ns() - e->deadline_ns);
+
+    e->lock.beginWrite();
+
+    QCanTxStatistics & s = e->stats;
+
+    if (s.count == 0 || jitter < s.minJitter_ns)
+        s.minJitter_ns = jitter;
+
+    if (s.count == 0 || jitter > s.maxJitter_ns)
+        s.maxJitter_ns = jitter;
+
+    s.count++;
+    s.lastJitter_ns = jitter;
+    s.meanJitter_ns += (jitter - s.meanJitter_ns) / s.count;
+
+    // Skip cycles we are already too late for instead of bursting them out
+    e->deadline_ns += e->interval_ns;
+    while (e->deadline_ns <= now_ns) {
+        e->deadline_ns += e->interval_ns;
+        s.missed++;
+    }
+
+    e->lock.endWrite();
+}
+
+quint64 QCanTxScheduler::toTick(quint64 time_ns) const
+{
+    // Round up, a message must never be sent before its deadline
+    return (time_ns + m_Resolution_ns - 1) / m_Resolution_ns;
+}
+
+void QCanTxScheduler::run()
+{
+    const quint64 start_ns = _now_ns();
+
+    QCanTimingWheel wheel(0);
+    QVector<QCanTimer*> expired;
+
+    expired.reserve(m_Entries.size());
+
+    // Spread first transmissions over the scheduler ticks of one interval
+    // to avoid sending all messages in the same tick
+    for (int i = 0; i < m_Entries.size(); i++) {
+        Entry *e = m_Entries[i];
+
+        e->deadline_ns = start_ns + e->interval_ns + ((i * m_Resolution_ns) % e->interval_ns);
+        wheel.schedule(e, toTick(e->deadline_ns - start_ns));
+    }
+
+    while (!m_TerminationRequested) {
+        quint64 tick;
+
+        if (wheel.getNextExpiry(tick)) {
+            struct itimerspec its;
+            quint64 deadline_ns = start_ns + tick * m_Resolution_ns;
+
+            memset(&its, 0, sizeof(its));
+            its.it_value.tv_sec = deadline_ns / 1000000000ULL;
+            its.it_value.tv_nsec = deadline_ns % 1000000000ULL;
+
+            timerfd_settime(m_TimerFd, TFD_TIMER_ABSTIME, &its, NULL);
+        }
+
+        fd_set rdfs;
+        struct timeval tv;
+        FD_ZERO(&rdfs);
+
+        FD_SET(m_TimerFd, &rdfs);
+
+        tv.tv_sec = 0;
+        tv.tv_usec = 10 * 1000;
+
+        int ret = select(m_TimerFd + 1, &rdfs, NULL, NULL, &tv);
+
+        if (ret < 0)
+            break;
+
+        if (ret == 0)
+            continue;
+
+        quint64 expirations;
+        if (read(m_TimerFd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            continue;
+
+        quint64 now_ns = _now_ns();
+
+        expired.clear();
+        wheel.advance((now_ns - start_ns) / m_Resolution_ns, expired);
+
+        for (int i = 0; i < expired.size(); i++) {
+            Entry *e = static_cast<Entry *>(expired[i]);
+
+            transmit(e, now_ns);
+
+            wheel.schedule(e, toTick(e->deadline_ns - start_ns));
+        }
+    }
+}
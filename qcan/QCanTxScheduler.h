@@ -0,0 +1,120 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QCANTXSCHEDULER_H_
+#define QCANTXSCHEDULER_H_
+
+#include <QThread>
+#include <QVector>
+#include <QHash>
+
+#include "QCanSeqLock.h"
+#include "QCanTimingWheel.h"
+
+class QCanChannel;
+class QCanSignals;
+class QCanSignalContainer;
+
+/**
+ * Transmit statistics of a cyclic message, jitter is the delay between the
+ * deadline of a cycle and the moment the frame was written to the channel.
+ */
+struct QCanTxStatistics
+{
+    quint64 count;
+    quint64 missed;
+
+    qint64 lastJitter_ns;
+    qint64 minJitter_ns;
+    qint64 maxJitter_ns;
+    double meanJitter_ns;
+};
+
+/**
+ * Sends messages cyclically on a CAN channel.
+ *
+ * All messages share one timerfd armed with absolute CLOCK_MONOTONIC
+ * deadlines, due messages are looked up in a timing wheel. Deadlines are
+ * derived from the start time and the interval, so cycles don't drift.
+ */
+class QCanTxScheduler : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @param channel channel to send messages on
+     * @param resolution_us scheduler tick in microseconds
+     */
+    QCanTxScheduler(QCanChannel *channel, quint32 resolution_us = 1000);
+    ~QCanTxScheduler();
+
+    /**
+     * Add a message to be sent cyclically. Must be called before Start().
+     * @param message message to send
+     * @param interval_ms cycle time, 0 uses the interval declared in the KCD
+     * @return false if the message has no cycle time
+     */
+    bool addMessage(QCanSignalContainer *message, quint32 interval_ms = 0);
+
+    /**
+     * Add all messages with a KCD interval
+     * @return number of added messages
+     */
+    int addMessages(QCanSignals *canSignals);
+
+    bool Start();
+    void Stop();
+
+    /**
+     * Read transmit statistics of a message. May be called from any thread.
+     * @return false if message is not scheduled
+     */
+    bool getStatistics(QCanSignalContainer *message, QCanTxStatistics & stats) const;
+
+protected:
+    void run();
+
+private:
+    struct Entry : public QCanTimer {
+        QCanSignalContainer *message;
+
+        quint64 interval_ns;
+        quint64 deadline_ns;
+
+        QCanSeqLock lock;
+        QCanTxStatistics stats;
+    };
+
+    void transmit(Entry *e, quint64 now_ns);
+    quint64 toTick(quint64 time_ns) const;
+
+    QCanChannel *m_CanChannel;
+    const quint64 m_Resolution_ns;
+
+    QVector<Entry*> m_Entries;
+    QHash<QCanSignalContainer*, Entry*> m_EntryMap;
+
+    int m_TimerFd;
+    bool m_TerminationRequested;
+};
+
+#endif /* QCANTXSCHEDULER_H_ */
@@ -2,8 +2,47 @@ TEMPLATE = lib
 CONFIG += staticlib
 TARGET = qcan
 QT += core \
+      network \
       xml
 HEADERS += QCanSignals.h \
-           QCanChannel.h
+           QCanChannel.h \
+           QCanChannelStatistics.h \
+           QCanSeqLock.h \
+           QCanTimingWheel.h \
+           QCanTxScheduler.h \
+           QCanTimeoutMonitor.h \
+           QCanReplayChannel.h \
+           QCanRecordFormat.h \
+           QCanRecorder.h \
+           QCanRecordReader.h \
+           QCanFlightRecorder.h \
+           QCanPredicate.h \
+           QCanGateway.h \
+           QCanSharedFormat.h \
+           QCanSharedSignals.h \
+           QCanSharedSignalsClient.h \
+           QCanStreamFormat.h \
+           QCanStreamServer.h \
+           QCanStreamClient.h \
+           QCanMergeChannel.h \
+           QCanSignalStatistics.h \
+           QCanTrace.h
 SOURCES += QCanSignals.cc \
-           QCanChannel.cc
+           QCanChannel.cc \
+           QCanChannelStatistics.cc \
+           QCanTimingWheel.cc \
+           QCanTxScheduler.cc \
+           QCanTimeoutMonitor.cc \
+           QCanReplayChannel.cc \
+           QCanRecorder.cc \
+           QCanRecordReader.cc \
+           QCanFlightRecorder.cc \
+           QCanPredicate.cc \
+           QCanGateway.cc \
+           QCanSharedSignals.cc \
+           QCanSharedSignalsClient.cc \
+           QCanStreamServer.cc \
+           QCanStreamClient.cc \
+           QCanMergeChannel.cc \
+           QCanSignalStatistics.cc \
+           QCanTrace.cc
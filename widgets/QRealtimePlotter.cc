@@ -24,8 +24,12 @@
 #include <qwt/qwt_scale_widget.h>
 #include <qwt/qwt_legend.h>
 #include <qwt/qwt_legend_data.h>
+#include <qwt/qwt_legend_label.h>
+#include <qwt/qwt_plot_zoomer.h>
+#include <qwt/qwt_plot_panner.h>
 
 #include "QRealtimePlotter.h"
+#include "QRealtimeRenderer.h"
 
 /// Small helper to provide a date/time string for the bottom scale
 class TimeScaleDraw : public QwtScaleDraw
@@ -38,7 +42,42 @@ public:
     }
 };
 
-QRealtimePlotter::QRealtimePlotter(double buffer_time_ms, QWidget *parent) : QwtPlot(parent)
+/// Zoomer showing the time of the cursor position
+class TimeZoomer : public QwtPlotZoomer
+{
+public:
+    TimeZoomer(int xAxis, int yAxis, QWidget *canvas) : QwtPlotZoomer(xAxis, yAxis, canvas) {}
+
+protected:
+    virtual QwtText trackerTextF(const QPointF & pos) const {
+        return QString("%1, %2")
+                .arg(QDateTime::fromMSecsSinceEpoch(static_cast<quint64>(pos.x())).time().toString("hh:mm:ss.zzz"))
+                .arg(pos.y());
+    }
+};
+
+/// Curve leaving the painting to the renderer in threaded mode
+class RealtimeCurve : public QwtPlotCurve
+{
+public:
+    RealtimeCurve() {}
+
+protected:
+    virtual void drawSeries(QPainter *painter, const QwtScaleMap & xMap, const QwtScaleMap & yMap,
+                            const QRectF & canvasRect, int from, int to) const {
+        const QRealtimePlotter *p = static_cast<const QRealtimePlotter *>(plot());
+
+        if (p && p->getRenderMode() == QRealtimePlotter::E_RENDER_THREADED)
+            return;
+
+        QwtPlotCurve::drawSeries(painter, xMap, yMap, canvasRect, from, to);
+    }
+};
+
+QRealtimePlotter::QRealtimePlotter(double buffer_time_ms, QWidget *parent, QRealtimeSampleStores *stores)
+ : QwtPlot(parent), m_Stores(stores), m_Master(NULL), m_TimeFrom(0.0), m_TimeTo(0.0), m_Paused(false),
+   m_FrameRate(0), m_Dirty(false), m_RenderMode(E_RENDER_DIRECT), m_Renderer(NULL),
+   m_RasterItem(NULL), m_PaintTime_us(0)
 {
     setAxisScaleDraw(QwtPlot::xBottom, new TimeScaleDraw());
     setAxisLabelRotation(QwtPlot::xBottom, -50.0);
@@ -50,16 +89,16 @@ QRealtimePlotter::QRealtimePlotter(double buffer_time_ms, QWidget *parent) : Qwt
 
     setAxisTitle(QwtPlot::xBottom, "Time");
 
-    QwtLegend *legend = new QwtLegend;
-    legend->setDefaultItemMode( QwtLegendData::Checkable );
-    insertLegend( legend, QwtPlot::RightLegend );
-
-    connect( this, SIGNAL( legendChecked( QwtPlotItem *, bool ) ), SLOT( showItem( QwtPlotItem *, bool ) ) ) ;
+    setLegendPosition(QwtPlot::RightLegend);
 
     setTimeScale(1000.0);
 
     QObject::connect(&m_UpdateTimer, SIGNAL(timeout()), this, SLOT(updateTimeScale()));
 
+    m_FrameTimer.setSingleShot(true);
+    QObject::connect(&m_FrameTimer, SIGNAL(timeout()), this, SLOT(renderFrame()));
+    setFrameRate(30);
+
     setFrameStyle(QFrame::NoFrame);
     setLineWidth(0);
     ((QFrame *)canvas())->setLineWidth(2);
@@ -72,24 +111,191 @@ QRealtimePlotter::QRealtimePlotter(double buffer_time_ms, QWidget *parent) : Qwt
 
     setCanvasBackground(QColor(0, 0, 0));
 
+    // Rubber band zoom with the left, zoom out with the right button
+    m_Zoomer[E_SCALE_LEFT] = new TimeZoomer(QwtPlot::xBottom, QwtPlot::yLeft, canvas());
+    m_Zoomer[E_SCALE_LEFT]->setRubberBandPen(QPen(Qt::white, 0, Qt::DashLine));
+    m_Zoomer[E_SCALE_LEFT]->setTrackerPen(QPen(Qt::white));
+
+    m_Zoomer[E_SCALE_RIGHT] = new QwtPlotZoomer(QwtPlot::xTop, QwtPlot::yRight, canvas());
+    m_Zoomer[E_SCALE_RIGHT]->setRubberBand(QwtPicker::NoRubberBand);
+    m_Zoomer[E_SCALE_RIGHT]->setTrackerMode(QwtPicker::AlwaysOff);
+
+    // The middle button belongs to the panner: zoom out one step with the
+    // right button, Ctrl+right goes back to the base, Shift+right zooms in
+    int i;
+
+    for(i = 0; i < E_NUM_SCALES; i++) {
+        m_Zoomer[i]->setMousePattern(QwtEventPattern::MouseSelect2, Qt::RightButton, Qt::ControlModifier);
+        m_Zoomer[i]->setMousePattern(QwtEventPattern::MouseSelect3, Qt::RightButton);
+        m_Zoomer[i]->setMousePattern(QwtEventPattern::MouseSelect6, Qt::RightButton, Qt::ShiftModifier);
+    }
+
+    QObject::connect(m_Zoomer[E_SCALE_LEFT], SIGNAL(activated(bool)), this, SLOT(navigationStarted()));
+
+    // Pan with the middle button
+    m_Panner = new QwtPlotPanner(canvas());
+    m_Panner->setMouseButton(Qt::MiddleButton);
+
+    QObject::connect(m_Panner, SIGNAL(panned(int, int)), this, SLOT(navigationStarted()));
+
     m_BufferTime_ms = buffer_time_ms;
+
+    if (!m_Stores)
+        m_Stores = new QRealtimeSampleStores(this);
+}
+
+QRealtimePlotter::~QRealtimePlotter()
+{
+    delete m_RasterItem;
+    delete m_Renderer;
 }
 
 void QRealtimePlotter::addCurve(scale_t scale, const QObject & source, const QColor & color)
 {
     struct Curve *c = new Curve();
 
-    c->curve = new QwtPlotCurve();
+    c->curve = new RealtimeCurve();
     c->curve->setRenderHint(QwtPlotItem::RenderAntialiased);
     c->curve->setPen(color);
+    c->curve->setYAxis(scale == E_SCALE_LEFT ? QwtPlot::yLeft : QwtPlot::yRight);
     c->curve->attach(this);
 
+    showCurve(c->curve, true);
+
+    c->store = m_Stores->getStore(source);
+
+    c->data = new QRealtimeSeriesData(c->store);
+    c->data->setResolution(canvas()->width());
+    c->curve->setData(c->data);
+
     c->source = &source;
 
     m_Curves[scale].push_back(c);
+    m_CurveBySource.insert(&source, c);
+
+    QObject::connect(c->store, SIGNAL(samplesAppended()), this, SLOT(scheduleReplot()),
+                     Qt::UniqueConnection);
+}
+
+void QRealtimePlotter::setLegendPosition(QwtPlot::LegendPosition pos)
+{
+    QwtLegend *legend = new QwtLegend;
+    legend->setDefaultItemMode( QwtLegendData::Checkable );
+    insertLegend( legend, pos );
 
-    QObject::connect(&source, SIGNAL(valueChanged(const struct timeval &, double)),
-                     this, SLOT(newSampleReceived(const struct timeval &, double)));
+    connect( legend, SIGNAL( checked( const QVariant &, bool, int ) ),
+             SLOT( legendChecked( const QVariant &, bool ) ) );
+
+    // A new legend starts unchecked, check the visible curves
+    QwtPlotItem *item;
+    foreach(item, itemList(QwtPlotItem::Rtti_PlotCurve))
+        showCurve(item, item->isVisible());
+}
+
+void QRealtimePlotter::legendChecked(const QVariant & itemInfo, bool on)
+{
+    QwtPlotItem *item = infoToItem(itemInfo);
+
+    if (item)
+        showCurve(item, on);
+}
+
+void QRealtimePlotter::showCurve(QwtPlotItem *item, bool on)
+{
+    QwtLegend *legend = qobject_cast<QwtLegend *>(this->legend());
+
+    item->setVisible(on);
+
+    if (legend) {
+        QList<QWidget *> widgets = legend->legendWidgets(itemToInfo(item));
+
+        if (widgets.size() == 1) {
+            QwtLegendLabel *label = qobject_cast<QwtLegendLabel *>(widgets[0]);
+
+            if (label)
+                label->setChecked(on);
+        }
+    }
+
+    requestFrame();
+}
+
+void QRealtimePlotter::followTimeScale(QRealtimePlotter *master)
+{
+    m_Master = master;
+
+    suspendRecording();
+
+    QObject::connect(master, SIGNAL(timeScaleChanged(double, double)), this, SLOT(setTimeRange(double, double)));
+    QObject::connect(this, SIGNAL(timeScaleChanged(double, double)), master, SLOT(setTimeRange(double, double)));
+    QObject::connect(master, SIGNAL(pausedChanged(bool)), this, SLOT(setPaused(bool)));
+    QObject::connect(this, SIGNAL(pausedChanged(bool)), master, SLOT(setPaused(bool)));
+
+    setTimeRange(master->axisScaleDiv(QwtPlot::xBottom).lowerBound(),
+                 master->axisScaleDiv(QwtPlot::xBottom).upperBound());
+}
+
+void QRealtimePlotter::setTimeRange(double from, double to)
+{
+    // The live view of the master is only changed by its own timer
+    if (!m_Master && !m_Paused)
+        return;
+
+    if (from == m_TimeFrom && to == m_TimeTo)
+        return;
+
+    setAxisScale(QwtPlot::xBottom, from, to);
+    setAxisScale(QwtPlot::xTop, from, to);
+
+    if (!m_Paused)
+        deleteOldSamples();
+
+    replot();
+}
+
+void QRealtimePlotter::setFrameRate(int fps)
+{
+    if (fps <= 0)
+        fps = 1;
+
+    m_FrameRate = fps;
+    m_FrameTimer.setInterval(1000 / fps);
+}
+
+void QRealtimePlotter::setMemoryBudget(qint64 bytes, qint64 spill_bytes)
+{
+    m_Stores->setMemoryBudget(bytes, spill_bytes);
+}
+
+void QRealtimePlotter::setRenderMode(render_mode_t mode)
+{
+    if (mode == m_RenderMode)
+        return;
+
+    m_RenderMode = mode;
+
+    if (mode == E_RENDER_THREADED) {
+        m_Renderer = new QRealtimeRenderer();
+        m_RasterItem = new QRealtimeRasterItem(m_Renderer);
+        m_RasterItem->attach(this);
+
+        QObject::connect(m_Renderer, SIGNAL(frameReady()), this, SLOT(replot()), Qt::QueuedConnection);
+
+        m_Renderer->start();
+    } else {
+        delete m_RasterItem;
+        m_RasterItem = NULL;
+
+        delete m_Renderer;
+        m_Renderer = NULL;
+    }
+
+    requestFrame();
+}
+
+qint64 QRealtimePlotter::getRasterTime_us() const
+{
+    return m_Renderer ? m_Renderer->getRasterTime_us() : 0;
 }
 
 void QRealtimePlotter::changeScale(scale_t scale,
@@ -120,14 +326,56 @@ void QRealtimePlotter::suspendRecording()
     m_UpdateTimer.stop();
 }
 
+void QRealtimePlotter::setPaused(bool paused)
+{
+    int i;
+
+    if (paused == m_Paused)
+        return;
+
+    m_Paused = paused;
+
+    if (paused) {
+        suspendRecording();
+
+        // Zooming out ends at the view the plot was paused at
+        for(i = 0; i < E_NUM_SCALES; i++)
+            m_Zoomer[i]->setZoomBase(false);
+    } else {
+        for(i = 0; i < E_NUM_SCALES; i++)
+            m_Zoomer[i]->zoom(0);
+
+        // Followers continue with the live view of the master
+        if (m_Master)
+            setTimeRange(m_Master->axisScaleDiv(QwtPlot::xBottom).lowerBound(),
+                         m_Master->axisScaleDiv(QwtPlot::xBottom).upperBound());
+        else
+            startRecording();
+    }
+
+    emit pausedChanged(paused);
+}
+
+void QRealtimePlotter::navigationStarted()
+{
+    setPaused(true);
+}
+
 void QRealtimePlotter::updateTimeScale()
 {
+    if (m_Paused || m_Master)
+        return;
+
     double now = static_cast<double>(QDateTime::currentDateTime().toMSecsSinceEpoch());
 
     setAxisScale(QwtPlot::xBottom, now, now + m_Interval);
 
+    // The time scale of the right zoomer
+    setAxisScale(QwtPlot::xTop, now, now + m_Interval);
+
     deleteOldSamples();
 
+    m_Dirty = false;
     replot();
 
     m_UpdateTimer.start(m_Interval);
@@ -140,55 +388,155 @@ void QRealtimePlotter::deleteOldSamples()
     for(i = 0; i < E_NUM_SCALES; i++) {
         struct Curve *c = NULL;
 
-        // Find curve of sender and append sample value
         foreach(c, m_Curves[i]) {
-            if (c->timedata.empty())
+            if (c->store->getSampleCount() == 0)
                 continue;
 
-            double latest_sample = c->timedata.back();
+            double latest_sample = c->store->at(c->store->getEndIndex() - 1).x();
 
-            QVector<double>::iterator time_iter   = c->timedata.begin();
-            QVector<double>::iterator sample_iter = c->sample.begin();
+            c->store->expire(latest_sample - m_BufferTime_ms);
+        }
+    }
+}
 
-            while (time_iter != c->timedata.end()) {
-                if ((latest_sample - *time_iter) > m_BufferTime_ms) {
-                    time_iter = c->timedata.erase(time_iter);
-                    sample_iter = c->sample.erase(sample_iter);
-                    continue;
-                } else {
-                    // Elements are in order if we stumble about a sample not
-                    // older than m_BufferTime_ms we can stop erasing samples.
-                    break;
-                }
+void QRealtimePlotter::resizeEvent(QResizeEvent *e)
+{
+    int i;
 
-                ++time_iter;
-                ++sample_iter;
-            }
+    QwtPlot::resizeEvent(e);
 
-            c->curve->setSamples(c->timedata, c->sample);
-        }
+    for(i = 0; i < E_NUM_SCALES; i++) {
+        struct Curve *c = NULL;
+
+        foreach(c, m_Curves[i])
+            c->data->setResolution(canvas()->width());
     }
+
+    // Rasterised image doesn't fit the canvas anymore
+    if (m_Renderer)
+        requestFrame();
 }
 
 void QRealtimePlotter::newSampleReceived(const struct timeval & tv, double sample)
 {
-    QObject *s = QObject::sender();
-    int i;
+    struct Curve *c = m_CurveBySource.value(QObject::sender(), NULL);
+
+    if (!c)
+        return;
+
+    c->store->append((tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0), sample);
+
+    scheduleReplot();
+}
+
+void QRealtimePlotter::scheduleReplot()
+{
+    m_Dirty = true;
+
+    // Samples are still buffered but the frozen view isn't redrawn
+    if (m_Paused)
+        return;
+
+    if (!m_FrameTimer.isActive())
+        m_FrameTimer.start();
+}
+
+void QRealtimePlotter::requestFrame()
+{
+    m_Dirty = true;
+
+    if (!m_FrameTimer.isActive())
+        m_FrameTimer.start();
+}
+
+void QRealtimePlotter::renderFrame()
+{
+    if (!m_Dirty)
+        return;
+
+    m_Dirty = false;
+
+    if (m_Renderer)
+        submitFrame();
+    else
+        replot();
+}
+
+void QRealtimePlotter::submitFrame()
+{
+    QRealtimeRenderJob job;
+    int axis, i, j;
+
+    // Scales and rects of interest of the series as replot() would set them
+    updateAxes();
+
+    job.size = canvas()->size();
+
+    for (axis = 0; axis < QwtPlot::axisCnt; axis++)
+        job.maps[axis] = canvasMap(axis);
 
     for(i = 0; i < E_NUM_SCALES; i++) {
         struct Curve *c = NULL;
 
-        // Find curve of sender and append sample value
         foreach(c, m_Curves[i]) {
-            if (c->source == s) {
-                c->sample.push_back(sample);
-                c->timedata.push_back((tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0));
+            if (!c->curve->isVisible())
+                continue;
+
+            QRealtimeRenderJob::Curve curve;
+            const int n = c->data->size();
+
+            // Only the decimated view is copied, bounded by the canvas width
+            curve.points.resize(n);
 
-                c->curve->setSamples(c->timedata, c->sample);
-            }
+            for (j = 0; j < n; j++)
+                curve.points[j] = c->data->sample(j);
+
+            curve.pen = c->curve->pen();
+            curve.xAxis = c->curve->xAxis();
+            curve.yAxis = c->curve->yAxis();
+
+            job.curves.push_back(curve);
         }
     }
 
-    replot();
+    m_Renderer->submit(job);
+}
+
+void QRealtimePlotter::replot()
+{
+    QwtScaleMap maps[QwtPlot::axisCnt];
+    int axis;
+
+    QwtPlot::replot();
+
+    const QwtScaleDiv & time = axisScaleDiv(QwtPlot::xBottom);
+
+    if (time.lowerBound() != m_TimeFrom || time.upperBound() != m_TimeTo) {
+        m_TimeFrom = time.lowerBound();
+        m_TimeTo = time.upperBound();
+
+        emit timeScaleChanged(m_TimeFrom, m_TimeTo);
+    }
+
+    if (!m_Renderer)
+        return;
+
+    for (axis = 0; axis < QwtPlot::axisCnt; axis++)
+        maps[axis] = canvasMap(axis);
+
+    // Zooming, panning or moving the time scale outdates the image
+    if (!m_Renderer->isCurrent(maps, canvas()->size()))
+        requestFrame();
+}
+
+void QRealtimePlotter::drawCanvas(QPainter *painter)
+{
+    QElapsedTimer timer;
+
+    timer.start();
+
+    QwtPlot::drawCanvas(painter);
+
+    m_PaintTime_us = timer.nsecsElapsed() / 1000;
 }
 
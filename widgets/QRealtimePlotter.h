@@ -29,7 +29,12 @@
 
 #include <sys/time.h>
 
-#define MAX_SAMPLES 100000
+#include "QRealtimeSeriesData.h"
+
+class QwtPlotZoomer;
+class QwtPlotPanner;
+class QRealtimeRenderer;
+class QRealtimeRasterItem;
 
 class QRealtimePlotter : public QwtPlot
 {
@@ -39,22 +44,58 @@ public slots:
     void startRecording();
     void suspendRecording();
 
+    /**
+     * Freeze the time scale to inspect the buffered samples. Zooming or
+     * panning pauses the plot, resuming returns to the live view.
+     */
+    void setPaused(bool paused);
+
     /**
      * Slot to force updating of time scale to show now -> now + interval
      */
     void updateTimeScale();
 
     /**
-     * Slot when a new sample was received.
+     * Slot when a new sample was received. Curves added by addCurve()
+     * are fed by their sample store, this slot is kept for sources
+     * connected manually and looks up the curve of the sender.
      */
     void newSampleReceived(const struct timeval & tv, double sample);
 
+    /**
+     * Mark the plot as changed, it is redrawn with the next frame
+     */
+    void scheduleReplot();
+
+    /// Redraw axes and overlays, rasterised curves are requested if outdated
+    virtual void replot();
+
+    /// Show the time range from -> to, used to keep panes in sync
+    void setTimeRange(double from, double to);
+
+signals:
+    /// Plot was paused or resumed, also emitted when zooming pauses the plot
+    void pausedChanged(bool paused);
+
+    /// Visible time range changed by the live view, zooming or panning
+    void timeScaleChanged(double from, double to);
+
 public:
     /**
      * @param buffer_time_ms Time to buffer samples. Plot will keep samples
      * for at least buffer_time_ms
+     * @param stores sample stores shared with other plots, the plot uses
+     * its own stores if NULL
      */
-    QRealtimePlotter(double buffer_time_ms, QWidget *parent = NULL);
+    QRealtimePlotter(double buffer_time_ms, QWidget *parent = NULL, QRealtimeSampleStores *stores = NULL);
+    virtual ~QRealtimePlotter();
+
+    typedef enum E_RENDER_MODE {
+        /// Curves are painted by replot() on the GUI thread
+        E_RENDER_DIRECT = 0,
+        /// Curves are rasterised on a worker thread, the GUI only blits the image
+        E_RENDER_THREADED
+    } render_mode_t;
 
     typedef enum E_SCALE {
         E_SCALE_LEFT = 0,
@@ -76,26 +117,92 @@ public:
      * @param interval_ms interval in milliseconds
      */
     void setTimeScale(const double & interval_ms);
+    double getTimeScale() const { return m_Interval; }
+
+    bool isPaused() const { return m_Paused; }
 
     /**
-     * Add source to given scale.
+     * Add source to given scale. Sources already shown by a plot sharing
+     * the sample stores reuse the stored samples.
      */
     void addCurve(scale_t scale, const QObject & source, const QColor & color);
 
+    /**
+     * Follow the time scale of another plot instead of running an own live
+     * view. Zooming, panning and pausing either plot applies to both.
+     */
+    void followTimeScale(QRealtimePlotter *master);
+
+    QRealtimeSampleStores * getSampleStores() const { return m_Stores; }
+
+    /// Move the (checkable) legend, it is on the right by default
+    void setLegendPosition(QwtPlot::LegendPosition pos);
+
+    /**
+     * Limit the number of replots per second (default: 30). New samples
+     * only mark the plot dirty, it is redrawn at most once per frame and
+     * not at all if nothing changed.
+     */
+    void setFrameRate(int fps);
+    int getFrameRate() const { return m_FrameRate; }
+
+    /**
+     * Limit the memory used for the samples of all curves, see
+     * QRealtimeSampleStores::setMemoryBudget(). The budget should be set
+     * before recording starts.
+     */
+    void setMemoryBudget(qint64 bytes, qint64 spill_bytes = 0);
+
+    void setRenderMode(render_mode_t mode);
+    render_mode_t getRenderMode() const { return m_RenderMode; }
+
+    /// Time the GUI thread spent painting the canvas of the last frame
+    qint64 getPaintTime_us() const { return m_PaintTime_us; }
+
+    /// Time the worker spent rasterising the last frame (threaded mode)
+    qint64 getRasterTime_us() const;
+
+private slots:
+    void renderFrame();
+
+    /// Axes or visible curves changed, draw a new frame even if paused
+    void requestFrame();
+
+    /// Zoomer or panner was used
+    void navigationStarted();
+
+    /// Legend entry of a curve was (un)checked
+    void legendChecked(const QVariant & itemInfo, bool on);
+
 protected:
+    /// Show or hide a curve and keep its legend entry in sync
+    void showCurve(QwtPlotItem *item, bool on);
+
     /// Delete all samples which doesn't fit into m_BufferTime_ms
     void deleteOldSamples();
 
+    /// Snapshot the visible curves for the renderer
+    void submitFrame();
+
+    virtual void drawCanvas(QPainter *painter);
+
+    /// Adapt the decimation of the curves to the canvas width
+    virtual void resizeEvent(QResizeEvent *e);
+
 private:
     struct Curve {
         QwtPlotCurve *curve;
-        QVector<double> sample;
-        QVector<double> timedata;
+
+        // Owned by curve
+        QRealtimeSeriesData *data;
+
+        QRealtimeSampleStore *store;
 
         QObject const * source;
     };
 
     QVector<struct Curve *> m_Curves[E_NUM_SCALES];
+    QHash<const QObject *, struct Curve *> m_CurveBySource;
 
     // Visible buffer size
     double m_Interval;
@@ -103,7 +210,33 @@ private:
     // Time in ms to keep samples in buffer
     double m_BufferTime_ms;
 
+    QRealtimeSampleStores *m_Stores;
+
+    // Plot whose time scale is followed
+    QRealtimePlotter *m_Master;
+
+    // Time range last announced by timeScaleChanged()
+    double m_TimeFrom;
+    double m_TimeTo;
+
     QTimer m_UpdateTimer;
+
+    bool m_Paused;
+
+    // One zoomer per value scale, both share the time scale
+    QwtPlotZoomer *m_Zoomer[E_NUM_SCALES];
+    QwtPlotPanner *m_Panner;
+
+    // Single shot, started by the first change after a frame
+    QTimer m_FrameTimer;
+    int m_FrameRate;
+    bool m_Dirty;
+
+    render_mode_t m_RenderMode;
+    QRealtimeRenderer *m_Renderer;
+    QRealtimeRasterItem *m_RasterItem;
+
+    qint64 m_PaintTime_us;
 };
 
 #endif /* QREALTIMEPLOTTER_H_ */
@@ -0,0 +1,171 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <QPainter>
+#include <QElapsedTimer>
+
+#include "QRealtimeRenderer.h"
+
+QRealtimeRenderer::QRealtimeRenderer()
+ : m_TerminationRequested(false), m_HasPending(false), m_RasterTime_us(0)
+{
+}
+
+QRealtimeRenderer::~QRealtimeRenderer()
+{
+    Stop();
+}
+
+void QRealtimeRenderer::Stop()
+{
+    m_Lock.lock();
+    m_TerminationRequested = true;
+    m_Wakeup.wakeAll();
+    m_Lock.unlock();
+
+    wait();
+}
+
+void QRealtimeRenderer::submit(const QRealtimeRenderJob & job)
+{
+    QMutexLocker locker(&m_Lock);
+
+    m_Pending = job;
+    m_HasPending = true;
+
+    m_Wakeup.wakeOne();
+}
+
+void QRealtimeRenderer::drawFrame(QPainter *painter)
+{
+    QMutexLocker locker(&m_Lock);
+
+    if (!m_Front.isNull())
+        painter->drawImage(QPointF(0.0, 0.0), m_Front);
+}
+
+bool QRealtimeRenderer::isCurrent(const QwtScaleMap maps[QwtPlot::axisCnt], const QSize & size)
+{
+    QMutexLocker locker(&m_Lock);
+    int axis;
+
+    if (m_Front.isNull() || m_FrontJob.size != size)
+        return false;
+
+    for (axis = 0; axis < QwtPlot::axisCnt; axis++) {
+        const QwtScaleMap & a = m_FrontJob.maps[axis];
+        const QwtScaleMap & b = maps[axis];
+
+        if (a.s1() != b.s1() || a.s2() != b.s2() || a.p1() != b.p1() || a.p2() != b.p2())
+            return false;
+    }
+
+    return true;
+}
+
+void QRealtimeRenderer::render(const QRealtimeRenderJob & job, QImage & image)
+{
+    int i, j;
+
+    if (image.size() != job.size)
+        image = QImage(job.size, QImage::Format_ARGB32_Premultiplied);
+
+    image.fill(Qt::transparent);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    QPolygonF polygon;
+
+    for (i = 0; i < job.curves.size(); i++) {
+        const QRealtimeRenderJob::Curve & c = job.curves[i];
+        const QwtScaleMap & xMap = job.maps[c.xAxis];
+        const QwtScaleMap & yMap = job.maps[c.yAxis];
+
+        polygon.resize(c.points.size());
+
+        for (j = 0; j < c.points.size(); j++)
+            polygon[j] = QPointF(xMap.transform(c.points[j].x()), yMap.transform(c.points[j].y()));
+
+        painter.setPen(c.pen);
+        painter.drawPolyline(polygon);
+    }
+}
+
+void QRealtimeRenderer::run()
+{
+    QRealtimeRenderJob job;
+    QElapsedTimer timer;
+
+    m_Lock.lock();
+
+    for (;;) {
+        if (m_TerminationRequested)
+            break;
+
+        if (!m_HasPending) {
+            m_Wakeup.wait(&m_Lock);
+            continue;
+        }
+
+        job = m_Pending;
+        m_HasPending = false;
+
+        // Rasterise without holding the lock, the GUI keeps drawing the front image
+        m_Lock.unlock();
+
+        timer.start();
+        render(job, m_Back);
+        m_RasterTime_us.store(timer.nsecsElapsed() / 1000);
+
+        m_Lock.lock();
+
+        m_Front.swap(m_Back);
+        m_FrontJob = job;
+
+        m_Lock.unlock();
+
+        emit frameReady();
+
+        m_Lock.lock();
+    }
+
+    m_Lock.unlock();
+}
+
+QRealtimeRasterItem::QRealtimeRasterItem(QRealtimeRenderer *renderer)
+ : m_Renderer(renderer)
+{
+    // Same level as the curves it is drawn for
+    setZ(20.0);
+    setItemAttribute(QwtPlotItem::Legend, false);
+    setItemAttribute(QwtPlotItem::AutoScale, false);
+}
+
+void QRealtimeRasterItem::draw(QPainter *painter, const QwtScaleMap & xMap,
+                               const QwtScaleMap & yMap, const QRectF & canvasRect) const
+{
+    Q_UNUSED(xMap);
+    Q_UNUSED(yMap);
+    Q_UNUSED(canvasRect);
+
+    // An outdated image is shown until the next frame is ready
+    m_Renderer->drawFrame(painter);
+}
@@ -0,0 +1,134 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QREALTIMERENDERER_H_
+#define QREALTIMERENDERER_H_
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <QImage>
+#include <QPen>
+#include <QVector>
+#include <qwt/qwt_plot.h>
+#include <qwt/qwt_plot_item.h>
+#include <qwt/qwt_scale_map.h>
+
+class QPainter;
+
+/**
+ * Snapshot of the visible curves of a plot, taken on the GUI thread and
+ * rasterised by QRealtimeRenderer
+ */
+struct QRealtimeRenderJob {
+    struct Curve {
+        QVector<QPointF> points;
+        QPen pen;
+        int xAxis;
+        int yAxis;
+    };
+
+    /// Size of the canvas
+    QSize size;
+
+    /// Maps of all axes at the time of the snapshot
+    QwtScaleMap maps[QwtPlot::axisCnt];
+
+    QVector<Curve> curves;
+};
+
+/**
+ * Rasterises curve snapshots into an image on a worker thread.
+ *
+ * The renderer owns two images: the worker draws into the back image and
+ * swaps it with the front image once done, the GUI thread only blits the
+ * front image. Jobs submitted while a frame is rendered replace each
+ * other, only the latest one is rendered next.
+ */
+class QRealtimeRenderer : public QThread
+{
+    Q_OBJECT
+
+signals:
+    /// A new front image is available (emitted on the worker thread)
+    void frameReady();
+
+public:
+    QRealtimeRenderer();
+    virtual ~QRealtimeRenderer();
+
+    void Stop();
+
+    /// Queue a snapshot for rendering
+    void submit(const QRealtimeRenderJob & job);
+
+    /// Draw the front image at the canvas origin
+    void drawFrame(QPainter *painter);
+
+    /// Whether the front image was rendered with the given maps and size
+    bool isCurrent(const QwtScaleMap maps[QwtPlot::axisCnt], const QSize & size);
+
+    /// Duration of the last rasterisation
+    qint64 getRasterTime_us() const { return m_RasterTime_us.load(); }
+
+protected:
+    void run();
+
+private:
+    void render(const QRealtimeRenderJob & job, QImage & image);
+
+    QMutex m_Lock;
+    QWaitCondition m_Wakeup;
+    bool m_TerminationRequested;
+
+    // Protected by m_Lock
+    QRealtimeRenderJob m_Pending;
+    bool m_HasPending;
+
+    QImage m_Front;
+    QRealtimeRenderJob m_FrontJob;
+
+    // Only used by the worker thread
+    QImage m_Back;
+
+    QAtomicInteger<qint64> m_RasterTime_us;
+};
+
+/**
+ * Plot item blitting the front image of a renderer, drawn in place of the
+ * curves when they are rasterised in the background
+ */
+class QRealtimeRasterItem : public QwtPlotItem
+{
+public:
+    QRealtimeRasterItem(QRealtimeRenderer *renderer);
+
+    virtual int rtti() const { return QwtPlotItem::Rtti_PlotUserItem; }
+
+    virtual void draw(QPainter *painter, const QwtScaleMap & xMap,
+                      const QwtScaleMap & yMap, const QRectF & canvasRect) const;
+
+private:
+    QRealtimeRenderer *m_Renderer;
+};
+
+#endif /* QREALTIMERENDERER_H_ */
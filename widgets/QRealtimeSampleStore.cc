@@ -0,0 +1,350 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <sys/mman.h>
+
+#include <QDir>
+
+#include "QRealtimeSampleStore.h"
+
+/// Spill file pages are released from the mapping in chunks of this size
+#define SPILL_RELEASE_CHUNK (1024 * 1024)
+
+QRealtimeSampleStore::QRealtimeSampleStore(int capacity, int spill_capacity, QObject *parent)
+ : QObject(parent), m_Spill(NULL), m_SpillCapacity(0), m_NumLevels(0)
+{
+    setCapacity(capacity, spill_capacity);
+}
+
+QRealtimeSampleStore::~QRealtimeSampleStore()
+{
+    closeSpill();
+}
+
+void QRealtimeSampleStore::setCapacity(int capacity, int spill_capacity)
+{
+    closeSpill();
+
+    m_Samples.resize(capacity > 0 ? capacity : 1);
+
+    if (spill_capacity > 0)
+        openSpill(spill_capacity);
+
+    qint64 span = 4;
+    int level;
+
+    for (level = 0; level < QREALTIME_LOD_LEVELS; level++)
+        m_Levels[level].clear();
+
+    m_NumLevels = 0;
+
+    // Levels with buckets larger than the buffer don't reduce anything
+    while (m_NumLevels < QREALTIME_LOD_LEVELS && span <= m_Samples.size() + m_SpillCapacity) {
+        qint64 samples = m_Samples.size();
+
+        if (m_NumLevels + 1 >= QREALTIME_LOD_SPILL_LEVEL)
+            samples += m_SpillCapacity;
+
+        // One more bucket for the partially expired and the incomplete one
+        m_Levels[m_NumLevels].resize(samples / span + 2);
+        m_NumLevels++;
+        span *= 4;
+    }
+
+    clear();
+}
+
+/// Memory used per sample in memory and per spilled sample by the levels
+static void _getSampleCost(double & per_sample, double & per_spilled)
+{
+    qint64 span = 4;
+    int level;
+
+    per_sample = sizeof(QPointF);
+    per_spilled = 0.0;
+
+    for (level = 1; level <= QREALTIME_LOD_LEVELS; level++) {
+        per_sample += double(sizeof(QRealtimeSampleStore::Bucket)) / span;
+
+        if (level >= QREALTIME_LOD_SPILL_LEVEL)
+            per_spilled += double(sizeof(QRealtimeSampleStore::Bucket)) / span;
+
+        span *= 4;
+    }
+}
+
+int QRealtimeSampleStore::getCapacityForBudget(qint64 bytes, int spill_capacity)
+{
+    double per_sample, per_spilled;
+
+    _getSampleCost(per_sample, per_spilled);
+
+    double capacity = (bytes - spill_capacity * per_spilled) / per_sample;
+
+    return capacity < 1.0 ? 0 : int(qMin(capacity, 1.0e9));
+}
+
+int QRealtimeSampleStore::getSpillCapacityForBudget(qint64 bytes)
+{
+    double per_sample, per_spilled;
+
+    _getSampleCost(per_sample, per_spilled);
+
+    double capacity = (bytes / 2) / per_spilled;
+
+    return capacity < 1.0 ? 0 : int(qMin(capacity, 2147483647.0));
+}
+
+bool QRealtimeSampleStore::openSpill(int spill_capacity)
+{
+    QByteArray path = QDir(QDir::tempPath()).filePath("QRealtimeSampleStore-XXXXXX").toLocal8Bit();
+    size_t size = size_t(spill_capacity) * sizeof(SpillSample);
+
+    int fd = mkstemp(path.data());
+
+    if (fd < 0) {
+        qWarning("Unable to create spill file in %s", qPrintable(QDir::tempPath()));
+        return false;
+    }
+
+    // Only reachable through the mapping, removed as soon as it is unmapped
+    unlink(path.constData());
+
+    void *p = MAP_FAILED;
+
+    if (ftruncate(fd, size) == 0)
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        qWarning("Unable to map spill file of %zu bytes", size);
+        return false;
+    }
+
+    m_Spill = static_cast<SpillSample *>(p);
+    m_SpillCapacity = spill_capacity;
+
+    return true;
+}
+
+void QRealtimeSampleStore::closeSpill()
+{
+    if (m_Spill)
+        munmap(m_Spill, size_t(m_SpillCapacity) * sizeof(SpillSample));
+
+    m_Spill = NULL;
+    m_SpillCapacity = 0;
+}
+
+void QRealtimeSampleStore::clear()
+{
+    m_First = 0;
+    m_Total = 0;
+
+    m_SpillFirst = 0;
+    m_SpillBase = 0.0;
+
+    m_MinY = 0.0;
+    m_MaxY = 0.0;
+}
+
+void QRealtimeSampleStore::spill(qint64 index, const QPointF & p)
+{
+    double time = (p.x() - m_SpillBase) * 100.0;
+
+    // Start over if the time doesn't fit anymore (after about 11h)
+    if (index == m_SpillFirst || time < 0.0 || time > 4294967295.0) {
+        m_SpillBase = p.x();
+        m_SpillFirst = index;
+        time = 0.0;
+    }
+
+    if (index - m_SpillFirst >= m_SpillCapacity)
+        m_SpillFirst = index - m_SpillCapacity + 1;
+
+    const qint64 slot = index % m_SpillCapacity;
+    SpillSample & s = m_Spill[slot];
+
+    s.time = quint32(time + 0.5);
+    s.value = float(p.y());
+
+    // Written pages stay in the page cache but don't count for the process
+    const qint64 offset = (slot + 1) * sizeof(SpillSample);
+
+    if (offset % SPILL_RELEASE_CHUNK == 0)
+        madvise(reinterpret_cast<char *>(m_Spill) + offset - SPILL_RELEASE_CHUNK, SPILL_RELEASE_CHUNK, MADV_DONTNEED);
+}
+
+void QRealtimeSampleStore::append(double x, double y)
+{
+    const QPointF p(x, y);
+    int level;
+
+    if (m_Total == m_First) {
+        m_MinY = y;
+        m_MaxY = y;
+    } else {
+        m_MinY = qMin(m_MinY, y);
+        m_MaxY = qMax(m_MaxY, y);
+    }
+
+    const qint64 dropped = m_Total - m_Samples.size();
+
+    if (dropped >= m_First) {
+        if (m_Spill)
+            spill(dropped, m_Samples[dropped % m_Samples.size()]);
+        else
+            m_First = dropped + 1;
+    }
+
+    if (m_Spill)
+        m_First = qMax(m_First, m_SpillFirst);
+
+    // Overwrites the oldest sample if the buffer is full
+    m_Samples[m_Total % m_Samples.size()] = p;
+
+    for (level = 0; level < m_NumLevels; level++) {
+        const int shift = 2 * (level + 1);
+        const qint64 b = m_Total >> shift;
+        Bucket & bucket = m_Levels[level][b % m_Levels[level].size()];
+
+        if ((m_Total & ((Q_INT64_C(1) << shift) - 1)) == 0) {
+            bucket.first = p;
+            bucket.min = p;
+            bucket.max = p;
+        } else {
+            if (y < bucket.min.y())
+                bucket.min = p;
+
+            if (y > bucket.max.y())
+                bucket.max = p;
+        }
+
+        bucket.last = p;
+    }
+
+    m_Total++;
+}
+
+void QRealtimeSampleStore::sampleReceived(const struct timeval & tv, double sample)
+{
+    append((tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0), sample);
+
+    emit samplesAppended();
+}
+
+void QRealtimeSampleStore::expire(double x)
+{
+    while (m_First < m_Total && at(m_First).x() < x)
+        m_First++;
+}
+
+qint64 QRealtimeSampleStore::lowerBound(double x) const
+{
+    qint64 lo = m_First, hi = m_Total;
+
+    while (lo < hi) {
+        qint64 mid = lo + (hi - lo) / 2;
+
+        if (at(mid).x() < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+bool QRealtimeSampleStore::hasBucket(int level, qint64 b) const
+{
+    const qint64 last = (m_Total - 1) >> (2 * level);
+
+    return b > last - m_Levels[level - 1].size();
+}
+
+QRealtimeSampleStores::QRealtimeSampleStores(QObject *parent)
+ : QObject(parent), m_MemoryBudget(0), m_SpillBudget(0)
+{
+}
+
+QRealtimeSampleStore * QRealtimeSampleStores::getStore(const QObject & source)
+{
+    QRealtimeSampleStore *store = m_Stores.value(&source, NULL);
+
+    if (store)
+        return store;
+
+    store = new QRealtimeSampleStore(MAX_SAMPLES, 0, this);
+    m_Stores.insert(&source, store);
+
+    QObject::connect(&source, SIGNAL(valueChanged(const struct timeval &, double)),
+                     store, SLOT(sampleReceived(const struct timeval &, double)));
+
+    if (m_MemoryBudget > 0)
+        applyMemoryBudget();
+
+    return store;
+}
+
+void QRealtimeSampleStores::setMemoryBudget(qint64 bytes, qint64 spill_bytes)
+{
+    m_MemoryBudget = bytes;
+    m_SpillBudget = spill_bytes;
+
+    if (m_MemoryBudget > 0)
+        applyMemoryBudget();
+}
+
+void QRealtimeSampleStores::applyMemoryBudget()
+{
+    const int stores = m_Stores.size();
+
+    if (stores == 0)
+        return;
+
+    const qint64 budget = m_MemoryBudget / stores;
+    int spill = QRealtimeSampleStore::getSpillCapacityForSize(m_SpillBudget / stores);
+    const int indexed = QRealtimeSampleStore::getSpillCapacityForBudget(budget);
+
+    // Levels of a larger spill file would eat up the memory budget
+    if (spill > indexed) {
+        qWarning("Memory budget of %lld MiB covers only %d spilled samples per curve, spill files are limited to that",
+                 m_MemoryBudget >> 20, indexed);
+        spill = indexed;
+    }
+
+    int capacity = QRealtimeSampleStore::getCapacityForBudget(budget, spill);
+
+    if (capacity < MIN_SAMPLES) {
+        qWarning("Memory budget of %lld MiB is too small for %d curves, keeping %d samples per curve",
+                 m_MemoryBudget >> 20, stores, MIN_SAMPLES);
+        capacity = MIN_SAMPLES;
+        spill = 0;
+    }
+
+    QRealtimeSampleStore *store = NULL;
+
+    foreach(store, m_Stores)
+        store->setCapacity(capacity, spill);
+}
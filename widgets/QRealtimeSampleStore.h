@@ -0,0 +1,230 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QREALTIMESAMPLESTORE_H_
+#define QREALTIMESAMPLESTORE_H_
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QPointF>
+
+#include <sys/time.h>
+
+/// Capacity of a sample store without a memory budget
+#define MAX_SAMPLES 100000
+
+/// Samples kept in memory by a store even if the memory budget is smaller
+#define MIN_SAMPLES 10000
+
+/// Number of decimation levels, level n combines 4^n samples
+#define QREALTIME_LOD_LEVELS 9
+
+/// First level which also covers the spilled samples
+#define QREALTIME_LOD_SPILL_LEVEL 3
+
+/**
+ * Samples of one signal in a fixed capacity ring buffer. Appending and
+ * expiring samples is O(1). Samples are addressed by a global index
+ * counting all samples appended since clear().
+ *
+ * Alongside the raw samples a min/max pyramid is maintained while
+ * appending: each bucket of a level keeps the first, last, minimum and
+ * maximum sample (M4) of 4^level samples.
+ *
+ * Optionally samples dropped from the ring are spilled to a memory mapped
+ * temporary file instead of being discarded. Spilled samples take 8 bytes
+ * (time in 10us steps and value as float) and stay available for
+ * scrolling back. Only the levels from QREALTIME_LOD_SPILL_LEVEL on cover
+ * the spilled samples, the finer ones are limited to the ring.
+ *
+ * A store is shared by all curves showing the signal, each curve reads it
+ * through its own QRealtimeSeriesData. Samples have to be appended in time
+ * order (x).
+ */
+class QRealtimeSampleStore : public QObject
+{
+    Q_OBJECT
+
+signals:
+    /// Emitted by sampleReceived()
+    void samplesAppended();
+
+public slots:
+    /// Append a sample of a signal (e.g. valueChanged of QCanSignal)
+    void sampleReceived(const struct timeval & tv, double sample);
+
+public:
+    struct Bucket {
+        QPointF first;
+        QPointF last;
+        QPointF min;
+        QPointF max;
+    };
+
+    /**
+     * @param capacity maximum number of samples kept in memory, the oldest
+     * sample is spilled or dropped when a sample is appended to a full buffer
+     * @param spill_capacity number of samples kept in the spill file, 0
+     * disables spilling
+     */
+    QRealtimeSampleStore(int capacity, int spill_capacity = 0, QObject *parent = NULL);
+    virtual ~QRealtimeSampleStore();
+
+    /// Change the capacities, all samples are dropped
+    void setCapacity(int capacity, int spill_capacity = 0);
+
+    /**
+     * @return number of samples that can be kept in memory if the store
+     * may use bytes of memory including its decimation levels, 0 if not
+     * even one sample fits
+     */
+    static int getCapacityForBudget(qint64 bytes, int spill_capacity = 0);
+
+    /**
+     * The decimation levels covering the spill file are kept in memory.
+     * @return number of spilled samples whose levels fit into half of
+     * bytes, the other half is left for the samples in memory
+     */
+    static int getSpillCapacityForBudget(qint64 bytes);
+
+    /// @return number of samples fitting into a spill file of bytes
+    static int getSpillCapacityForSize(qint64 bytes) {
+        return int(qMin<qint64>(bytes / sizeof(SpillSample), 0x7fffffff));
+    }
+
+    void append(double x, double y);
+
+    /// Drop all samples older than x
+    void expire(double x);
+
+    void clear();
+
+    int getCapacity() const { return m_Samples.size(); }
+    int getSpillCapacity() const { return m_SpillCapacity; }
+
+    /// Number of buffered samples
+    qint64 getSampleCount() const { return m_Total - m_First; }
+
+    /// Global index of the oldest sample
+    qint64 getFirstIndex() const { return m_First; }
+
+    /// Global index the next sample will get
+    qint64 getEndIndex() const { return m_Total; }
+
+    /// Sample by global index, from memory or the spill file
+    QPointF at(qint64 index) const {
+        if (index >= m_Total - m_Samples.size())
+            return m_Samples[index % m_Samples.size()];
+
+        const SpillSample & s = m_Spill[index % m_SpillCapacity];
+        return QPointF(m_SpillBase + s.time / 100.0, s.value);
+    }
+
+    /// Global index of the first sample with x >= value
+    qint64 lowerBound(double x) const;
+
+    int getLevelCount() const { return m_NumLevels; }
+
+    /// Whether bucket b of level (1-based) is still stored
+    bool hasBucket(int level, qint64 b) const;
+
+    const Bucket & getBucket(int level, qint64 b) const {
+        const QVector<Bucket> & buckets = m_Levels[level - 1];
+        return buckets[b % buckets.size()];
+    }
+
+    /// Value range of all samples since clear()
+    double getMinValue() const { return m_MinY; }
+    double getMaxValue() const { return m_MaxY; }
+
+private:
+    struct SpillSample {
+        quint32 time;
+        float value;
+    };
+
+    /// Move a sample dropped from the ring to the spill file
+    void spill(qint64 index, const QPointF & p);
+
+    bool openSpill(int spill_capacity);
+    void closeSpill();
+
+    QVector<QPointF> m_Samples;
+
+    // Global index of the oldest sample and of the next sample appended
+    qint64 m_First;
+    qint64 m_Total;
+
+    // Spilled sample i is stored at i % m_SpillCapacity
+    SpillSample *m_Spill;
+    int m_SpillCapacity;
+    qint64 m_SpillFirst;
+    double m_SpillBase;
+
+    // Level n is stored in m_Levels[n - 1], bucket b at b % size()
+    QVector<Bucket> m_Levels[QREALTIME_LOD_LEVELS];
+    int m_NumLevels;
+
+    double m_MinY;
+    double m_MaxY;
+};
+
+/**
+ * Sample stores of all signals shown by one or more plots. Each signal is
+ * stored once, no matter how many curves show it.
+ */
+class QRealtimeSampleStores : public QObject
+{
+    Q_OBJECT
+
+public:
+    QRealtimeSampleStores(QObject *parent = NULL);
+
+    /**
+     * @return store fed by the valueChanged signal of source, created on
+     * first use
+     */
+    QRealtimeSampleStore * getStore(const QObject & source);
+
+    int getStoreCount() const { return m_Stores.size(); }
+
+    /**
+     * Limit the memory used by all stores. The budget is split evenly
+     * between the stores, samples which don't fit are spilled to temporary
+     * files of up to spill_bytes (all stores) or dropped. Changing the
+     * budget or adding a store drops the buffered samples.
+     * @param bytes memory budget, 0 keeps MAX_SAMPLES per store
+     * @param spill_bytes size of the spill files, 0 disables spilling
+     */
+    void setMemoryBudget(qint64 bytes, qint64 spill_bytes = 0);
+
+private:
+    /// Resize all stores according to the memory budget
+    void applyMemoryBudget();
+
+    QHash<const QObject *, QRealtimeSampleStore *> m_Stores;
+
+    qint64 m_MemoryBudget;
+    qint64 m_SpillBudget;
+};
+
+#endif /* QREALTIMESAMPLESTORE_H_ */
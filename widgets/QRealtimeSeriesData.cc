@@ -0,0 +1,143 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "QRealtimeSeriesData.h"
+
+QRealtimeSeriesData::QRealtimeSeriesData(QRealtimeSampleStore *store)
+ : m_Store(store), m_Resolution(0), m_ViewFirst(-1), m_ViewEnd(-1), m_ViewLevel(0)
+{
+}
+
+void QRealtimeSeriesData::setResolution(int pixels)
+{
+    m_Resolution = pixels > 0 ? pixels : 0;
+
+    updateView();
+}
+
+void QRealtimeSeriesData::setRectOfInterest(const QRectF & rect)
+{
+    m_RectOfInterest = rect;
+
+    updateView();
+}
+
+void QRealtimeSeriesData::updateView()
+{
+    m_ViewLevel = 0;
+
+    // Without a resolution every sample is drawn
+    if (m_Resolution == 0 || m_RectOfInterest.width() <= 0.0) {
+        m_ViewFirst = -1;
+        m_ViewEnd = -1;
+        return;
+    }
+
+    // Keep one sample on each side so the curve reaches the canvas border
+    m_ViewFirst = qMax(m_Store->lowerBound(m_RectOfInterest.left()) - 1, m_Store->getFirstIndex());
+    m_ViewEnd = qMin(m_Store->lowerBound(m_RectOfInterest.right()) + 1, m_Store->getEndIndex());
+
+    const qint64 count = m_ViewEnd - m_ViewFirst;
+
+    // Raw samples until there are more than the four M4 points per pixel
+    if (count <= 4 * m_Resolution)
+        return;
+
+    int level;
+
+    for (level = 1; level <= m_Store->getLevelCount(); level++) {
+        const int shift = 2 * level;
+        const qint64 buckets = ((m_ViewEnd - 1) >> shift) - (m_ViewFirst >> shift) + 1;
+
+        // Finer levels don't reach back into the spilled samples
+        if (!m_Store->hasBucket(level, m_ViewFirst >> shift))
+            continue;
+
+        m_ViewLevel = level;
+
+        if (buckets <= m_Resolution)
+            break;
+    }
+}
+
+void QRealtimeSeriesData::getViewRange(qint64 & first, qint64 & end) const
+{
+    first = m_Store->getFirstIndex();
+    end = m_Store->getEndIndex();
+
+    // The store may have been expired or cleared since the view was set
+    if (m_ViewFirst >= 0) {
+        first = qMax(first, m_ViewFirst);
+        end = qMin(end, m_ViewEnd);
+    }
+
+    if (end < first)
+        end = first;
+}
+
+size_t QRealtimeSeriesData::size() const
+{
+    qint64 first, end;
+
+    getViewRange(first, end);
+
+    if (m_ViewLevel == 0 || first == end)
+        return end - first;
+
+    const int shift = 2 * m_ViewLevel;
+
+    return 4 * (((end - 1) >> shift) - (first >> shift) + 1);
+}
+
+QPointF QRealtimeSeriesData::sample(size_t i) const
+{
+    qint64 first, end;
+
+    getViewRange(first, end);
+
+    if (m_ViewLevel == 0)
+        return m_Store->at(first + i);
+
+    const QRealtimeSampleStore::Bucket & bucket =
+            m_Store->getBucket(m_ViewLevel, (first >> (2 * m_ViewLevel)) + i / 4);
+
+    // first, min and max in time order, last
+    switch (i % 4) {
+    case 0:
+        return bucket.first;
+    case 1:
+        return bucket.min.x() <= bucket.max.x() ? bucket.min : bucket.max;
+    case 2:
+        return bucket.min.x() <= bucket.max.x() ? bucket.max : bucket.min;
+    default:
+        return bucket.last;
+    }
+}
+
+QRectF QRealtimeSeriesData::boundingRect() const
+{
+    if (m_Store->getSampleCount() == 0)
+        return QRectF(1.0, 1.0, -2.0, -2.0);
+
+    const double first = m_Store->at(m_Store->getFirstIndex()).x();
+    const double last = m_Store->at(m_Store->getEndIndex() - 1).x();
+
+    return QRectF(first, m_Store->getMinValue(), last - first, m_Store->getMaxValue() - m_Store->getMinValue());
+}
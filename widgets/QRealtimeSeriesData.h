@@ -0,0 +1,86 @@
+/* Copyright Sebastian Haas <sebastian@sebastianhaas.info>. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef QREALTIMESERIESDATA_H_
+#define QREALTIMESERIESDATA_H_
+
+#include <QPointF>
+#include <QRectF>
+#include <qwt/qwt_series_data.h>
+
+#include "QRealtimeSampleStore.h"
+
+/**
+ * Curve view of a QRealtimeSampleStore, the curve reads the samples in
+ * place. Several curves (e.g. in different panes) can show the same store.
+ *
+ * Once setResolution() was called the series only exposes the samples
+ * inside the rect of interest and switches to the coarsest decimation
+ * level of the store that still has at most one bucket per pixel. The
+ * number of points drawn then depends on the canvas width instead of the
+ * buffer length, spikes are kept by min/max.
+ */
+class QRealtimeSeriesData : public QwtSeriesData<QPointF>
+{
+public:
+    /// @param store samples to show, not owned by the series
+    QRealtimeSeriesData(QRealtimeSampleStore *store);
+
+    QRealtimeSampleStore * getStore() const { return m_Store; }
+
+    /**
+     * Set the number of pixels the series is drawn on, 0 disables
+     * decimation and all buffered samples are drawn (default)
+     */
+    void setResolution(int pixels);
+    int getResolution() const { return m_Resolution; }
+
+    /// Decimation level chosen by the last setRectOfInterest(), 0 is raw
+    int getLevel() const { return m_ViewLevel; }
+
+    /// Points of the current view, see setRectOfInterest()
+    virtual size_t size() const;
+    virtual QPointF sample(size_t i) const;
+
+    /// Time range of the samples, value range of all samples since clear()
+    virtual QRectF boundingRect() const;
+
+    /// Restrict the view to the time range of rect and choose a level
+    virtual void setRectOfInterest(const QRectF & rect);
+
+private:
+    void updateView();
+
+    /// View range limited to the samples still stored
+    void getViewRange(qint64 & first, qint64 & end) const;
+
+    QRealtimeSampleStore *m_Store;
+
+    int m_Resolution;
+
+    // Visible range as set by setRectOfInterest()
+    QRectF m_RectOfInterest;
+    qint64 m_ViewFirst;
+    qint64 m_ViewEnd;
+    int m_ViewLevel;
+};
+
+#endif /* QREALTIMESERIESDATA_H_ */
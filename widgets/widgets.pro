@@ -5,6 +5,12 @@ QT += core \
       gui\
       widgets\
       xml
-HEADERS += QRealtimePlotter.h
-SOURCES += QRealtimePlotter.cc
+HEADERS += QRealtimePlotter.h \
+           QRealtimeSampleStore.h \
+           QRealtimeSeriesData.h \
+           QRealtimeRenderer.h
+SOURCES += QRealtimePlotter.cc \
+           QRealtimeSampleStore.cc \
+           QRealtimeSeriesData.cc \
+           QRealtimeRenderer.cc
 LIBS += -lqwt-qt5